@@ -0,0 +1,585 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+// Micro-benchmarks for the hot paths of mash (built by "make bench"). All
+// inputs are generated from fixed seeds, so runs are comparable across
+// commits. Each line reports the benchmark, the thread count, the number of
+// operations, the time per operation and, where it applies, the throughput.
+//
+// usage: mash-bench [-t <max threads>] [-s <scale>] [<name filter>]
+// (or "make bench BENCHFLAGS=...")
+
+#include "mash/CommandContain.h"
+#include "mash/CommandDistance.h"
+#include "mash/MinHashHeap.h"
+#include "mash/PValueTable.h"
+#include "mash/Sketch.h"
+#include "mash/ThreadPool.h"
+#include "mash/hash.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace::std;
+using namespace::mash;
+
+static string filter;
+static int threadsMax = 1;
+static double scale = 1;
+static string directory;
+
+double now()
+{
+    struct timeval time;
+    gettimeofday(&time, 0);
+    return time.tv_sec + time.tv_usec / 1e6;
+}
+
+bool selected(const string & name)
+{
+    return filter.empty() || name.find(filter) != string::npos;
+}
+
+void report(const string & name, int threads, uint64_t ops, double seconds, uint64_t bytes = 0)
+{
+    printf("%-28s %3d %12llu %12.1f ns/op", name.c_str(), threads, (unsigned long long)ops, seconds * 1e9 / ops);
+
+    if ( bytes > 0 )
+    {
+        printf(" %10.1f MB/s", bytes / seconds / 1e6);
+    }
+
+    printf("\n");
+    fflush(stdout);
+}
+
+uint64_t scaled(uint64_t count)
+{
+    uint64_t result = count * scale;
+    return result > 0 ? result : 1;
+}
+
+// Random genome with the given GC fraction.
+//
+void generateGenome(string & genome, uint64_t length, double gc, uint64_t seed)
+{
+    mt19937_64 random(seed);
+    uniform_real_distribution<double> uniform(0, 1);
+
+    genome.resize(length);
+
+    for ( uint64_t i = 0; i < length; i++ )
+    {
+        double u = uniform(random);
+
+        if ( u < gc )
+        {
+            genome[i] = u < gc / 2 ? 'G' : 'C';
+        }
+        else
+        {
+            genome[i] = u < gc + (1 - gc) / 2 ? 'A' : 'T';
+        }
+    }
+}
+
+// Copy of a genome with point substitutions at the given rate.
+//
+void mutateGenome(string & genome, double rate, uint64_t seed)
+{
+    static const char bases[] = "ACGT";
+    mt19937_64 random(seed);
+    uniform_real_distribution<double> uniform(0, 1);
+
+    for ( uint64_t i = 0; i < genome.length(); i++ )
+    {
+        if ( uniform(random) < rate )
+        {
+            genome[i] = bases[random() % 4];
+        }
+    }
+}
+
+string writeFasta(const string & name, const string & genome)
+{
+    string path = directory + "/" + name + ".fna";
+    ofstream file(path.c_str());
+
+    file << '>' << name << '\n';
+
+    for ( uint64_t i = 0; i < genome.length(); i += 80 )
+    {
+        file << genome.substr(i, 80) << '\n';
+    }
+
+    return path;
+}
+
+// k-finger file in the lyn2vec format: each line is an ID followed by the
+// lengths of k consecutive factors.
+//
+string writeFingerprints(const string & name, uint64_t references, uint64_t lines, int k, uint64_t seed)
+{
+    string path = directory + "/" + name + ".txt";
+    ofstream file(path.c_str());
+    mt19937_64 random(seed);
+    geometric_distribution<int> factorLength(0.15);
+
+    for ( uint64_t i = 0; i < references; i++ )
+    {
+        for ( uint64_t j = 0; j < lines; j++ )
+        {
+            file << "read" << i;
+
+            for ( int l = 0; l < k; l++ )
+            {
+                file << ' ' << factorLength(random) + 1;
+            }
+
+            file << '\n';
+        }
+    }
+
+    return path;
+}
+
+void setParameters(Sketch::Parameters & parameters, int kmerSize, uint64_t sketchSize, int threads)
+{
+    parameters.kmerSize = kmerSize;
+    parameters.minHashesPerWindow = sketchSize;
+    parameters.parallelism = threads;
+    parameters.seed = 42;
+    parameters.warning = 0.01;
+    parameters.concatenated = true;
+    setAlphabetFromString(parameters, alphabetNucleotide);
+    parameters.use64 = pow(parameters.alphabetSize, parameters.kmerSize) > pow(2, 32);
+}
+
+void benchHash()
+{
+    string genome;
+    generateGenome(genome, scaled(1 << 24), .5, 1);
+
+    if ( selected("getHash") )
+    {
+        uint64_t sum = 0;
+        uint64_t count = genome.length() - 21 + 1;
+        double start = now();
+
+        for ( uint64_t i = 0; i < count; i++ )
+        {
+            sum += getHash(genome.data() + i, 21, 42, true).hash64;
+        }
+
+        report("getHash k=21", 1, count, now() - start, count);
+
+        if ( sum == 0 ) printf("\n"); // (keep the loop)
+    }
+
+    if ( selected("getHashFingerPrint") )
+    {
+        mt19937_64 random(2);
+        vector<vector<uint64_t>> fingerprints(1 << 16, vector<uint64_t>(10));
+
+        for ( uint64_t i = 0; i < fingerprints.size(); i++ )
+        {
+            for ( uint64_t j = 0; j < fingerprints[i].size(); j++ )
+            {
+                fingerprints[i][j] = random() % 50 + 1;
+            }
+        }
+
+        uint64_t sum = 0;
+        uint64_t count = scaled(1 << 24);
+        double start = now();
+
+        for ( uint64_t i = 0; i < count; i++ )
+        {
+            const vector<uint64_t> & fingerprint = fingerprints[i % fingerprints.size()];
+            sum += getHashFingerPrint(fingerprint, fingerprint.size() * sizeof(uint64_t), 42, true).hash64;
+        }
+
+        report("getHashFingerPrint k=10", 1, count, now() - start, count * 10 * sizeof(uint64_t));
+
+        if ( sum == 0 ) printf("\n");
+    }
+}
+
+void benchMinHashHeap()
+{
+    if ( ! selected("tryInsert") )
+    {
+        return;
+    }
+
+    mt19937_64 random(3);
+    uint64_t count = scaled(1 << 25);
+    MinHashHeap heap(true, 1000);
+    double start = now();
+
+    for ( uint64_t i = 0; i < count; i++ )
+    {
+        hash_u hash;
+        hash.hash64 = random();
+        heap.tryInsert(hash);
+    }
+
+    report("MinHashHeap::tryInsert s=1000", 1, count, now() - start);
+}
+
+void benchSketching()
+{
+    string genome;
+    generateGenome(genome, scaled(1 << 23), .4, 4);
+
+    Sketch::Parameters parameters;
+    setParameters(parameters, 21, 1000, 1);
+
+    if ( selected("addMinHashes") )
+    {
+        MinHashHeap heap(parameters.use64, parameters.minHashesPerWindow);
+        vector<char> seq(genome.begin(), genome.end());
+        double start = now();
+
+        addMinHashes(heap, seq.data(), seq.size(), parameters);
+
+        report("addMinHashes k=21 s=1000", 1, seq.size(), now() - start, seq.size());
+    }
+
+    if ( selected("getMinHashPositions") )
+    {
+        for ( uint64_t minHashes = 1; minHashes <= 16; minHashes *= 4 )
+        {
+            Sketch::Parameters parametersWindow(parameters);
+            parametersWindow.windowSize = 1000;
+            parametersWindow.minHashesPerWindow = minHashes;
+
+            vector<Sketch::PositionHash> loci;
+            vector<char> seq(genome.begin(), genome.end());
+            double start = now();
+
+            getMinHashPositions(loci, seq.data(), seq.size(), parametersWindow);
+
+            char name[64];
+            snprintf(name, sizeof(name), "getMinHashPositions w=1000 h=%d", int(minHashes));
+            report(name, 1, seq.size(), now() - start, seq.size());
+        }
+    }
+}
+
+void benchComparison()
+{
+    if ( ! selected("compareSketches") && ! selected("containSketches") )
+    {
+        return;
+    }
+
+    // one base genome and mutated copies at a range of distances
+
+    Sketch::Parameters parameters;
+    setParameters(parameters, 21, 1000, 1);
+
+    string base;
+    generateGenome(base, scaled(1 << 20), .5, 5);
+
+    vector<Sketch::Reference> references;
+
+    for ( int i = 0; i < 16; i++ )
+    {
+        string genome(base);
+        mutateGenome(genome, i * .01, 100 + i);
+
+        MinHashHeap heap(parameters.use64, parameters.minHashesPerWindow);
+        vector<char> seq(genome.begin(), genome.end());
+        addMinHashes(heap, seq.data(), seq.size(), parameters);
+
+        Sketch::Reference reference;
+        reference.length = genome.length();
+        setMinHashesForReference(reference, heap);
+        references.push_back(reference);
+    }
+
+    uint64_t count = scaled(1 << 20);
+    double kmerSpace = pow(4., 21);
+    PValueTable pValueTable(parameters.minHashesPerWindow);
+
+    if ( selected("compareSketches") )
+    {
+        CommandDistance::CompareOutput::PairOutput pair;
+        double start = now();
+
+        for ( uint64_t i = 0; i < count; i++ )
+        {
+            compareSketches(&pair, references[i % 16], references[(i / 16) % 16], 1000, 21, kmerSpace, -1, -1, pValueTable);
+        }
+
+        report("compareSketches s=1000", 1, count, now() - start);
+
+        start = now();
+
+        for ( uint64_t i = 0; i < count; i++ )
+        {
+            compareSketches(&pair, references[i % 16], references[(i / 16) % 16], 1000, 21, kmerSpace, .05, 1, pValueTable);
+        }
+
+        report("compareSketches s=1000 d<.05", 1, count, now() - start);
+    }
+
+    if ( selected("containSketches") )
+    {
+        double error;
+        double sum = 0;
+        double start = now();
+
+        for ( uint64_t i = 0; i < count; i++ )
+        {
+            sum += containSketches(references[i % 16].hashesSorted, references[(i / 16) % 16].hashesSorted, error);
+        }
+
+        report("containSketches s=1000", 1, count, now() - start);
+
+        if ( sum < 0 ) printf("\n");
+    }
+}
+
+void benchSketchFiles()
+{
+    if ( ! selected("initFromFiles") && ! selected("writeToCapnp") && ! selected("loadCapnp") )
+    {
+        return;
+    }
+
+    vector<string> files;
+    uint64_t bytes = 0;
+
+    for ( int i = 0; i < 16; i++ )
+    {
+        string genome;
+        char name[32];
+
+        generateGenome(genome, scaled(1 << 21), .3 + i * .025, 200 + i);
+        snprintf(name, sizeof(name), "genome%d", i);
+        files.push_back(writeFasta(name, genome));
+        bytes += genome.length();
+    }
+
+    Sketch sketch;
+
+    for ( int threads = 1; threads <= threadsMax; threads *= 2 )
+    {
+        Sketch::Parameters parameters;
+        setParameters(parameters, 21, 10000, threads);
+
+        Sketch sketchThreads;
+        double start = now();
+
+        sketchThreads.initFromFiles(files, parameters);
+
+        if ( selected("initFromFiles") )
+        {
+            report("initFromFiles (sketch) s=1e4", threads, files.size(), now() - start, bytes);
+        }
+
+        if ( threads == 1 )
+        {
+            sketch = sketchThreads;
+        }
+    }
+
+    string path = directory + "/genomes.msh";
+
+    if ( selected("writeToCapnp") || selected("loadCapnp") )
+    {
+        uint64_t count = scaled(64);
+        double start = now();
+
+        for ( uint64_t i = 0; i < count; i++ )
+        {
+            sketch.writeToCapnp(path.c_str());
+        }
+
+        report("writeToCapnp 16x1e4", 1, count, now() - start);
+    }
+
+    if ( selected("loadCapnp") )
+    {
+        Sketch::Parameters parameters;
+        setParameters(parameters, 21, 10000, 1);
+
+        vector<string> sketchFiles(16, path);
+        uint64_t count = scaled(16);
+        double start = now();
+
+        for ( uint64_t i = 0; i < count; i++ )
+        {
+            Sketch sketchLoaded;
+            sketchLoaded.initFromFiles(sketchFiles, parameters);
+        }
+
+        report("loadCapnp 16x(16x1e4)", 1, count * sketchFiles.size(), now() - start);
+    }
+}
+
+void benchFingerprints()
+{
+    if ( ! selected("initFromFingerprints") )
+    {
+        return;
+    }
+
+    string path = writeFingerprints("fingerprints", 64, scaled(1 << 12), 10, 6);
+
+    FILE * file = fopen(path.c_str(), "r");
+    fseek(file, 0, SEEK_END);
+    uint64_t bytes = ftell(file);
+    fclose(file);
+
+    Sketch::Parameters parameters;
+    setParameters(parameters, 1, 1000, 1);
+    parameters.fingerprint = true;
+    parameters.noncanonical = true;
+
+    vector<string> files(1, path);
+    Sketch sketch;
+
+    // (progress messages go to cout)
+    streambuf * coutBuffer = cout.rdbuf(0);
+    double start = now();
+
+    sketch.initFromFingerprints(files, parameters);
+
+    double seconds = now() - start;
+    cout.rdbuf(coutBuffer);
+
+    report("initFromFingerprints k=10", 1, 64 * scaled(1 << 12), seconds, bytes);
+}
+
+struct BenchInput
+{
+    uint64_t value;
+};
+
+struct BenchOutput
+{
+    uint64_t value;
+};
+
+BenchOutput * benchWork(BenchInput * input)
+{
+    BenchOutput * output = new BenchOutput();
+    output->value = input->value * 2;
+    return output;
+}
+
+void benchThreadPool()
+{
+    if ( ! selected("ThreadPool") )
+    {
+        return;
+    }
+
+    for ( int threads = 1; threads <= threadsMax; threads *= 2 )
+    {
+        ThreadPool<BenchInput, BenchOutput> threadPool(benchWork, threads);
+        uint64_t count = scaled(1 << 18);
+        uint64_t sum = 0;
+        double start = now();
+
+        for ( uint64_t i = 0; i < count; i++ )
+        {
+            BenchInput * input = new BenchInput();
+            input->value = i;
+            threadPool.runWhenThreadAvailable(input);
+
+            while ( threadPool.outputAvailable() )
+            {
+                BenchOutput * output = threadPool.popOutputWhenAvailable();
+                sum += output->value;
+                delete output;
+            }
+        }
+
+        while ( threadPool.running() )
+        {
+            BenchOutput * output = threadPool.popOutputWhenAvailable();
+            sum += output->value;
+            delete output;
+        }
+
+        report("ThreadPool handoff", threads, count, now() - start);
+
+        if ( sum != count * (count - 1) )
+        {
+            cerr << "ERROR: ThreadPool lost outputs." << endl;
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, const char ** argv)
+{
+    threadsMax = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( strcmp(argv[i], "-t") == 0 && i + 1 < argc )
+        {
+            threadsMax = atoi(argv[++i]);
+        }
+        else if ( strcmp(argv[i], "-s") == 0 && i + 1 < argc )
+        {
+            scale = atof(argv[++i]);
+        }
+        else if ( argv[i][0] == '-' )
+        {
+            cerr << "usage: " << argv[0] << " [-t <max threads>] [-s <scale>] [<name filter>]" << endl;
+            return 1;
+        }
+        else
+        {
+            filter = argv[i];
+        }
+    }
+
+    if ( threadsMax < 1 )
+    {
+        threadsMax = 1;
+    }
+
+    char directoryTemplate[] = "/tmp/mash-bench-XXXXXX";
+
+    if ( mkdtemp(directoryTemplate) == 0 )
+    {
+        cerr << "ERROR: could not create a temporary directory." << endl;
+        return 1;
+    }
+
+    directory = directoryTemplate;
+
+    printf("%-28s %3s %12s %15s %15s\n", "#benchmark", "thr", "ops", "time", "throughput");
+
+    benchHash();
+    benchMinHashHeap();
+    benchSketching();
+    benchComparison();
+    benchSketchFiles();
+    benchFingerprints();
+    benchThreadPool();
+
+    string command = "rm -rf " + directory;
+
+    if ( system(command.c_str()) != 0 )
+    {
+        cerr << "WARNING: could not remove " << directory << "." << endl;
+    }
+
+    return 0;
+}
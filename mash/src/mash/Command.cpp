@@ -15,6 +15,7 @@
 #include <utility>
 
 #include "Command.h"
+#include "Stats.h"
 #include "version.h"
 
 using std::cout;
@@ -190,6 +191,8 @@ Command::Command()
     //                 "Error bound. The (maximum) number of min-hashes in each sketch will be one divided by this number squared.", "0.05"));
     addAvailableOption("sketchSize", Option(Option::Integer, "s", "Sketch", 
                       "Sketch size. Each sketch will have at most this many non-redundant min-hashes.", "1000"));
+    addAvailableOption("scaled", Option(Option::Integer, "-scaled", "Sketch", 
+                      "Scaled sketches (FracMinHash). Keep every hash in the lowest 1/<scale> of the hash space, rather than a fixed number of min-hashes (see -s), so sketches grow with their inputs and containment is estimated from all of a query's hashes, whatever the size of the reference. Incompatible with -s.", "", 1, 0xFFFFFFFF));
     addAvailableOption("verbose", Option(Option::Boolean, "v", "Output", "Verbose", ""));
     addAvailableOption("silent", Option(Option::Boolean, "s", "Output", "Silent", ""));
     addAvailableOption("individual", Option(Option::Boolean, "i", "Sketch", 
@@ -201,9 +204,9 @@ Command::Command()
     addAvailableOption("seed", Option(Option::Integer, "S", "Sketch", 
                       "Seed to provide to the hash function.", "42", 0, 0xFFFFFFFF));
     addAvailableOption("memory", Option(Option::Size, "b", "Reads", 
-                      "Use a Bloom filter of this size (raw bytes or with K/M/G/T) to filter out unique k-mers. This is useful if exact filtering with -m uses too much memory. However, some unique k-mers may pass erroneously, and copies cannot be counted beyond 2. Implies -r."));
+                      "Memory for the noise filter (raw bytes or with K/M/G/T). With -m, the size of the count-min sketch counting k-mers that have not yet passed (64M by default, or smaller when sized from -g or a single sequence with -i). Alone, a Bloom filter of this size filters out unique k-mers; copies cannot then be counted beyond 2. Either way, some k-mers may pass early by collision. Implies -r."));
     addAvailableOption("minCov", Option(Option::Integer, "m", "Reads", 
-                      "Minimum copies of each k-mer required to pass noise filter for reads. Implies -r.", "1"));
+                      "Minimum copies of each k-mer required to pass noise filter for reads. Copies are counted approximately, in fixed memory (see -b). Implies -r.", "1"));
     addAvailableOption("targetCov", Option(Option::Number, "c", "Reads", 
                       "Target coverage. Sketching will conclude if this coverage is reached before the end of the input file (estimated by average k-mer multiplicity). Implies -r."));
     addAvailableOption("genome", Option(Option::Size, "g", "Reads", 
@@ -214,6 +217,8 @@ Command::Command()
                       "Use amino acid alphabet (A-Z, except BJOUXZ). Implies -n, -k 9.", ""));
     addAvailableOption("alphabet", Option(Option::String, "z", "Alphabet", 
                       "Alphabet to base hashes on (case ignored by default; see -Z). K-mers with other characters will be ignored. Implies -n.", ""));
+    addAvailableOption("utf8", Option(Option::Boolean, "-utf8", "Alphabet", 
+                      "Sequences are UTF-8 text (such as fingerprints mapped to symbols). K-mers are formed over Unicode code points rather than bytes, and any code point other than controls and spaces is allowed. Implies -n.", ""));
     addAvailableOption("case", Option(Option::Boolean, "Z", "Alphabet", 
                       "Preserve case in k-mers and alphabet (case is ignored by default). Sequence letters whose case is not in the current alphabet will be skipped when sketching.", ""));
     addAvailableOption("threads", Option(Option::Integer, "p", "", 
@@ -235,6 +240,11 @@ Command::Command()
     addCategory("Window", "Sketching (windowed)");
     addCategory("Reads", "Sketching (reads)");
     addCategory("Alphabet", "Sketching (alphabet)");
+    addCategory("Stats", "Statistics");
+
+    // Opzioni comuni a tutti i comandi
+    addOption("stats", Option(Option::Boolean, "-stats", "Stats", "Print time spent in each phase (load, sketch, compare, output) and counters (bytes and records read, k-mers hashed, heap inserts, pairs compared, thread waits) and peak memory use to stderr when finished.", ""));
+    addOption("statsJson", Option(Option::Boolean, "-stats-json", "Stats", "As --stats, but as a single line of JSON.", ""));
 }
 
 // Stampa le opzioni e le descrizioni
@@ -372,7 +382,21 @@ int Command::run(int argc, const char **argv)
         }
     }
 
-    return run();
+    bool stats = options.at("stats").active || options.at("statsJson").active;
+
+    if (stats)
+    {
+        Stats::enable();
+    }
+
+    int result = run();
+
+    if (stats)
+    {
+        Stats::write(cerr, options.at("statsJson").active);
+    }
+
+    return result;
 }
 
 // Utilizza un'opzione predefinita
@@ -389,6 +413,7 @@ void Command::useSketchOptions()
     useOption("noncanonical");
     useOption("protein");
     useOption("alphabet");
+    useOption("utf8");
     useOption("case");
 #ifdef COMMAND_FIND
     useOption("windowed");
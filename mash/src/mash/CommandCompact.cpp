@@ -0,0 +1,46 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#include "CommandCompact.h"
+#include "SketchDatabase.h"
+#include <iostream>
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+namespace mash {
+
+CommandCompact::CommandCompact()
+: Command()
+{
+    name = "compact";
+    summary = "Merge the segments of a sketch database.";
+    description = "Merge the segments of a sketch database (" + string(suffixSketchDatabase) + "), which \"mash sketch\" and \"mash paste\" add to, into a single segment. The database can be read and added to while this runs; segments added meanwhile are kept. Merged segments are left for readers that may still be loading them, and removed by the next compaction.";
+    argumentString = "<database>" + string(suffixSketchDatabase);
+    
+    useOption("help");
+    addOption("packed", Option(Option::Boolean, "-pack", "", "Store hashes delta-encoded and bit-packed, which makes sketch files smaller (typically 2-3x for 32-bit hashes and 1.4x for 64-bit). Such files can only be read by versions of Mash that support them.", ""));
+}
+
+int CommandCompact::run() const
+{
+    if ( arguments.size() != 1 || options.at("help").active )
+    {
+        print();
+        return 0;
+    }
+    
+    if ( ! isSketchDatabase(arguments[0]) )
+    {
+        cerr << "ERROR: The file \"" << arguments[0] << "\" does not look like a sketch database (" << suffixSketchDatabase << ")." << endl;
+        return 1;
+    }
+    
+    return compactSketchDatabase(arguments[0], options.at("packed").active);
+}
+
+} // namespace mash
@@ -5,7 +5,10 @@
 // See the LICENSE.txt file included with this software for license information.
 
 #include "CommandContain.h"
+#include "ServeProtocol.h"
 #include "Sketch.h"
+#include "SketchDatabase.h"
+#include "Stats.h"
 #include <iostream>
 #include <zlib.h>
 #include "ThreadPool.h"
@@ -31,7 +34,9 @@ CommandContain::CommandContain()
                   "Both the reference and queries can be fasta or fastq, gzipped or not, or mash sketch files (.msh) "
                   "with matching k-mer sizes. Query files can also be files of file names (see -l). "
                   "The score is the number of intersecting min-hashes divided by the query set size. "
-                  "The output format is [score, error-bound, reference-ID, query-ID].";
+                  "The output format is [score, error-bound, reference-ID, query-ID]. "
+                  "With scaled sketches (see --scaled), the score is taken over all of the query's hashes, and each line "
+                  "ends with an identity estimate (score^(1/k)).";
     
     // Stringa che descrive gli argomenti attesi dal comando, in questo caso i file di riferimento e query
     argumentString = "<reference> <query> [<query>] ...";
@@ -50,12 +55,16 @@ CommandContain::CommandContain()
     // - Il valore predefinito di questa opzione è "0.05".
     addOption("errorThreshold", Option(Option::Number, "e", "Output", "Error bound threshold for reporting scores values. Error bounds can generally be increased by increasing the sketch size of the reference.", "0.05"));
     
+    // Opzione client per "mash serve": il riferimento è già caricato nel server.
+    addOption("server", Option(Option::File, "-server", "Input", "Send the queries to a \"mash serve\" process listening on this socket instead of loading a reference. All arguments are then queries, and are sketched with the parameters of the served reference.", ""));
+    
     // Aggiunta dell'opzione "help", ereditata dalla classe base Command.
     // Questa opzione generalmente fornisce informazioni sull'uso del comando.
     useOption("help");
     
     // Aggiunta delle opzioni relative agli sketch, che includono parametri come la dimensione del k-mer.
     useSketchOptions();
+    useOption("scaled");
 }
 
 
@@ -77,8 +86,10 @@ Termine dell'Esecuzione: La funzione si assicura che tutti i thread siano comple
 
 int CommandContain::run() const
 {
-    // Se il numero di argomenti è inferiore a 2 o l'opzione "help" è attiva, stampa l'aiuto e termina l'esecuzione.
-    if ( arguments.size() < 2 || options.at("help").active )
+    bool server = options.at("server").active;
+    
+    // Se il numero di argomenti è inferiore a 2 (1 con un server) o l'opzione "help" è attiva, stampa l'aiuto e termina l'esecuzione.
+    if ( arguments.size() < (server ? 1 : 2) || options.at("help").active )
     {
         print();  // Stampa il messaggio di aiuto.
         return 0; // Esce dalla funzione con codice di successo.
@@ -98,12 +109,37 @@ int CommandContain::run() const
     	return 1; // Esce dalla funzione con codice di errore.
     }
     
+    // Con un server tutti gli argomenti sono query: il server calcola il containment e restituisce l'output.
+    if ( server )
+    {
+        vector<string> queryFiles;
+        
+        for ( int i = 0; i < arguments.size(); i++ )
+        {
+            if ( list )
+            {
+                splitFile(arguments[i], queryFiles);
+            }
+            else
+            {
+                queryFiles.push_back(arguments[i]);
+            }
+        }
+        
+        ServeMessage request;
+        
+        request.putByte(ServeContain);
+        request.putDouble(parameters.error);
+        
+        return runServerQuery(options.at("server").argument, request, queryFiles, false, true, threads);
+    }
+    
     // Crea un oggetto Sketch per il riferimento.
     Sketch sketchRef;
     const string & fileReference = arguments[0];  // Il primo argomento è il file di riferimento.
     
     // Verifica se il file di riferimento è uno sketch (controlla l'estensione).
-    bool isSketch = hasSuffix(fileReference, suffixSketch);
+    bool isSketch = isSketchFile(fileReference);
     
     if ( isSketch )
     {
@@ -129,6 +165,12 @@ int CommandContain::run() const
         {
             cerr << "ERROR: The option " << options.at("alphabet").identifier << " cannot be used when a sketch is provided; it is inherited from the sketch." << endl;
         }
+        
+        if ( options.at("scaled").active )
+        {
+            cerr << "ERROR: The option " << options.at("scaled").identifier << " cannot be used when a sketch is provided; it is inherited from the sketch." << endl;
+            return 1;
+        }
     }
     else
     {
@@ -151,11 +193,22 @@ int CommandContain::run() const
         parameters.noncanonical = sketchRef.getNoncanonical();
         parameters.preserveCase = sketchRef.getPreserveCase();
         parameters.seed = sketchRef.getHashSeed();
+        parameters.scale = sketchRef.getScale();
+        parameters.fingerprintWhole = sketchRef.getFingerprintWhole();
+        parameters.hashScheme = sketchRef.getHashScheme();
         
-        // Ottiene l'alfabeto dallo sketch e lo imposta nei parametri.
-        string alphabet;
-        sketchRef.getAlphabetAsString(alphabet);
-        setAlphabetFromString(parameters, alphabet.c_str());
+        // Ottiene l'alfabeto dallo sketch e lo imposta nei parametri
+        // (quello UTF-8 non è un insieme di caratteri).
+        if ( sketchRef.getUnicode() )
+        {
+            setAlphabetUnicode(parameters);
+        }
+        else
+        {
+            string alphabet;
+            sketchRef.getAlphabetAsString(alphabet);
+            setAlphabetFromString(parameters, alphabet.c_str());
+        }
     }
     else
     {
@@ -210,6 +263,9 @@ int CommandContain::run() const
     uint64_t iFloor = pairsPerThread / sketchRef.getReferenceCount();
     uint64_t iMod = pairsPerThread % sketchRef.getReferenceCount();
     
+    // Il tempo da qui in poi è conteggiato nella fase di confronto (--stats).
+    StatsPhase phase(Stats::Compare);
+    
     // Avvia l'elaborazione delle coppie di riferimenti e query sui thread disponibili.
     for ( uint64_t i = 0, j = 0; i < sketchQuery.getReferenceCount(); i += iFloor, j += iMod )
     {
@@ -231,14 +287,14 @@ int CommandContain::run() const
         // Scrive l'output quando disponibile dal thread pool.
 		while ( threadPool.outputAvailable() )
 		{
-			writeOutput(threadPool.popOutputWhenAvailable(), parameters.error);
+			writeOutput(threadPool.popOutputWhenAvailable());
 		}
     }
     
     // Assicura che tutti i thread siano completati e scrive l'output finale.
     while ( threadPool.running() )
     {
-        writeOutput(threadPool.popOutputWhenAvailable(), parameters.error);
+        writeOutput(threadPool.popOutputWhenAvailable());
     }
     
     return 0;  // Termina l'esecuzione con codice di successo.
@@ -246,56 +302,12 @@ int CommandContain::run() const
 
 
 
-/**Inizializzazione degli Indici: Questi indici sono utilizzati per scorrere attraverso gli sketch di query (i) e di riferimento (j) mentre vengono processate le coppie di risultati.
-
-Iterazione sui Risultati: Il ciclo for percorre tutte le coppie di risultati (pairCount) e si assicura che ci siano ancora sketch di query da confrontare.
-
-Accesso alla Coppia di Risultati: La struttura PairOutput rappresenta il risultato di una singola comparazione tra uno sketch di query e uno di riferimento.
-
-Filtraggio per Errore: Solo le comparazioni che hanno un errore inferiore o uguale al valore fornito vengono considerate per l'output.
-
-Scrittura dell'Output: Se la coppia è valida (cioè ha un errore accettabile), i risultati vengono stampati, mostrando il punteggio, l'errore e i nomi degli sketch comparati.
-
-Avanzamento degli Indici: Dopo ogni comparazione, l'indice del riferimento (j) viene incrementato. Quando tutti gli sketch di riferimento sono stati processati, l'indice viene reimpostato e si passa al prossimo sketch di query (i).
-
-Pulizia della Memoria: Alla fine, l'oggetto output viene eliminato per prevenire eventuali perdite di memoria (memory leaks). */
-
-
-void CommandContain::writeOutput(ContainOutput *output, float error) const
+// Scrive le righe già formattate dal thread di lavoro e dealloca l'output.
+void CommandContain::writeOutput(ContainOutput *output) const
 {
-    // Inizializza gli indici per tracciare la posizione corrente negli sketch di query e riferimento
-    uint64_t i = output->indexQuery;  // Indice dello sketch di query
-    uint64_t j = output->indexRef;    // Indice dello sketch di riferimento
-    
-    // Itera attraverso tutte le coppie di risultati nel ContainOutput
-    for ( uint64_t k = 0; k < output->pairCount && i < output->sketchQuery.getReferenceCount(); k++ )
-    {
-        // Ottieni un puntatore alla coppia corrente di risultati
-        const ContainOutput::PairOutput *pair = &output->pairs[k];
-        
-        // Verifica se l'errore per questa coppia è inferiore o uguale al valore di errore massimo accettabile
-        if ( pair->error <= error )
-        {
-            // Se l'errore è accettabile, stampa i dettagli della comparazione:
-            // - pair->score: Punteggio della comparazione
-            // - pair->error: Errore associato a questa coppia
-            // - output->sketchRef.getReference(j).name: Nome dello sketch di riferimento
-            // - output->sketchQuery.getReference(i).name: Nome dello sketch di query
-            cout << pair->score << '\t' << pair->error << '\t' << output->sketchRef.getReference(j).name << '\t' << output->sketchQuery.getReference(i).name << endl;
-        }
-        
-        // Avanza l'indice del riferimento
-        j++;
-        
-        // Se l'indice del riferimento raggiunge il limite, ricomincia e passa al prossimo sketch di query
-        if ( j == output->sketchRef.getReferenceCount() )
-        {
-            j = 0; // Reimposta l'indice del riferimento
-            i++;   // Avanza all'indice del prossimo sketch di query
-        }
-    }
+    StatsPhase phase(Stats::Output);
     
-    // Dealloca l'oggetto output per evitare fughe di memoria
+    output->buffer.write(stdout);
     delete output;
 }
 
@@ -335,16 +347,30 @@ CommandContain::ContainOutput * contain(CommandContain::ContainInput * input)
     
     // Ciclo che itera attraverso le coppie di sequenze da confrontare.
     // Il ciclo continua finché ci sono coppie da confrontare e finché ci sono sequenze nella query.
-    for ( uint64_t k = 0; k < input->pairCount && i < sketchQuery.getReferenceCount(); k++ )
+    uint64_t k;
+    
+    for ( k = 0; k < input->pairCount && i < sketchQuery.getReferenceCount(); k++ )
     {
         // Calcolo del containment (inclusione) tra la sequenza di riferimento e quella di query.
         // La funzione containSketches confronta gli hash delle due sequenze e restituisce un punteggio di containment (score)
         // e un errore associato, che viene salvato nell'output.
-        output->pairs[k].score = containSketches(
-            sketchRef.getReference(j).hashesSorted,  // Hash della sequenza di riferimento
-            sketchQuery.getReference(i).hashesSorted,// Hash della sequenza di query
-            output->pairs[k].error                   // Errore del calcolo
-        );
+        // Con gli sketch scalati si usano tutti gli hash della query.
+        if ( sketchRef.getScale() )
+        {
+            output->pairs[k].score = containSketchesScaled(
+                sketchRef.getReference(j).hashesSorted,
+                sketchQuery.getReference(i).hashesSorted,
+                output->pairs[k].error
+            );
+        }
+        else
+        {
+            output->pairs[k].score = containSketches(
+                sketchRef.getReference(j).hashesSorted,  // Hash della sequenza di riferimento
+                sketchQuery.getReference(i).hashesSorted,// Hash della sequenza di query
+                output->pairs[k].error                   // Errore del calcolo
+            );
+        }
         
         // Passa alla sequenza di riferimento successiva.
         j++;
@@ -357,11 +383,73 @@ CommandContain::ContainOutput * contain(CommandContain::ContainInput * input)
         }
     }
     
+    Stats::add(Stats::PairsCompared, k);
+    
+    // Formatta le righe qui, nel thread di lavoro, invece che nel thread principale.
+    formatOutput(output, input->parameters.error);
+    
     // Restituisce l'output contenente i risultati del calcolo di containment.
     return output;
 }
 
 
+/**Inizializzazione degli Indici: Questi indici sono utilizzati per scorrere attraverso gli sketch di query (i) e di riferimento (j) mentre vengono processate le coppie di risultati.
+
+Iterazione sui Risultati: Il ciclo for percorre tutte le coppie di risultati (pairCount) e si assicura che ci siano ancora sketch di query da confrontare.
+
+Accesso alla Coppia di Risultati: La struttura PairOutput rappresenta il risultato di una singola comparazione tra uno sketch di query e uno di riferimento.
+
+Filtraggio per Errore: Solo le comparazioni che hanno un errore inferiore o uguale al valore fornito vengono considerate per l'output.
+
+Scrittura dell'Output: Se la coppia è valida (cioè ha un errore accettabile), i risultati vengono scritti nel buffer dell'output, mostrando il punteggio, l'errore e i nomi degli sketch comparati.
+
+Avanzamento degli Indici: Dopo ogni comparazione, l'indice del riferimento (j) viene incrementato. Quando tutti gli sketch di riferimento sono stati processati, l'indice viene reimpostato e si passa al prossimo sketch di query (i). */
+
+
+void formatOutput(CommandContain::ContainOutput *output, float error)
+{
+    // Inizializza gli indici per tracciare la posizione corrente negli sketch di query e riferimento
+    uint64_t i = output->indexQuery;  // Indice dello sketch di query
+    uint64_t j = output->indexRef;    // Indice dello sketch di riferimento
+    
+    // Itera attraverso tutte le coppie di risultati nel ContainOutput
+    for ( uint64_t k = 0; k < output->pairCount && i < output->sketchQuery.getReferenceCount(); k++ )
+    {
+        // Ottieni un puntatore alla coppia corrente di risultati
+        const CommandContain::ContainOutput::PairOutput *pair = &output->pairs[k];
+        
+        // Verifica se l'errore per questa coppia è inferiore o uguale al valore di errore massimo accettabile
+        if ( pair->error <= error )
+        {
+            // Se l'errore è accettabile, stampa i dettagli della comparazione:
+            // - pair->score: Punteggio della comparazione
+            // - pair->error: Errore associato a questa coppia
+            // - output->sketchRef.getReference(j).name: Nome dello sketch di riferimento
+            // - output->sketchQuery.getReference(i).name: Nome dello sketch di query
+            output->buffer << pair->score << '\t' << pair->error << '\t' << output->sketchRef.getReference(j).name << '\t' << output->sketchQuery.getReference(i).name;
+            
+            // Identità stimata (come in "mash screen") per gli sketch scalati
+            if ( output->sketchRef.getScale() )
+            {
+                output->buffer << '\t' << (pair->score > 0 ? pow(pair->score, 1. / output->sketchRef.getKmerSize()) : 0.);
+            }
+            
+            output->buffer << '\n';
+        }
+        
+        // Avanza l'indice del riferimento
+        j++;
+        
+        // Se l'indice del riferimento raggiunge il limite, ricomincia e passa al prossimo sketch di query
+        if ( j == output->sketchRef.getReferenceCount() )
+        {
+            j = 0; // Reimposta l'indice del riferimento
+            i++;   // Avanza all'indice del prossimo sketch di query
+        }
+    }
+}
+
+
 // Questa funzione calcola il livello di "containment" (inclusione) tra due insiemi di hash ordinati, rappresentanti rispettivamente
 // una sequenza di riferimento e una sequenza di query. La funzione restituisce un punteggio di containment (come un valore double)
 // e imposta un valore di errore associato al calcolo.
@@ -412,4 +500,48 @@ double containSketches(const HashList & hashesSortedRef, const HashList & hashes
 }
 
 
+// Containment per gli sketch scalati (FracMinHash): tutti gli hash sotto la
+// soglia sono presenti in entrambi gli sketch, quindi non c'è un limite di
+// passi e il denominatore è l'intera query, qualunque sia la dimensione del
+// riferimento.
+double containSketchesScaled(const HashList & hashesSortedRef, const HashList & hashesSortedQuery, double & errorToSet)
+{
+    uint64_t common = 0;
+    uint64_t i = 0;
+    uint64_t j = 0;
+    bool use64 = hashesSortedRef.get64();
+    
+    while ( i < hashesSortedRef.size() && j < hashesSortedQuery.size() )
+    {
+        if ( hashLessThan(hashesSortedRef.at(i), hashesSortedQuery.at(j), use64) )
+        {
+            i++;
+        }
+        else if ( hashLessThan(hashesSortedQuery.at(j), hashesSortedRef.at(i), use64) )
+        {
+            j++;
+        }
+        else
+        {
+            i++;
+            j++;
+            common++;
+        }
+    }
+    
+    uint64_t denom = hashesSortedQuery.size();
+    
+    if ( denom == 0 )
+    {
+        errorToSet = 1.;
+        return 0.;
+    }
+    
+    // Stesso limite di containSketches(), sull'intera query
+    errorToSet = 1. / sqrt(denom);
+    
+    return double(common) / denom;
+}
+
+
 } // namespace mash
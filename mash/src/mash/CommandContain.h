@@ -9,6 +9,7 @@
 
 #include "Command.h"
 #include "Sketch.h"
+#include "OutputBuffer.h"
 
 namespace mash {
 
@@ -141,6 +142,9 @@ struct ContainOutput
 
     // Puntatore a un array di PairOutput, ciascun elemento rappresenta il risultato di un confronto.
     PairOutput * pairs;
+
+    // Righe di output già formattate dal thread di lavoro; il thread principale deve solo scriverle.
+    OutputBuffer buffer;
 };
 
     
@@ -150,12 +154,14 @@ struct ContainOutput
     
 private:
     
-    void writeOutput(ContainOutput * output, float error) const;
+    void writeOutput(ContainOutput * output) const;
 };
 
 CommandContain::ContainOutput * contain(CommandContain::ContainInput * data);
+void formatOutput(CommandContain::ContainOutput * output, float error);
 
 double containSketches(const HashList & hashesSortedRef, const HashList & hashesSortedQuery, double & errorToSet);
+double containSketchesScaled(const HashList & hashesSortedRef, const HashList & hashesSortedQuery, double & errorToSet);
 
 } // namespace mash
 
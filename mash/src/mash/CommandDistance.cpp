@@ -1,18 +1,14 @@
 #include "CommandDistance.h"
+#include "ServeProtocol.h"
 #include "Sketch.h"
+#include "SketchDatabase.h"
+#include "Stats.h"
 #include <iostream>
 #include <zlib.h>
 #include "ThreadPool.h"
 #include "sketchParameterSetup.h"
 #include <math.h>
 
-#ifdef USE_BOOST
-    #include <boost/math/distributions/binomial.hpp>
-    using namespace::boost::math;
-#else
-    #include <gsl/gsl_cdf.h>
-#endif
-
 using namespace::std;
 
 namespace mash {
@@ -31,13 +27,22 @@ CommandDistance::CommandDistance()
     addOption("pvalue", Option(Option::Number, "v", "Output", "Maximum p-value to report.", "1.0", 0., 1.));
     addOption("distance", Option(Option::Number, "d", "Output", "Maximum distance to report.", "1.0", 0., 1.));
     addOption("comment", Option(Option::Boolean, "C", "Output", "Show comment fields with reference/query names (denoted with ':').", "1.0", 0., 1.));
-    addOption("fingerprint", Option(Option::Boolean, "fp", "Input", "Indicates that the input files are fingerprints instead of sequences.", "")); // Aggiunto
+    addOption("fingerprint", Option(Option::Boolean, "fp", "Input", "Indicates that the input files are fingerprints instead of sequences. Fingerprints are sketched as bottom-k sets of k-finger hashes, and the distance reported for them is the Jaccard distance.", "")); // Aggiunto
+    addOption("fingerprintAcross", Option(Option::Boolean, "-fp-across", "Input", "With -fp and a k-finger size (-k), let k-fingers of split fingerprints (segments separated by '|') span the segments, rather than staying within each one. Without -k, each fingerprint line is a single k-finger.", ""));
+    addOption("fingerprintPacked", Option(Option::Boolean, "-fp-packed", "Input", "With -fp, hash k-fingers as packed integer keys (numbers below 128 take a byte) with a fast integer mixer, rather than MurmurHash3 of 8 bytes per number. Much faster for factor lengths; the sketches are only comparable with others made this way.", ""));
+    addOption("binary", Option(Option::File, "B", "Output", "Write distances to a binary matrix at this path instead of text output, with a row for each query and a column for each reference (see \"mash matrix\"). Pairs that do not meet the thresholds are stored as blanks. The suffix '" + string(suffixMatrix) + "' is conventional.", ""));
+    addOption("half", Option(Option::Boolean, "Bh", "Output", "Store distances in the binary matrix as 16-bit floats (about 3 significant digits). Requires -B.", ""));
+    addOption("shared", Option(Option::Boolean, "Bn", "Output", "Store shared-hash counts in the binary matrix. Requires -B.", ""));
+    addOption("weighted", Option(Option::Boolean, "-weighted", "Output", "Weight shared hashes by their counts, which the sketches must have (see sketch -M, or reads with -r). The distance is then one minus the weighted Jaccard (the sum of the smaller counts over the sum of the larger, for the hashes in the bottom of the union), so abundances matter. Shared-hash counts and p-values are still for presence only.", ""));
+    addOption("server", Option(Option::File, "-server", "Input", "Send the queries to a \"mash serve\" process listening on this socket instead of loading a reference. All arguments are then queries, and are sketched with the parameters of the served reference.", ""));
     useSketchOptions();
 }
 
 int CommandDistance::run() const
 {
-    if ( arguments.size() < 2 || options.at("help").active )
+    bool server = options.at("server").active;
+    
+    if ( arguments.size() < (server ? 1 : 2) || options.at("help").active )
     {
         print();
         return 0;
@@ -50,6 +55,54 @@ int CommandDistance::run() const
     double pValueMax = options.at("pvalue").getArgumentAsNumber();
     double distanceMax = options.at("distance").getArgumentAsNumber();
     bool fingerprint = options.at("fingerprint").active; // Nuova opzione
+    bool binary = options.at("binary").active;
+    bool weighted = options.at("weighted").active;
+    
+    if ( ! binary && ( options.at("half").active || options.at("shared").active ) )
+    {
+        cerr << "ERROR: The options -" << options.at("half").identifier << " and -" << options.at("shared").identifier << " require -" << options.at("binary").identifier << "." << endl;
+        return 1;
+    }
+    
+    if ( binary && table )
+    {
+        cerr << "ERROR: The options -" << options.at("binary").identifier << " and -" << options.at("table").identifier << " are incompatible." << endl;
+        return 1;
+    }
+    
+    if ( server )
+    {
+        if ( binary || weighted )
+        {
+            cerr << "ERROR: The options -" << options.at(binary ? "binary" : "weighted").identifier << " and -" << options.at("server").identifier << " are incompatible." << endl;
+            return 1;
+        }
+        
+        vector<string> queryFiles;
+        
+        for ( int i = 0; i < arguments.size(); i++ )
+        {
+            if ( list )
+            {
+                splitFile(arguments[i], queryFiles);
+            }
+            else
+            {
+                queryFiles.push_back(arguments[i]);
+            }
+        }
+        
+        ServeMessage request;
+        
+        request.putByte(ServeDistance);
+        request.putDouble(distanceMax);
+        request.putDouble(pValueMax);
+        request.putByte(table);
+        request.putByte(comment);
+        request.putByte(fingerprint);
+        
+        return runServerQuery(options.at("server").argument, request, queryFiles, fingerprint, false, threads);
+    }
     
     Sketch::Parameters parameters;
     
@@ -68,7 +121,7 @@ int CommandDistance::run() const
     
     const string & fileReference = arguments[0];
     
-    bool isSketch = hasSuffix(fileReference, suffixSketch);
+    bool isSketch = isSketchFile(fileReference);
     
     if ( isSketch )
     {
@@ -148,10 +201,20 @@ int CommandDistance::run() const
         parameters.noncanonical = sketchRef.getNoncanonical();
         parameters.preserveCase = sketchRef.getPreserveCase();
         parameters.seed = sketchRef.getHashSeed();
+        parameters.scale = sketchRef.getScale();
+        parameters.fingerprintWhole = sketchRef.getFingerprintWhole();
+        parameters.hashScheme = sketchRef.getHashScheme();
         
-        string alphabet;
-        sketchRef.getAlphabetAsString(alphabet);
-        setAlphabetFromString(parameters, alphabet.c_str());
+        if ( sketchRef.getUnicode() )
+        {
+            setAlphabetUnicode(parameters);
+        }
+        else
+        {
+            string alphabet;
+            sketchRef.getAlphabetAsString(alphabet);
+            setAlphabetFromString(parameters, alphabet.c_str());
+        }
     }
     else
     {
@@ -176,18 +239,6 @@ int CommandDistance::run() const
         cerr << "done.\n";
     }
     
-    if ( table )
-    {
-        cout << "#query";
-        
-        for ( int i = 0; i < sketchRef.getReferenceCount(); i++ )
-        {
-            cout << '\t' << sketchRef.getReference(i).name;
-        }
-        
-        cout << endl;
-    }
-    
     ThreadPool<CompareInput, CompareOutput> threadPool(compare, threads);
     
     vector<string> queryFiles;
@@ -221,6 +272,50 @@ int CommandDistance::run() const
         sketchQuery.initFromFiles(queryFiles, parameters, 0, true);
     }
     
+    if ( weighted && ( ! sketchRef.hasHashCounts() || ! sketchQuery.hasHashCounts() ) )
+    {
+        cerr << "ERROR: The option -" << options.at("weighted").identifier << " requires sketches with hash counts (see sketch -M)." << endl;
+        return 1;
+    }
+    
+    if ( table )
+    {
+        cout << "#query";
+        
+        for ( int i = 0; i < sketchRef.getReferenceCount(); i++ )
+        {
+            cout << '\t' << sketchRef.getReference(i).name;
+        }
+        
+        cout << endl;
+    }
+    
+    DistanceMatrixWriter matrixWriter;
+    
+    if ( binary )
+    {
+        vector<string> rowNames;
+        vector<string> columnNames;
+        
+        for ( uint64_t i = 0; i < sketchQuery.getReferenceCount(); i++ )
+        {
+            const Sketch::Reference & ref = sketchQuery.getReference(i);
+            rowNames.push_back(comment ? ref.name + ':' + ref.comment : ref.name);
+        }
+        
+        for ( uint64_t i = 0; i < sketchRef.getReferenceCount(); i++ )
+        {
+            const Sketch::Reference & ref = sketchRef.getReference(i);
+            columnNames.push_back(comment ? ref.name + ':' + ref.comment : ref.name);
+        }
+        
+        matrixWriter.open(options.at("binary").argument, DistanceMatrix::Rectangle, rowNames, columnNames, options.at("half").active, options.at("shared").active);
+    }
+    
+    // for the smaller of the two sketch sizes, which compare() will use (scaled
+    // sketches have no fixed size, so theirs are all computed directly)
+    PValueTable pValueTable(sketchRef.getScale() ? 0 : sketchQuery.getMinHashesPerWindow() < sketchRef.getMinHashesPerWindow() ? sketchQuery.getMinHashesPerWindow() : sketchRef.getMinHashesPerWindow());
+    
     uint64_t pairCount = sketchRef.getReferenceCount() * sketchQuery.getReferenceCount();
     uint64_t pairsPerThread = pairCount / parameters.parallelism;
     
@@ -239,6 +334,8 @@ int CommandDistance::run() const
     uint64_t iFloor = pairsPerThread / sketchRef.getReferenceCount();
     uint64_t iMod = pairsPerThread % sketchRef.getReferenceCount();
     
+    StatsPhase phase(Stats::Compare);
+    
     for ( uint64_t i = 0, j = 0; i < sketchQuery.getReferenceCount(); i += iFloor, j += iMod )
     {
         if ( j >= sketchRef.getReferenceCount() )
@@ -252,17 +349,22 @@ int CommandDistance::run() const
             j -= sketchRef.getReferenceCount();
         }
         
-        threadPool.runWhenThreadAvailable(new CompareInput(sketchRef, sketchQuery, j, i, pairsPerThread, parameters, distanceMax, pValueMax));
+        threadPool.runWhenThreadAvailable(new CompareInput(sketchRef, sketchQuery, j, i, pairsPerThread, parameters, distanceMax, pValueMax, fingerprint, table, comment, binary, pValueTable, weighted));
         
         while ( threadPool.outputAvailable() )
         {
-            writeOutput(threadPool.popOutputWhenAvailable(), table, comment);
+            writeOutput(threadPool.popOutputWhenAvailable(), matrixWriter);
         }
     }
     
     while ( threadPool.running() )
     {
-        writeOutput(threadPool.popOutputWhenAvailable(), table, comment);
+        writeOutput(threadPool.popOutputWhenAvailable(), matrixWriter);
+    }
+    
+    if ( binary )
+    {
+        matrixWriter.close();
     }
     
     if ( warningCount > 0 && ! parameters.reads )
@@ -273,46 +375,125 @@ int CommandDistance::run() const
     return 0;
 }
 
-void CommandDistance::writeOutput(CompareOutput * output, bool table, bool comment) const
+void CommandDistance::writeOutput(CompareOutput * output, DistanceMatrixWriter & matrixWriter) const
+{
+    StatsPhase phase(Stats::Output);
+    
+    if ( matrixWriter.isOpen() )
+    {
+        uint64_t i = output->indexQuery;
+        uint64_t j = output->indexRef;
+        
+        for ( uint64_t k = 0; k < output->pairCount && i < output->sketchQuery.getReferenceCount(); k++ )
+        {
+            const CompareOutput::PairOutput & pair = output->pairs[k];
+            
+            if ( pair.pass )
+            {
+                matrixWriter.append(pair.distance, pair.numer, pair.denom);
+            }
+            else
+            {
+                matrixWriter.append(NAN, 0, 0);
+            }
+            
+            j++;
+            
+            if ( j == output->sketchRef.getReferenceCount() )
+            {
+                j = 0;
+                i++;
+            }
+        }
+    }
+    else
+    {
+        output->buffer.write(stdout);
+    }
+    
+    delete output;
+}
+
+CommandDistance::CompareOutput * compare(CommandDistance::CompareInput * input)
 {
+    const Sketch & sketchRef = input->sketchRef;
+    const Sketch & sketchQuery = input->sketchQuery;
+    
+    CommandDistance::CompareOutput * output = new CommandDistance::CompareOutput(input->sketchRef, input->sketchQuery, input->indexRef, input->indexQuery, input->pairCount);
+    
+    uint64_t sketchSize = sketchQuery.getMinHashesPerWindow() < sketchRef.getMinHashesPerWindow() ?
+        sketchQuery.getMinHashesPerWindow() :
+        sketchRef.getMinHashesPerWindow();
+    
+    uint64_t i = input->indexQuery;
+    uint64_t j = input->indexRef;
+    
+    uint64_t k;
+    
+    for (k = 0; k < input->pairCount && i < sketchQuery.getReferenceCount(); k++) {
+        try {
+            compareSketches(&output->pairs[k], sketchRef.getReference(j), sketchQuery.getReference(i), sketchSize, sketchRef.getKmerSize(), sketchRef.getKmerSpace(), input->maxDistance, input->maxPValue, input->pValueTable, input->fingerprint, input->weighted);
+        } catch (const std::out_of_range& e) {
+            std::cerr << "Error: out_of_range exception caught: " << e.what() << std::endl;
+        }
+        j++;
+        if (j == sketchRef.getReferenceCount()) {
+            j = 0;
+            i++;
+        }
+    }
+    
+    Stats::add(Stats::PairsCompared, k);
+    
+    if ( ! input->binary )
+    {
+        formatOutput(output, input->table, input->comment);
+    }
+    
+    return output;
+}
+
+void formatOutput(CommandDistance::CompareOutput * output, bool table, bool comment)
+{
+    OutputBuffer & buffer = output->buffer;
     uint64_t i = output->indexQuery;
     uint64_t j = output->indexRef;
     
     for ( uint64_t k = 0; k < output->pairCount && i < output->sketchQuery.getReferenceCount(); k++ )
     {
-        const CompareOutput::PairOutput * pair = &output->pairs[k];
+        const CommandDistance::CompareOutput::PairOutput * pair = &output->pairs[k];
         
         if ( table && j == 0 )
         {
-            cout << output->sketchQuery.getReference(i).name;
+            buffer << output->sketchQuery.getReference(i).name;
         }
         
         if ( table )
         {
-            cout << '\t';
+            buffer << '\t';
     
             if ( pair->pass )
             {
-                cout << pair->distance;
+                buffer << pair->distance;
             }
         }
         else if ( pair->pass )
         {
-            cout << output->sketchRef.getReference(j).name;
+            buffer << output->sketchRef.getReference(j).name;
             
             if ( comment )
             {
-                cout << ':' << output->sketchRef.getReference(j).comment;
+                buffer << ':' << output->sketchRef.getReference(j).comment;
             }
             
-            cout << '\t' << output->sketchQuery.getReference(i).name;
+            buffer << '\t' << output->sketchQuery.getReference(i).name;
             
             if ( comment )
             {
-                cout << ':' << output->sketchQuery.getReference(i).comment;
+                buffer << ':' << output->sketchQuery.getReference(i).comment;
             }
             
-            cout << '\t' << pair->distance << '\t' << pair->pValue << '\t' << pair->numer << '/' << pair->denom << endl;
+            buffer << '\t' << pair->distance << '\t' << pair->pValue << '\t' << pair->numer << '/' << pair->denom << '\n';
         }
     
         j++;
@@ -321,91 +502,181 @@ void CommandDistance::writeOutput(CompareOutput * output, bool table, bool comme
         {
             if ( table )
             {
-                cout << endl;
+                buffer << '\n';
             }
             
             j = 0;
             i++;
         }
     }
-    
-    delete output;
 }
 
-CommandDistance::CompareOutput * compare(CommandDistance::CompareInput * input)
+template <typename T>
+void mergeSketchesWeighted(const T * hashesRef, const uint32_t * countsRef, uint64_t sizeRef, const T * hashesQry, const uint32_t * countsQry, uint64_t sizeQry, uint64_t sketchSize, uint64_t & commonToSet, uint64_t & denomToSet, double & jaccardToSet)
 {
-    const Sketch & sketchRef = input->sketchRef;
-    const Sketch & sketchQuery = input->sketchQuery;
-    
-    CommandDistance::CompareOutput * output = new CommandDistance::CompareOutput(input->sketchRef, input->sketchQuery, input->indexRef, input->indexQuery, input->pairCount);
-    
-    uint64_t sketchSize = sketchQuery.getMinHashesPerWindow() < sketchRef.getMinHashesPerWindow() ?
-        sketchQuery.getMinHashesPerWindow() :
-        sketchRef.getMinHashesPerWindow();
+    // As mergeSketches(), also summing the smaller and larger count of each
+    // hash in the bottom of the union (a missing hash counts 0). There is no
+    // early exit, since counts can make up for unshared hashes.
     
-    uint64_t i = input->indexQuery;
-    uint64_t j = input->indexRef;
+    uint64_t i = 0;
+    uint64_t j = 0;
+    uint64_t common = 0;
+    uint64_t denom = 0;
+    uint64_t sumMin = 0;
+    uint64_t sumMax = 0;
     
-    for (uint64_t k = 0; k < input->pairCount && i < sketchQuery.getReferenceCount(); k++) {
-        try {
-            compareSketches(&output->pairs[k], sketchRef.getReference(j), sketchQuery.getReference(i), sketchSize, sketchRef.getKmerSize(), sketchRef.getKmerSpace(), input->maxDistance, input->maxPValue);
-        } catch (const std::out_of_range& e) {
-            std::cerr << "Error: out_of_range exception caught: " << e.what() << std::endl;
+    while ( denom < sketchSize && ( i < sizeRef || j < sizeQry ) )
+    {
+        if ( j == sizeQry || ( i < sizeRef && hashesRef[i] < hashesQry[j] ) )
+        {
+            sumMax += countsRef[i];
+            i++;
         }
-        j++;
-        if (j == sketchRef.getReferenceCount()) {
-            j = 0;
+        else if ( i == sizeRef || hashesQry[j] < hashesRef[i] )
+        {
+            sumMax += countsQry[j];
+            j++;
+        }
+        else
+        {
+            uint32_t countRef = countsRef[i];
+            uint32_t countQry = countsQry[j];
+            
+            sumMin += countRef < countQry ? countRef : countQry;
+            sumMax += countRef < countQry ? countQry : countRef;
             i++;
+            j++;
+            common++;
         }
+        
+        denom++;
     }
     
-    return output;
+    commonToSet = common;
+    denomToSet = denom;
+    jaccardToSet = sumMax ? double(sumMin) / sumMax : 0;
 }
 
-void compareSketches(CommandDistance::CompareOutput::PairOutput * output, const Sketch::Reference & refRef, const Sketch::Reference & refQry, uint64_t sketchSize, int kmerSize, double kmerSpace, double maxDistance, double maxPValue)
+template <typename T>
+bool mergeSketches(const T * hashesRef, uint64_t sizeRef, const T * hashesQry, uint64_t sizeQry, uint64_t sketchSize, uint64_t maxMismatch, uint64_t & commonToSet, uint64_t & denomToSet)
 {
+    // Merge the bottom of the union, giving up once more hashes are unshared
+    // than any passing pair could have.
+    
     uint64_t i = 0;
     uint64_t j = 0;
     uint64_t common = 0;
     uint64_t denom = 0;
-    const HashList & hashesSortedRef = refRef.hashesSorted;
-    const HashList & hashesSortedQry = refQry.hashesSorted;
-    
-    output->pass = false;
     
-    while (denom < sketchSize && i < hashesSortedRef.size() && j < hashesSortedQry.size()) {
-        if (hashLessThan(hashesSortedRef.at(i), hashesSortedQry.at(j), hashesSortedRef.get64())) {
+    while ( denom < sketchSize && i < sizeRef && j < sizeQry )
+    {
+        if ( hashesRef[i] < hashesQry[j] )
+        {
             i++;
-        } else if (hashLessThan(hashesSortedQry.at(j), hashesSortedRef.at(i), hashesSortedRef.get64())) {
+        }
+        else if ( hashesQry[j] < hashesRef[i] )
+        {
             j++;
-        } else {
+        }
+        else
+        {
             i++;
             j++;
             common++;
         }
+        
         denom++;
+        
+        if ( denom - common > maxMismatch )
+        {
+            return false;
+        }
     }
     
-    if (denom < sketchSize) {
+    if ( denom < sketchSize )
+    {
         // complete the union operation if possible
-        if (i < hashesSortedRef.size()) {
-            denom += hashesSortedRef.size() - i;
+        
+        denom += (sizeRef - i) + (sizeQry - j);
+        
+        if ( denom > sketchSize )
+        {
+            denom = sketchSize;
         }
-        if (j < hashesSortedQry.size()) {
-            denom += hashesSortedQry.size() - j;
+    }
+    
+    commonToSet = common;
+    denomToSet = denom;
+    
+    return true;
+}
+
+void compareSketches(CommandDistance::CompareOutput::PairOutput * output, const Sketch::Reference & refRef, const Sketch::Reference & refQry, uint64_t sketchSize, int kmerSize, double kmerSpace, double maxDistance, double maxPValue, const PValueTable & pValueTable, bool fingerprint, bool weighted)
+{
+    uint64_t common;
+    uint64_t denom;
+    const HashList & hashesSortedRef = refRef.hashesSorted;
+    const HashList & hashesSortedQry = refQry.hashesSorted;
+    
+    output->pass = false;
+    
+    // (a sketch without counts, e.g. pasted in from elsewhere, is compared by presence)
+    weighted = weighted && refRef.counts.size() == hashesSortedRef.size() && refQry.counts.size() == hashesSortedQry.size();
+    
+    // The final Jaccard is at most (sketchSize - mismatches) / sketchSize, so
+    // a pair can be abandoned once its mismatches exceed what the distance
+    // threshold allows (with one hash of slack against rounding).
+    
+    uint64_t maxMismatch = sketchSize;
+    
+    if ( maxDistance >= 0 && maxDistance < 1 )
+    {
+        double jaccardMin = fingerprint ? 1. - maxDistance : 1. / (2. * exp(kmerSize * maxDistance) - 1.);
+        maxMismatch = (1. - jaccardMin) * sketchSize + 1;
+    }
+    
+    bool complete = true;
+    double jaccardWeighted;
+    
+    if ( weighted )
+    {
+        if ( hashesSortedRef.get64() )
+        {
+            mergeSketchesWeighted(hashesSortedRef.data64(), refRef.counts.data(), hashesSortedRef.size(), hashesSortedQry.data64(), refQry.counts.data(), hashesSortedQry.size(), sketchSize, common, denom, jaccardWeighted);
         }
-        if (denom > sketchSize) {
-            denom = sketchSize;
+        else
+        {
+            mergeSketchesWeighted(hashesSortedRef.data32(), refRef.counts.data(), hashesSortedRef.size(), hashesSortedQry.data32(), refQry.counts.data(), hashesSortedQry.size(), sketchSize, common, denom, jaccardWeighted);
         }
     }
+    else if ( hashesSortedRef.get64() )
+    {
+        complete = mergeSketches(hashesSortedRef.data64(), hashesSortedRef.size(), hashesSortedQry.data64(), hashesSortedQry.size(), sketchSize, maxMismatch, common, denom);
+    }
+    else
+    {
+        complete = mergeSketches(hashesSortedRef.data32(), hashesSortedRef.size(), hashesSortedQry.data32(), hashesSortedQry.size(), sketchSize, maxMismatch, common, denom);
+    }
+    
+    if ( ! complete )
+    {
+        return;
+    }
     
     double distance;
     double jaccard = double(common) / denom;
     
-    if (common == denom) { // avoid -0
+    if (weighted) {
+        // abundance-weighted; like fingerprints, no mutation model applies
+        distance = 1. - jaccardWeighted;
+    } else if (common == denom) { // avoid -0
         distance = 0;
     } else if (common == 0) { // avoid inf
         distance = 1.;
+    } else if (fingerprint) {
+        // k-fingers have no per-letter mutation model to invert, so the
+        // distance is the Jaccard distance of the fingerprint sets
+        distance = 1. - jaccard;
     } else {
         distance = -log(2 * jaccard / (1. + jaccard)) / kmerSize;
         if (distance > 1) {
@@ -420,7 +691,7 @@ void compareSketches(CommandDistance::CompareOutput::PairOutput * output, const
     output->numer = common;
     output->denom = denom;
     output->distance = distance;
-    output->pValue = pValue(common, refRef.length, refQry.length, kmerSpace, denom);
+    output->pValue = pValue(common, refRef.length, refQry.length, fingerprint ? getFingerprintSpace(hashesSortedRef.get64()) : kmerSpace, denom, pValueTable, maxPValue);
     
     if (maxPValue >= 0 && output->pValue > maxPValue) {
         return;
@@ -430,7 +701,16 @@ void compareSketches(CommandDistance::CompareOutput::PairOutput * output, const
 }
 
 
-double pValue(uint64_t x, uint64_t lengthRef, uint64_t lengthQuery, double kmerSpace, uint64_t sketchSize)
+double getFingerprintSpace(bool use64)
+{
+    // The null model for fingerprints: k-fingers drawn uniformly from the
+    // hash space (their values are unbounded, so there is no alphabet to
+    // count words over).
+    
+    return pow(2., use64 ? 64 : 32);
+}
+
+double pValue(uint64_t x, uint64_t lengthRef, uint64_t lengthQuery, double kmerSpace, uint64_t sketchSize, const PValueTable & pValueTable, double maxPValue)
 {
     if ( x == 0 )
     {
@@ -442,11 +722,7 @@ double pValue(uint64_t x, uint64_t lengthRef, uint64_t lengthQuery, double kmerS
     
     double r = pX * pY / (pX + pY - pX * pY);
     
-#ifdef USE_BOOST
-    return cdf(complement(binomial(sketchSize, r), x - 1));
-#else
-    return gsl_cdf_binomial_Q(x - 1, r, sketchSize);
-#endif
+    return pValueTable.getPValue(x, sketchSize, r, maxPValue);
 }
 
 
@@ -3,6 +3,9 @@
 
 #include "Command.h"
 #include "Sketch.h"
+#include "OutputBuffer.h"
+#include "DistanceMatrix.h"
+#include "PValueTable.h"
 
 namespace mash {
 
@@ -12,7 +15,7 @@ public:
     
     struct CompareInput
     {
-        CompareInput(const Sketch & sketchRefNew, const Sketch & sketchQueryNew, uint64_t indexRefNew, uint64_t indexQueryNew, uint64_t pairCountNew, const Sketch::Parameters & parametersNew, double maxDistanceNew, double maxPValueNew)
+        CompareInput(const Sketch & sketchRefNew, const Sketch & sketchQueryNew, uint64_t indexRefNew, uint64_t indexQueryNew, uint64_t pairCountNew, const Sketch::Parameters & parametersNew, double maxDistanceNew, double maxPValueNew, bool fingerprintNew, bool tableNew, bool commentNew, bool binaryNew, const PValueTable & pValueTableNew, bool weightedNew = false)
             :
             sketchRef(sketchRefNew),
             sketchQuery(sketchQueryNew),
@@ -21,7 +24,13 @@ public:
             pairCount(pairCountNew),
             parameters(parametersNew),
             maxDistance(maxDistanceNew),
-            maxPValue(maxPValueNew)
+            maxPValue(maxPValueNew),
+            fingerprint(fingerprintNew),
+            table(tableNew),
+            comment(commentNew),
+            binary(binaryNew),
+            pValueTable(pValueTableNew),
+            weighted(weightedNew)
             {}
         
         const Sketch & sketchRef;
@@ -34,6 +43,14 @@ public:
         const Sketch::Parameters & parameters;
         double maxDistance;
         double maxPValue;
+        bool fingerprint;
+        
+        bool table;
+        bool comment;
+        bool binary; // leave formatting to the matrix writer
+        
+        const PValueTable & pValueTable;
+        bool weighted; // use the hash counts (see compareSketches())
     };
     
     struct CompareOutput
@@ -71,6 +88,8 @@ public:
         uint64_t pairCount;
         
         PairOutput * pairs;
+        
+        OutputBuffer buffer; // formatted lines, filled by the worker thread
     };
     
     CommandDistance();
@@ -79,13 +98,15 @@ public:
     
 private:
     
-    void writeOutput(CompareOutput * output, bool table, bool comment) const;
+    void writeOutput(CompareOutput * output, DistanceMatrixWriter & matrixWriter) const;
 };
 
 
 CommandDistance::CompareOutput * compare(CommandDistance::CompareInput * input);
-void compareSketches(CommandDistance::CompareOutput::PairOutput * output, const Sketch::Reference & refRef, const Sketch::Reference & refQry, uint64_t sketchSize, int kmerSize, double kmerSpace, double maxDistance, double maxPValue);
-double pValue(uint64_t x, uint64_t lengthRef, uint64_t lengthQuery, double kmerSpace, uint64_t sketchSize);
+void formatOutput(CommandDistance::CompareOutput * output, bool table, bool comment);
+void compareSketches(CommandDistance::CompareOutput::PairOutput * output, const Sketch::Reference & refRef, const Sketch::Reference & refQry, uint64_t sketchSize, int kmerSize, double kmerSpace, double maxDistance, double maxPValue, const PValueTable & pValueTable, bool fingerprint = false, bool weighted = false);
+double getFingerprintSpace(bool use64);
+double pValue(uint64_t x, uint64_t lengthRef, uint64_t lengthQuery, double kmerSpace, uint64_t sketchSize, const PValueTable & pValueTable, double maxPValue = -1);
 
 
 bool containsMSH(const std::vector<std::string>& strVec) ;
@@ -9,8 +9,7 @@
 #include <zlib.h>
 #include "kseq.h"
 #include <iostream>
-#include <set>
-#include "robin_hood.h"
+#include <algorithm>
 #include "ThreadPool.h"
 #include "sketchParameterSetup.h"
 
@@ -231,7 +230,7 @@ void findPerStrand(const CommandFind::FindInput * input, CommandFind::FindOutput
 {
     bool verbose = false;
     
-    robin_hood::unordered_set<Sketch::hash_t> minHashes;
+    vector<Sketch::hash_t> minHashes;
     
     const Sketch & sketch = input->sketch;
     int kmerSize = sketch.getKmerSize();
@@ -289,74 +288,83 @@ void findPerStrand(const CommandFind::FindInput * input, CommandFind::FindOutput
     //
     for ( int i = 0; i < positionHashes.size(); i++ )
     {
-        minHashes.insert(positionHashes.at(i).hash);
+        minHashes.push_back(positionHashes.at(i).hash);
     }
     
+    sort(minHashes.begin(), minHashes.end());
+    minHashes.erase(unique(minHashes.begin(), minHashes.end()), minHashes.end());
+    
     if ( minusStrand )
     {
         delete [] seq;
     }
     
-    // get sorted lists of positions, per reference sequence, that have
-    // mutual min-hashes with the query
+    // get sorted positions, grouped by reference sequence, that have mutual
+    // min-hashes with the query (packed as sequence << 32 | position)
     //
-    robin_hood::unordered_map < uint32_t, std::set<uint32_t> >   hits;
-
-    for ( auto i = minHashes.begin(); i != minHashes.end(); i++ )
+    vector<uint64_t> hits;
+    
+    for ( int i = 0; i < minHashes.size(); i++ )
     {
-        Sketch::hash_t hash = *i;
+        Sketch::hash_t hash = minHashes.at(i);
+        const Sketch::Locus * loci;
+        uint64_t lociCount = sketch.getLociByHash(hash, loci);
         
-        if ( sketch.hasLociByHash(hash) )
+        for ( uint64_t j = 0; j < lociCount; j++ )
         {
-            const vector<Sketch::Locus> loci = sketch.getLociByHash(hash);
+            const Sketch::Locus & locus = loci[j];
             
-            for ( int j = 0; j < loci.size(); j++ )
+            if ( verbose ) cout << "Match for hash " << hash << "\t" << locus.sequence << "\t" << locus.position << endl;
+            
+            if ( locus.sequence != selfIndexRef || selfMatches )
             {
-                const Sketch::Locus & locus = loci.at(j);
-                
-                if ( verbose ) cout << "Match for hash " << hash << "\t" << locus.sequence << "\t" << locus.position << endl;
-                
-                if ( locus.sequence != selfIndexRef || selfMatches )
-                {
-                    hits[locus.sequence].insert(locus.position); // set will be created if needed
-                }
+                hits.push_back((uint64_t)locus.sequence << 32 | locus.position);
             }
         }
     }
     
-    for ( auto i = hits.begin(); i != hits.end(); i++ )
+    sort(hits.begin(), hits.end());
+    hits.erase(unique(hits.begin(), hits.end()), hits.end());
+    
+    for ( uint64_t hitsStart = 0; hitsStart < hits.size(); )
     {
-    	using std::set;
-    	
-        // pointer to the position at the beginning of the window; to be updated
+        uint32_t ref = hits[hitsStart] >> 32;
+        uint64_t hitsEnd = hitsStart;
+        
+        while ( hitsEnd < hits.size() && hits[hitsEnd] >> 32 == ref )
+        {
+            hitsEnd++;
+        }
+        
+        // index of the position at the beginning of the window; to be updated
         // as the end of the window is incremented
         //
-        set<uint32_t>::const_iterator windowStart = i->second.begin();
+        uint64_t windowStart = hitsStart;
         
-        if ( verbose ) cout << "Clustering in seq " << i->first << endl;
+        if ( verbose ) cout << "Clustering in seq " << ref << endl;
         
         // the number of positions between the window start and end (inclusive)
         //
         int windowCount = 0;
         
-        for ( set<uint32_t>::const_iterator j = i->second.begin(); j != i->second.end(); j++ )
+        for ( uint64_t j = hitsStart; j != hitsEnd; j++ )
         {
             windowCount++;
             
-            if ( verbose ) cout << *windowStart << "\t" << *j << endl;
+            if ( verbose ) cout << uint32_t(hits[windowStart]) << "\t" << uint32_t(hits[j]) << endl;
             
             // update window start if it is too far behind
             //
-            while ( windowStart != j && *j > length && *windowStart < *j - length + 1 )
+            while ( windowStart != j && uint32_t(hits[j]) >= length && uint32_t(hits[windowStart]) < uint32_t(hits[j]) - length + 1 )
             {
-                if ( verbose ) cout << "moving " << *j - length + 1 << endl;
+                if ( verbose ) cout << "moving " << uint32_t(hits[j]) - length + 1 << endl;
                 windowStart++;
                 windowCount--;
             }
             
             // extend the right of the window if possible
             //
-            while ( j != i->second.end() && *j - *windowStart < length )
+            while ( j != hitsEnd && uint32_t(hits[j]) - uint32_t(hits[windowStart]) < length )
             {
                 windowCount++;
                 j++;
@@ -365,7 +373,10 @@ void findPerStrand(const CommandFind::FindInput * input, CommandFind::FindOutput
             windowCount--;
             j--;
             
-            if ( verbose ) cout << *windowStart << "\t" << *j << endl;
+            uint32_t start = hits[windowStart];
+            uint32_t end = hits[j];
+            
+            if ( verbose ) cout << start << "\t" << end << endl;
             float score = float(windowCount) / minHashes.size();
             
             if
@@ -374,27 +385,22 @@ void findPerStrand(const CommandFind::FindInput * input, CommandFind::FindOutput
                 (
                     best == 0 ||
                     output->hits.size() < best ||
-                    CommandFind::FindOutput::Hit(i->first, *windowStart, *j, minusStrand, score) < output->hits.top()
+                    CommandFind::FindOutput::Hit(ref, start, end, minusStrand, score) < output->hits.top()
                 )
             )
             {
-                if ( verbose ) cout << input->seqId << '\t' << sketch.getReference(i->first).name << '\t' << *windowStart << '\t' << *j << '\t' << float(windowCount) / mins << endl;
+                if ( verbose ) cout << input->seqId << '\t' << sketch.getReference(ref).name << '\t' << start << '\t' << end << '\t' << float(windowCount) / mins << endl;
                 
-                output->hits.push(CommandFind::FindOutput::Hit(i->first, *windowStart, *j, minusStrand, score));
+                output->hits.push(CommandFind::FindOutput::Hit(ref, start, end, minusStrand, score));
                 
                 if ( best != 0 && output->hits.size() > best )
                 {
                     output->hits.pop();
                 }
-                
-                //break;
-                
-                for ( set<uint32_t>::const_iterator k = windowStart; k != i->second.end() && *k <= *j; k++ )
-                {
-                    if ( verbose ) cout << "      " << *k << endl;
-                }
             }
         }
+        
+        hitsStart = hitsEnd;
     }
     
     //cout << "done\n";
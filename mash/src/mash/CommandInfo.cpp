@@ -5,7 +5,9 @@
 // See the LICENSE.txt file included with this software for license information.
 
 #include "CommandInfo.h"
+#include "OutputBuffer.h"
 #include "Sketch.h"
+#include "SketchDatabase.h"
 #include <iostream>
 
 using std::cerr;
@@ -22,6 +24,8 @@ namespace mash {
     #define HASH "MurmurHash3_x64_128"
 #endif
 
+#define HASH_PACKED "PackedKeys_fmix64"
+
 /**
  * Costruttore della classe CommandInfo.
  * 
@@ -31,6 +35,8 @@ namespace mash {
  * - tabular (-t): Output tabellare, senza intestazione. Incompatibile con -d, -H e -c.
  * - counts (-c): Mostra gli istogrammi dei conteggi degli hash per ogni schizzo. Incompatibile con -d, -H e -t.
  * - dump (-d): Esporta gli schizzi in formato JSON. Incompatibile con -H, -t e -c.
+ * - dumpHashes (--dn): Numero massimo di hash (e conteggi) esportati per schizzo; 0 per i soli metadati.
+ * - dumpLines (--dl): Esporta un oggetto JSON per riga (NDJSON).
  */
 CommandInfo::CommandInfo()
 : Command()
@@ -49,6 +55,10 @@ CommandInfo::CommandInfo()
         "Show hash count histograms for each sketch. Incompatible with -d, -H and -t.", ""));
     addOption("dump", Option(Option::Boolean, "d", "", 
         "Dump sketches in JSON format. Incompatible with -H, -t, and -c.", ""));
+    addOption("dumpHashes", Option(Option::Integer, "-dn", "", 
+        "With -d, dump at most this many hashes (and counts) for each sketch. 0 dumps only the metadata.", ""));
+    addOption("dumpLines", Option(Option::Boolean, "-dl", "", 
+        "With -d, dump one JSON object per line (NDJSON): the header, then each sketch.", ""));
 }
 
 /**
@@ -112,9 +122,15 @@ int CommandInfo::run() const
         }
     }
     
+    if (!dump && (options.at("dumpHashes").active || options.at("dumpLines").active))
+    {
+        cerr << "ERROR: The options --dn and --dl require -d." << endl;
+        return 1;
+    }
+    
     const string &file = arguments[0];
     
-    if (!hasSuffix(file, suffixSketch))
+    if (!isSketchFile(file))
     {
         cerr << "ERROR: The file \"" << file << "\" does not look like a sketch." << endl;
         return 1;
@@ -124,29 +140,35 @@ int CommandInfo::run() const
     Sketch::Parameters params;
     params.parallelism = 1;
     
-    uint64_t referenceCount;
-    
-    if (header)
+    // Gli istogrammi richiedono tutti i conteggi: caricamento completo
+    if (counts)
     {
-        // Inizializza solo i parametri dello sketch dal file Cap'n Proto
-        referenceCount = sketch.initParametersFromCapnp(arguments[0].c_str());
+        sketch.initFromFiles(arguments, params);
+        return printCounts(sketch);
     }
-    else
+    
+    // Altrimenti bastano l'intestazione e i riferimenti, letti direttamente dal
+    // file mappato (per un database, i parametri del primo segmento)
+    vector<string> files;
+    expandSketchDatabases(arguments, files);
+    
+    if (files.size() == 0)
     {
-        // Inizializza lo sketch dai file specificati
-        sketch.initFromFiles(arguments, params);
-        referenceCount = sketch.getReferenceCount();
+        cerr << "ERROR: The sketch database \"" << file << "\" has no segments." << endl;
+        return 1;
     }
     
-    // Gestione delle opzioni specifiche
-    if (counts)
+    uint64_t referenceCount = sketch.initParametersFromCapnp(files[0].c_str());
+    
+    if (dump)
     {
-        return printCounts(sketch);
+        return writeJson(sketch, files);
     }
-    else if (dump)
+    
+    for (int i = 1; i < files.size(); i++)
     {
-        cout << "      \"Write JSON information : " << endl;
-        return writeJson(sketch);
+        Sketch sketchSegment;
+        referenceCount += sketchSegment.initParametersFromCapnp(files[i].c_str());
     }
     
     if (tabular)
@@ -159,12 +181,21 @@ int CommandInfo::run() const
         sketch.getAlphabetAsString(alphabet);
         
         cout << "Header:" << endl;
-        cout << "  Hash function (seed):          " << HASH << " (" << sketch.getHashSeed() << ")" << endl;
+        cout << "  Hash function (seed):          " << (sketch.getHashScheme() == hashSchemePackedKeys ? HASH_PACKED : HASH) << " (" << sketch.getHashSeed() << ")" << endl;
         cout << "  K-mer size:                    " << sketch.getKmerSize() << " (" << (sketch.getUse64() ? "64" : "32") << "-bit hashes)" << endl;
         cout << "  Alphabet:                      " << alphabet 
              << (sketch.getNoncanonical() ? "" : " (canonical)") 
              << (sketch.getPreserveCase() ? " (case-sensitive)" : "") << endl;
-        cout << "  Target min-hashes per sketch:  " << sketch.getMinHashesPerWindow() << endl;
+
+        if (sketch.getScale())
+        {
+            cout << "  Scale (hashes kept 1 in):      " << sketch.getScale() << endl;
+        }
+        else
+        {
+            cout << "  Target min-hashes per sketch:  " << sketch.getMinHashesPerWindow() << endl;
+        }
+        
         cout << "  Sketches:                      " << referenceCount << endl;
     }
 
@@ -183,23 +214,30 @@ int CommandInfo::run() const
             columns[3].push_back("[Comment]");
         }
         
-        for (uint64_t i = 0; i < sketch.getReferenceCount(); i++)
+        // In formato tabellare le righe vengono scritte man mano che si leggono
+        auto row = [&](const char * name, const char * comment, uint64_t length, uint64_t hashCount)
         {
-            const Sketch::Reference &ref = sketch.getReference(i);
-            
             if (tabular)
             {
-                cout << ref.hashesSorted.size() << '\t'
-                     << ref.length << '\t'
-                     << ref.name << '\t'
-                     << ref.comment << endl;
+                cout << hashCount << '\t'
+                     << length << '\t'
+                     << name << '\t'
+                     << comment << '\n';
             }
             else
             {
-                columns[0].push_back(std::to_string(ref.hashesSorted.size()));
-                columns[1].push_back(std::to_string(ref.length));
-                columns[2].push_back(ref.name);
-                columns[3].push_back(ref.comment);
+                columns[0].push_back(std::to_string(hashCount));
+                columns[1].push_back(std::to_string(length));
+                columns[2].push_back(name);
+                columns[3].push_back(comment);
+            }
+        };
+        
+        for (int i = 0; i < files.size(); i++)
+        {
+            if (readReferenceInfoFromCapnp(files[i].c_str(), sketch.getMinHashesPerWindow(), row))
+            {
+                return 1;
             }
         }
         
@@ -255,94 +293,193 @@ int CommandInfo::printCounts(const Sketch &sketch) const
     return 0;
 }
 
+// Scrive una stringa JSON, con le virgolette e i caratteri di escape necessari
+void writeJsonString(OutputBuffer & output, const string & text)
+{
+    static const char * hex = "0123456789abcdef";
+    
+    output << '"';
+    
+    for (int i = 0; i < text.length(); i++)
+    {
+        unsigned char c = text[i];
+        
+        if (c == '"' || c == '\\')
+        {
+            output << '\\' << char(c);
+        }
+        else if (c < 0x20)
+        {
+            output << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+        }
+        else
+        {
+            output << char(c);
+        }
+    }
+    
+    output << '"';
+}
+
 /**
- * Esporta lo sketch in formato JSON.
+ * Esporta gli schizzi in formato JSON.
  * 
- * Serializza i dati dello sketch e li stampa in formato JSON.
+ * I riferimenti vengono decodificati uno alla volta dai file mappati e scritti
+ * in un buffer svuotato periodicamente, quindi la memoria usata non dipende
+ * dalla dimensione dello sketch. Con --dl ogni oggetto occupa una riga
+ * (intestazione, poi uno schizzo per riga); con --dn si limita il numero di hash.
  * 
- * @param sketch Lo sketch da esportare.
+ * @param sketch Lo sketch con i parametri (dal primo file).
+ * @param files I file .msh da esportare (database già espansi).
  * @return 0 se l'operazione è completata con successo, 1 in caso di errore.
  */
-int CommandInfo::writeJson(const Sketch &sketch) const
+int CommandInfo::writeJson(const Sketch &sketch, const vector<string> &files) const
 {
+    static const uint64_t flushSize = 1 << 20;
+    
+    bool lines = options.at("dumpLines").active;
+    bool limit = options.at("dumpHashes").active;
+    uint64_t hashesMax = limit ? options.at("dumpHashes").getArgumentAsNumber() : 0;
+    
+    // Indentazione e separatori (nessuno in formato NDJSON)
+    const char * newline = lines ? "" : "\n";
+    const char * indent1 = lines ? "" : "\t";
+    const char * indent2 = lines ? "" : "\t\t";
+    const char * indent3 = lines ? "" : "\t\t\t";
+    const char * indent4 = lines ? "" : "\t\t\t\t";
+    const char * space = lines ? "" : " ";
+    
     string alphabet;
     sketch.getAlphabetAsString(alphabet);
     bool use64 = sketch.getUse64();
     
-    cout << "{" << endl;
-    cout << "  \"kmer\" : " << sketch.getKmerSize() << ',' << endl;
-    cout << "  \"alphabet\" : \"" << alphabet << "\"," << endl;
-    cout << "  \"preserveCase\" : " << (sketch.getPreserveCase() ? "true" : "false") << ',' << endl;
-    cout << "  \"canonical\" : " << (sketch.getNoncanonical() ? "false" : "true") << ',' << endl;
-    cout << "  \"sketchSize\" : " << sketch.getMinHashesPerWindow() << ',' << endl;
-    cout << "  \"hashType\" : \"" << HASH << "\"," << endl;
-    cout << "  \"hashBits\" : " << (use64 ? 64 : 32) << ',' << endl;
-    cout << "  \"hashSeed\" : " << sketch.getHashSeed() << ',' << endl;
-    cout << "  \"sketches\" :" << endl;
-    cout << "  [" << endl;
+    OutputBuffer output(flushSize + (1 << 16));
     
-    for (uint64_t i = 0; i < sketch.getReferenceCount(); i++)
+    output << '{' << newline;
+    output << indent1 << "\"kmer\"" << space << ':' << space << sketch.getKmerSize() << ',' << newline;
+    output << indent1 << "\"alphabet\"" << space << ':' << space;
+    writeJsonString(output, alphabet);
+    output << ',' << newline;
+    output << indent1 << "\"preserveCase\"" << space << ':' << space << (sketch.getPreserveCase() ? "true" : "false") << ',' << newline;
+    output << indent1 << "\"canonical\"" << space << ':' << space << (sketch.getNoncanonical() ? "false" : "true") << ',' << newline;
+    output << indent1 << "\"sketchSize\"" << space << ':' << space << sketch.getMinHashesPerWindow() << ',' << newline;
+    
+    if (sketch.getScale())
     {
-        const Sketch::Reference &ref = sketch.getReference(i);
-
+        output << indent1 << "\"scale\"" << space << ':' << space << sketch.getScale() << ',' << newline;
+    }
+    
+    output << indent1 << "\"hashType\"" << space << ':' << space << '"' << (sketch.getHashScheme() == hashSchemePackedKeys ? HASH_PACKED : HASH) << '"' << ',' << newline;
+    output << indent1 << "\"hashBits\"" << space << ':' << space << (use64 ? 64 : 32) << ',' << newline;
+    output << indent1 << "\"hashSeed\"" << space << ':' << space << sketch.getHashSeed();
+    
+    if (lines)
+    {
+        output << "}\n";
+    }
+    else
+    {
+        // (formato di riferimento di test/ref, spazio iniziale compreso)
+        output << ",\n \t\"sketches\" :\n\t[\n";
+    }
+    
+    bool first = true;
+    
+    auto writeReference = [&](const Sketch::Reference &ref)
+    {
+        uint64_t hashCount = ref.hashesSorted.size();
+        uint64_t countCount = ref.counts.size();
         
+        if (limit)
+        {
+            hashCount = std::min(hashCount, hashesMax);
+            countCount = std::min(countCount, hashesMax);
+        }
+        
+        if (!lines && !first)
+        {
+            output << ",\n";
+        }
         
-        cout << "    {" << endl;
-        cout << "      \"name\" : \"" << ref.name << "\"," << endl;
-        cout << "      \"length\" : " << ref.length << ',' << endl;
-        cout << "      \"comment\" : \"" << ref.comment << "\"," << endl;
-        cout << "      \"hashes\" :" << endl;
+        first = false;
         
-        cout << "      [" << endl;
+        output << indent2 << '{' << newline;
+        output << indent3 << "\"name\"" << space << ':' << space;
+        writeJsonString(output, ref.name);
+        output << ',' << newline;
+        output << indent3 << "\"length\"" << space << ':' << space << ref.length << ',' << newline;
+        output << indent3 << "\"comment\"" << space << ':' << space;
+        writeJsonString(output, ref.comment);
         
-        for (int j = 0; j < ref.hashesSorted.size(); j++)
+        if (!limit || hashesMax > 0)
         {
-            cout << "        " << (use64 ? ref.hashesSorted.at(j).hash64 : ref.hashesSorted.at(j).hash32);
+            output << ',' << newline;
+            output << indent3 << "\"hashes\"" << space << ':' << newline;
+            output << indent3 << '[' << newline;
             
-            if (j < ref.hashesSorted.size() - 1)
+            for (uint64_t j = 0; j < hashCount; j++)
             {
-                cout << ',';
+                output << indent4;
+                
+                if (use64)
+                {
+                    output << (unsigned long long)ref.hashesSorted.at(j).hash64;
+                }
+                else
+                {
+                    output << (unsigned long long)ref.hashesSorted.at(j).hash32;
+                }
+                
+                output << (j < hashCount - 1 ? "," : "") << newline;
             }
             
-            cout << endl;
-        }
-        
-        cout << "      ]" << endl;
-        
-        if (ref.countsSorted)
-        {
-            cout << "      \"counts\" :" << endl;
-            cout << "      [" << endl;
-        
-            for (int j = 0; j < ref.counts.size(); j++)
+            output << indent3 << ']';
+            
+            if (ref.countsSorted)
             {
-                cout << "        " << ref.counts.at(j);
+                output << ',' << newline;
+                output << indent3 << "\"counts\"" << space << ':' << newline;
+                output << indent3 << '[' << newline;
                 
-                if (j < ref.counts.size() - 1)
+                for (uint64_t j = 0; j < countCount; j++)
                 {
-                    cout << ',';
+                    output << indent4 << ref.counts.at(j) << (j < countCount - 1 ? "," : "") << newline;
                 }
                 
-                cout << endl;
+                output << indent3 << ']';
             }
+        }
+        
+        output << newline << indent2 << '}';
         
-            cout << "      ]" << endl;
+        if (lines)
+        {
+            output << '\n';
         }
         
-        if (i < sketch.getReferenceCount() - 1)
+        if (output.size() >= flushSize)
         {
-            cout << "    }," << endl;
+            output.write(stdout);
         }
-        else
+    };
+    
+    for (int i = 0; i < files.size(); i++)
+    {
+        if (loadReferencesFromCapnp(files[i].c_str(), sketch.getParameters(), writeReference))
         {
-            cout << "    }" << endl;
+            output.write(stdout);
+            return 1;
         }
     }
     
-    cout << "  ]" << endl;
-    cout << "}" << endl;
+    if (!lines)
+    {
+        output << (first ? "" : "\n") << "\t]\n}\n";
+    }
+    
+    output.write(stdout);
     
     return 0;
 }
 
-} // namespace mash
\ No newline at end of file
+} // namespace mash
@@ -9,6 +9,8 @@
 
 #include "Command.h"
 #include "Sketch.h"
+#include <string>
+#include <vector>
 
 namespace mash {
 
@@ -23,7 +25,7 @@ public:
 private:
 	
 	int printCounts(const Sketch & sketch) const;
-	int writeJson(const Sketch & sketch) const;
+	int writeJson(const Sketch & sketch, const std::vector<std::string> & files) const;
 };
 
 } // namespace mash
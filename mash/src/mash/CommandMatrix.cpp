@@ -0,0 +1,175 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#include "CommandMatrix.h"
+#include "OutputBuffer.h"
+#include <iostream>
+#include <math.h>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+
+namespace mash {
+
+CommandMatrix::CommandMatrix()
+: Command()
+{
+    name = "matrix";
+    summary = "Convert a binary distance matrix to text.";
+    description = "Convert a binary distance matrix (.mdm), written by \"mash triangle -B\" or \"mash dist -B\", to text. Matrices from triangle are written as relaxed Phylip and matrices from dist as a table (as with \"mash dist -t\"). Distances that did not pass the thresholds given when the matrix was written are left blank. The edge list fields are [reference-ID, query-ID, distance, shared-hashes], where shared-hashes is only present if the matrix was written with shared-hash counts.";
+    argumentString = "<matrix>";
+
+    useOption("help");
+    addOption("header", Option(Option::Boolean, "H", "Output", "Only show header info.", ""));
+    addOption("edge", Option(Option::Boolean, "E", "Output", "Output edge list instead of a matrix.", ""));
+    addOption("distance", Option(Option::Number, "d", "Output", "Maximum distance to report in edge list. Implies -" + getOption("edge").identifier + ".", "1.0", 0., 1.));
+}
+
+int CommandMatrix::run() const
+{
+    if ( arguments.size() != 1 || options.at("help").active )
+    {
+        print();
+        return 0;
+    }
+
+    bool edge = options.at("edge").active || options.at("distance").active;
+    double distanceMax = options.at("distance").getArgumentAsNumber();
+
+    DistanceMatrix matrix;
+
+    if ( matrix.load(arguments[0]) )
+    {
+        return 1;
+    }
+
+    if ( options.at("header").active )
+    {
+        writeHeader(matrix);
+    }
+    else if ( edge )
+    {
+        writeEdges(matrix, distanceMax);
+    }
+    else
+    {
+        writeTable(matrix);
+    }
+
+    return 0;
+}
+
+void CommandMatrix::writeEdges(const DistanceMatrix & matrix, double maxDistance) const
+{
+    OutputBuffer output;
+    bool triangle = matrix.getLayout() == DistanceMatrix::Triangle;
+
+    for ( uint64_t i = 0; i < matrix.getRowCount(); i++ )
+    {
+        string nameRow = matrix.getRowName(i);
+
+        for ( uint64_t j = 0; j < matrix.getRowLength(i); j++ )
+        {
+            float distance = matrix.getDistance(i, j);
+
+            if ( isnan(distance) || distance > maxDistance )
+            {
+                continue;
+            }
+
+            if ( triangle )
+            {
+                output << nameRow << '\t' << matrix.getColumnName(j);
+            }
+            else
+            {
+                output << matrix.getColumnName(j) << '\t' << nameRow;
+            }
+
+            output << '\t' << distance;
+
+            if ( matrix.hasShared() )
+            {
+                uint64_t numerator;
+                uint64_t denominator;
+
+                matrix.getShared(i, j, numerator, denominator);
+                output << '\t' << numerator << '/' << denominator;
+            }
+
+            output << '\n';
+        }
+
+        if ( output.size() >= 1 << 16 )
+        {
+            output.write(stdout);
+        }
+    }
+
+    output.write(stdout);
+}
+
+void CommandMatrix::writeHeader(const DistanceMatrix & matrix) const
+{
+    cout << "Layout:     " << (matrix.getLayout() == DistanceMatrix::Triangle ? "lower triangle" : "rectangle") << endl;
+    cout << "Rows:       " << matrix.getRowCount() << endl;
+    cout << "Columns:    " << matrix.getColumnCount() << endl;
+    cout << "Distances:  " << matrix.getCellCount() << " (float" << matrix.getPrecision() << ")" << endl;
+    cout << "Shared:     " << (matrix.hasShared() ? "yes" : "no") << endl;
+}
+
+void CommandMatrix::writeTable(const DistanceMatrix & matrix) const
+{
+    OutputBuffer output;
+
+    if ( matrix.getLayout() == DistanceMatrix::Triangle )
+    {
+        // relaxed Phylip, as "mash triangle" writes it
+
+        output << '\t' << matrix.getRowCount() << '\n';
+    }
+    else
+    {
+        output << "#query";
+
+        for ( uint64_t j = 0; j < matrix.getColumnCount(); j++ )
+        {
+            output << '\t' << matrix.getColumnName(j);
+        }
+
+        output << '\n';
+    }
+
+    for ( uint64_t i = 0; i < matrix.getRowCount(); i++ )
+    {
+        output << matrix.getRowName(i);
+
+        for ( uint64_t j = 0; j < matrix.getRowLength(i); j++ )
+        {
+            float distance = matrix.getDistance(i, j);
+
+            output << '\t';
+
+            if ( ! isnan(distance) )
+            {
+                output << distance;
+            }
+        }
+
+        output << '\n';
+
+        if ( output.size() >= 1 << 16 )
+        {
+            output.write(stdout);
+        }
+    }
+
+    output.write(stdout);
+}
+
+} // namespace mash
@@ -0,0 +1,32 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#ifndef INCLUDED_CommandMatrix
+#define INCLUDED_CommandMatrix
+
+#include "Command.h"
+#include "DistanceMatrix.h"
+
+namespace mash {
+
+class CommandMatrix : public Command
+{
+public:
+
+    CommandMatrix();
+
+    int run() const; // override
+
+private:
+
+    void writeEdges(const DistanceMatrix & matrix, double maxDistance) const;
+    void writeHeader(const DistanceMatrix & matrix) const;
+    void writeTable(const DistanceMatrix & matrix) const;
+};
+
+} // namespace mash
+
+#endif
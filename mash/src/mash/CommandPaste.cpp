@@ -6,6 +6,7 @@
 
 #include "CommandPaste.h"
 #include "Sketch.h"
+#include "SketchDatabase.h"
 #include <iostream>
 #include "unistd.h"
 
@@ -21,7 +22,7 @@ CommandPaste::CommandPaste()
 {
     name = "paste";
     summary = "Create a single sketch file from multiple sketch files.";
-    description = "Create a single sketch file from multiple sketch files.";
+    description = "Create a single sketch file from multiple sketch files. If the output ends with '" + string(suffixSketchDatabase) + "', the sketches are instead added as a new segment of that sketch database (created if needed), without rewriting the sketches already in it (see \"mash compact\").";
     argumentString = "<out_prefix> <sketch> [<sketch>] ...";
     
     // Opzioni disponibili per questo comando
@@ -31,6 +32,8 @@ CommandPaste::CommandPaste()
     // Opzione fingerPrint per inserire file di tipo fingerprint con formato .txt
     addOption("fingerPrint", Option(Option::Boolean, "fp" ,"","Insert fingerprint files are lists of file names.",""));
     // Opzione per indicare che questo file è un file di Output 
+    // Opzione per scrivere gli hash compressi (delta + bit-packing)
+    addOption("packed", Option(Option::Boolean, "-pack", "", "Store hashes delta-encoded and bit-packed, which makes sketch files smaller (typically 2-3x for 32-bit hashes and 1.4x for 64-bit). Such files can only be read by versions of Mash that support them.", ""));
     addOption("output",Option(Option::Boolean,"o","","Insert -o to indicate the name and path for the output file. Take this option as the last one after -fp or -l ",""));
 
 }
@@ -130,10 +133,7 @@ int CommandPaste::run() const
 
     }
     
-    Sketch sketch; // Oggetto Sketch per gestire gli sketch
     std::vector<string> filesGood; // Vettore per memorizzare i file validi
-    Sketch::Parameters parameters; // Parametri per l'oggetto Sketch
-    parameters.parallelism = 1; // Imposta il parallelismo a 1
     
     // Deve iterare su file che hanno suffisso sia .txt e sia .msh 
     if(fingerPrint){
@@ -200,7 +200,7 @@ int CommandPaste::run() const
         {
             const string & file = files[i];
             // Verifica se il file ha il suffisso corretto
-            if ( ! hasSuffix(file, suffixSketch) )
+            if ( ! isSketchFile(file) )
             {
                 cerr << "ERROR: The file \"" << file << "\" does not look like a sketch." << endl;
                 return 1;
@@ -211,7 +211,10 @@ int CommandPaste::run() const
         }
     }
     
-        sketch.initFromFiles(filesGood, parameters);
+    // I riferimenti vengono copiati direttamente dai file di input (vedi
+    // pasteCapnp()), senza caricarli: i database vengono espansi nei segmenti.
+    std::vector<string> filesSketch;
+    expandSketchDatabases(filesGood, filesSketch);
 
 
 
@@ -225,6 +228,14 @@ int CommandPaste::run() const
     // Verifica sul file di Output 
 
 
+    // Se l'output è un database, gli sketch vengono aggiunti come nuovo segmento
+    // senza riscrivere quelli già presenti.
+    if ( isSketchDatabase(out) )
+    {
+        cerr << "Adding to " << out << "..." << endl;
+        return appendToSketchDatabase(out, filesSketch, options.at("packed").active);
+    }
+
     // Aggiungi il suffisso al file di output se non è presente
     if ( ! hasSuffix(out, suffixSketch) )
     {
@@ -239,9 +250,7 @@ int CommandPaste::run() const
     }
     
     cerr << "Writing " << out << "..." << endl; // Messaggio di log
-    sketch.writeToCapnp(out.c_str()); // Scrivi l'oggetto Sketch nel file di output
-    
-    return 0; // Termina con successo
+    return pasteCapnp(filesSketch, out.c_str(), options.at("packed").active); // Copia i riferimenti nel file di output
 }
 
 
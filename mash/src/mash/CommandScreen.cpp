@@ -1,19 +1,16 @@
 #include "CommandScreen.h"
 #include "CommandDistance.h" // for pvalue
+#include "ServeProtocol.h"
 #include "Sketch.h"
+#include "Stats.h"
 #include "kseq.h"
 #include <iostream>
 #include <zlib.h>
 #include "ThreadPool.h"
+#include "OutputBuffer.h"
 #include <math.h>
 #include "robin_hood.h"
 
-#ifdef USE_BOOST
-    #include <boost/math/distributions/binomial.hpp>
-    using namespace::boost::math;
-#else
-    #include <gsl/gsl_cdf.h>
-#endif
 
 #define SET_BINARY_MODE(file)
 KSEQ_INIT(gzFile, gzread)
@@ -42,12 +39,15 @@ CommandScreen::CommandScreen()
     addOption("pvalue", Option(Option::Number, "v", "Output", "Maximum p-value to report.", "1.0", 0., 1.));
     addOption("saturation", Option(Option::Boolean, "s", "", "Include saturation curve in output. Each line will have an additional field representing the absolute number of k-mers seen at each Jaccard increase, formatted as a comma-separated list.", ""));
     addOption("fingerprint", Option(Option::Boolean, "fp", "", "Option about fingerprint, insert as argument[0] file about sketch file and other files as .txt in argument[1]", ""));
+    addOption("server", Option(Option::File, "-server", "", "Screen against the <queries> sketch held by a \"mash serve\" process listening on this socket instead of loading it. All arguments are then mixtures, whose sequences are sent to the server to be screened as they would be here. Incompatible with -w, -s and -fp.", ""));
 
 }
 
 int CommandScreen::run() const
 {
-    if (arguments.size() < 2 || options.at("help").active)
+    bool server = options.at("server").active;
+
+    if (arguments.size() < (server ? 1 : 2) || options.at("help").active)
     {
         print();
         return 0;
@@ -58,6 +58,23 @@ int CommandScreen::run() const
     double identityMin = options.at("identity").getArgumentAsNumber();
     bool fingerprint = options.at("fingerprint").active;
 
+    if (server)
+    {
+        if (sat || options.at("winning!").active || fingerprint)
+        {
+            cerr << "ERROR: The options -" << options.at("winning!").identifier << ", -" << options.at("saturation").identifier << " and -" << options.at("fingerprint").identifier << " cannot be used with -" << options.at("server").identifier << "." << endl;
+            return 1;
+        }
+
+        ServeMessage request;
+
+        request.putByte(ServeScreen);
+        request.putDouble(pValueMax);
+        request.putDouble(identityMin);
+
+        return runServerScreen(options.at("server").argument, request, arguments);
+    }
+
     vector<string> refArgVector;
     refArgVector.push_back(arguments[0]);
 
@@ -66,6 +83,13 @@ int CommandScreen::run() const
 
     sketch.initFromFiles(refArgVector, parameters);
 
+    // Lo screening scorre i k-mer come byte: non gestisce gli sketch UTF-8
+    if (sketch.getUnicode())
+    {
+        cerr << "ERROR: Screening against UTF-8 (--utf8) sketches is not supported." << endl;
+        return 1;
+    }
+
     string alphabet;
     sketch.getAlphabetAsString(alphabet);
     setAlphabetFromString(parameters, alphabet.c_str());
@@ -76,12 +100,17 @@ int CommandScreen::run() const
     parameters.use64 = sketch.getUse64();
     parameters.preserveCase = sketch.getPreserveCase();
     parameters.seed = sketch.getHashSeed();
+    parameters.hashScheme = sketch.getHashScheme();
+    parameters.scale = sketch.getScale();
+    parameters.fingerprintWhole = sketch.getFingerprintWhole();
     parameters.minHashesPerWindow = sketch.getMinHashesPerWindow();
 
     HashTable hashTable;
     robin_hood::unordered_map<uint64_t, std::atomic<uint32_t>> hashCounts;
     robin_hood::unordered_map<uint64_t, list<uint32_t>> saturationByIndex;
 
+    StatsPhase phase(Stats::Compare);
+
     cerr << "Loading " << arguments[0] << "..." << endl;
 
     for (int i = 0; i < sketch.getReferenceCount(); i++)
@@ -127,6 +156,11 @@ int CommandScreen::run() const
     cerr << "Loading " << arguments[1] << " as query..." << endl;
 
     uint64_t setSize = hashTable.size();
+
+    // Per le fingerprint l'identità è la frazione di hash condivisi (k = 1) e
+    // lo spazio del modello nullo è quello degli hash (vedi compareSketches).
+    int kmerSizeIdentity = fingerprint ? 1 : parameters.kmerSize;
+    double kmerSpace = fingerprint ? getFingerprintSpace(parameters.use64) : sketch.getKmerSpace();
     vector<uint64_t> shared(querySketch.getReferenceCount(), 0);
     vector<vector<uint64_t>> depths(querySketch.getReferenceCount());
 
@@ -157,7 +191,7 @@ int CommandScreen::run() const
 
         for (int i = 0; i < sketch.getReferenceCount(); i++)
         {
-            scores[i] = estimateIdentity(shared[i], sketch.getReference(i).hashesSorted.size(), parameters.kmerSize, sketch.getKmerSpace());
+            scores[i] = estimateIdentity(shared[i], sketch.getReference(i).hashesSorted.size(), kmerSizeIdentity, kmerSpace);
         }
 
         memset(shared.data(), 0, sizeof(uint64_t) * sketch.getReferenceCount());
@@ -210,49 +244,62 @@ int CommandScreen::run() const
         sort(depths[i].begin(), depths[i].end());
     }
 
+    Stats::add(Stats::PairsCompared, querySketch.getReferenceCount());
+
     cerr << "Writing output..." << endl;
 
+    StatsPhase phaseOutput(Stats::Output);
+
+    OutputBuffer output;
+    PValueTable pValueTable(sketch.getScale() ? 0 : sketch.getMinHashesPerWindow()); // (scaled: no fixed size)
+
     for (int i = 0; i < querySketch.getReferenceCount(); i++)
     {
-            cerr << "Sono qui !..." << endl;
         if (shared[i] != 0 || identityMin < 0.0)
         {
-            double identity = estimateIdentity(shared[i], querySketch.getReference(i).hashesSorted.size(), parameters.kmerSize, sketch.getKmerSpace());
+            double identity = estimateIdentity(shared[i], querySketch.getReference(i).hashesSorted.size(), kmerSizeIdentity, kmerSpace);
 
             if (identity < identityMin)
             {
                 continue;
             }
 
-            double pValue = pValueWithin(shared[i], setSize, sketch.getKmerSpace(), querySketch.getReference(i).hashesSorted.size());
+            double pValue = pValueWithin(shared[i], setSize, kmerSpace, querySketch.getReference(i).hashesSorted.size(), pValueTable, pValueMax);
 
             if (pValue > pValueMax)
             {
                 continue;
             }
 
-            cout << identity << '\t' << shared[i] << '/' << querySketch.getReference(i).hashesSorted.size() << '\t'
+            output << identity << '\t' << shared[i] << '/' << querySketch.getReference(i).hashesSorted.size() << '\t'
                  << (shared[i] > 0 ? depths[i].at(shared[i] / 2) : 0) << '\t' << pValue << '\t' << querySketch.getReference(i).name << '\t' << querySketch.getReference(i).comment;
 
              if (sat)
              {
-                 cout << '\t';
+                 output << '\t';
 
                  for (auto j = saturationByIndex.at(i).begin(); j != saturationByIndex.at(i).end(); j++)
                  {
                      if (j != saturationByIndex.at(i).begin())
                      {
-                         cout << ',';
+                         output << ',';
                      }
 
-                     cout << *j;
+                     output << *j;
                  }
              }
 
-            cout << endl;
+            output << '\n';
+
+            if (output.size() >= 1 << 16)
+            {
+                output.write(stdout);
+            }
         }
     }
 
+    output.write(stdout);
+
     return 0;
 }
 
@@ -360,8 +407,10 @@ CommandScreen::HashOutput * hashSequence(CommandScreen::HashInput * input)
             hash_u hash = getHash(kmer, kmerSize, seed, use64);
             uint64_t key = use64 ? hash.hash64 : hash.hash32;
 
-            // Messaggio di debug
-            cerr << "Comparing Hash: " << key << " in hashCounts" << endl;
+            if (input->minHashHeap != 0)
+            {
+                input->minHashHeap->tryInsert(hash); // (for the size of the mixture)
+            }
 
             if (input->hashCounts.count(key) == 1)
             {
@@ -383,7 +432,7 @@ CommandScreen::HashOutput * hashSequence(CommandScreen::HashInput * input)
     return output;
 }
 
-double pValueWithin(uint64_t x, uint64_t setSize, double kmerSpace, uint64_t sketchSize)
+double pValueWithin(uint64_t x, uint64_t setSize, double kmerSpace, uint64_t sketchSize, const PValueTable & pValueTable, double maxPValue)
 {
     if (x == 0)
     {
@@ -398,11 +447,7 @@ double pValueWithin(uint64_t x, uint64_t setSize, double kmerSpace, uint64_t ske
         r = std::max(0.0, std::min(1.0, r));
     }
 
-#ifdef USE_BOOST
-    return cdf(complement(binomial(sketchSize, r), x - 1));
-#else
-    return gsl_cdf_binomial_Q(x - 1, r, sketchSize);
-#endif
+    return pValueTable.getPValue(x, sketchSize, r, maxPValue);
 }
 
 void translate(const char * src, char * dst, uint64_t len)
@@ -15,6 +15,7 @@
 #include <atomic>
 #include "robin_hood.h"
 #include "MinHashHeap.h"
+#include "PValueTable.h"
 
 namespace mash {
 
@@ -162,7 +163,7 @@ private:
 char aaFromCodon(const char * codon);
 double estimateIdentity(uint64_t common, uint64_t denom, int kmerSize, double kmerSpace);
 CommandScreen::HashOutput * hashSequence(CommandScreen::HashInput * input);
-double pValueWithin(uint64_t x, uint64_t setSize, double kmerSpace, uint64_t sketchSize);
+double pValueWithin(uint64_t x, uint64_t setSize, double kmerSpace, uint64_t sketchSize, const PValueTable & pValueTable, double maxPValue = -1);
 void translate(const char * src, char * dst, uint64_t len);
 void useThreadOutput(CommandScreen::HashOutput * output, robin_hood::unordered_set<MinHashHeap *> & minHashHeaps);
 
@@ -0,0 +1,703 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#include "CommandServe.h"
+#include "CommandContain.h"
+#include "CommandDistance.h"
+#include "CommandScreen.h"
+#include "SketchDatabase.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <errno.h>
+#include <exception>
+#include <iostream>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace::std;
+
+namespace mash {
+
+// Holds the thread pool of the server for one request. Tasks the request
+// leaves behind (when it throws) are dropped, so the next one only sees its
+// own outputs.
+//
+class PoolRequest
+{
+public:
+
+    PoolRequest(CommandServe::Database & databaseNew)
+        :
+        database(databaseNew)
+    {
+        pthread_mutex_lock(&database.mutexPool);
+    }
+
+    ~PoolRequest()
+    {
+        while ( database.threadPool.running() )
+        {
+            delete database.threadPool.popOutputWhenAvailable();
+        }
+
+        pthread_mutex_unlock(&database.mutexPool);
+    }
+
+    bool outputAvailable() const {return database.threadPool.outputAvailable();}
+    bool running() const {return database.threadPool.running();}
+
+    template <class TypeInput, class TypeOutput>
+    void run(TypeOutput * (* function)(TypeInput *), TypeInput * input)
+    {
+        database.threadPool.runWhenThreadAvailable(new CommandServe::TaskFunction<TypeInput, TypeOutput>(function, input));
+    }
+
+    template <class TypeInput, class TypeOutput>
+    TypeOutput * popOutputWhenAvailable(TypeOutput * (* function)(TypeInput *)) // (function for the types only)
+    {
+        CommandServe::TaskFunction<TypeInput, TypeOutput> * task = (CommandServe::TaskFunction<TypeInput, TypeOutput> *)database.threadPool.popOutputWhenAvailable();
+        TypeOutput * output = task->output;
+
+        task->output = 0;
+        delete task;
+
+        return output;
+    }
+
+private:
+
+    CommandServe::Database & database;
+};
+
+CommandServe::CommandServe()
+: Command()
+{
+    name = "serve";
+    summary = "Keep a reference sketch in memory to answer queries.";
+    description = "Load a reference sketch (.msh) once and answer dist, screen and contain queries over a local socket until killed. Give the socket to those commands with --server, in place of the reference (or, for screen, the queries) argument; dist and contain sketch their queries with the parameters of the reference, screen sends its mixtures to be hashed in full, and each receives the same output it would have written.";
+    argumentString = "<reference>.msh";
+
+    useOption("help");
+    useOption("threads");
+    addOption("socket", Option(Option::File, "u", "", "Path of the (Unix domain) socket to listen on. An existing socket at this path is replaced.", serveSocketDefault));
+}
+
+int CommandServe::run() const
+{
+    if ( arguments.size() != 1 || options.at("help").active )
+    {
+        print();
+        return 0;
+    }
+
+    int threads = options.at("threads").getArgumentAsNumber();
+    string socketPath = options.at("socket").argument;
+
+    if ( ! isSketchFile(arguments[0]) )
+    {
+        cerr << "ERROR: The reference must be a sketch (" << suffixSketch << ") or sketch database (" << suffixSketchDatabase << ") file." << endl;
+        return 1;
+    }
+
+    struct sockaddr_un address;
+
+    if ( socketPath.length() >= sizeof(address.sun_path) )
+    {
+        cerr << "ERROR: The socket path " << socketPath << " is too long." << endl;
+        return 1;
+    }
+
+    cerr << "Loading " << arguments[0] << "..." << endl;
+
+    Sketch sketch;
+    Sketch::Parameters parameters;
+    parameters.parallelism = threads;
+
+    sketch.initFromFiles(vector<string>(1, arguments[0]), parameters);
+
+    Database database(sketch, threads);
+    createScreenIndex(database);
+
+    cerr << "   " << sketch.getReferenceCount() << " references, " << database.indexHashes.size() << " distinct hashes." << endl;
+
+    // replace a stale socket, but nothing else
+
+    struct stat fileInfo;
+
+    if ( lstat(socketPath.c_str(), &fileInfo) == 0 )
+    {
+        if ( ! S_ISSOCK(fileInfo.st_mode) )
+        {
+            cerr << "ERROR: " << socketPath << " exists and is not a socket." << endl;
+            return 1;
+        }
+
+        unlink(socketPath.c_str());
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath.c_str());
+
+    if ( fd < 0 || bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 64) != 0 )
+    {
+        cerr << "ERROR: Could not listen on " << socketPath << " (" << strerror(errno) << ")." << endl;
+        return 1;
+    }
+
+    // clients that hang up shouldn't take the server with them
+
+    signal(SIGPIPE, SIG_IGN);
+
+    cerr << "Listening on " << socketPath << "..." << endl;
+
+    while ( true )
+    {
+        int fdClient = accept(fd, 0, 0);
+
+        if ( fdClient < 0 )
+        {
+            if ( errno == EINTR || errno == ECONNABORTED )
+            {
+                continue;
+            }
+
+            cerr << "ERROR: Could not accept connection (" << strerror(errno) << ")." << endl;
+            break;
+        }
+
+        pthread_t thread;
+
+        if ( pthread_create(&thread, NULL, serveConnection, new Connection(database, fdClient)) != 0 )
+        {
+            cerr << "WARNING: Could not start a thread for a connection." << endl;
+            close(fdClient);
+            continue;
+        }
+
+        pthread_detach(thread);
+    }
+
+    close(fd);
+    unlink(socketPath.c_str());
+
+    return 1;
+}
+
+void createScreenIndex(CommandServe::Database & database)
+{
+    const Sketch & sketch = database.sketch;
+    vector<pair<uint64_t, uint32_t>> hashReferences;
+
+    for ( uint64_t i = 0; i < sketch.getReferenceCount(); i++ )
+    {
+        const HashList & hashes = sketch.getReference(i).hashesSorted;
+
+        for ( int j = 0; j < hashes.size(); j++ )
+        {
+            hashReferences.push_back(pair<uint64_t, uint32_t>(hashes.get64() ? hashes.at(j).hash64 : hashes.at(j).hash32, i));
+        }
+    }
+
+    sort(hashReferences.begin(), hashReferences.end());
+
+    database.indexReferences.reserve(hashReferences.size());
+
+    for ( uint64_t i = 0; i < hashReferences.size(); i++ )
+    {
+        if ( i == 0 || hashReferences[i].first != hashReferences[i - 1].first )
+        {
+            database.indexHashes.push_back(hashReferences[i].first);
+            database.indexOffsets.push_back(i);
+        }
+
+        database.indexReferences.push_back(hashReferences[i].second);
+    }
+
+    database.indexOffsets.push_back(database.indexReferences.size());
+}
+
+void getDatabaseParameters(const Sketch & sketch, Sketch::Parameters & parametersToSet)
+{
+    parametersToSet.kmerSize = sketch.getKmerSize();
+    parametersToSet.minHashesPerWindow = sketch.getMinHashesPerWindow();
+    parametersToSet.noncanonical = sketch.getNoncanonical();
+    parametersToSet.preserveCase = sketch.getPreserveCase();
+    parametersToSet.seed = sketch.getHashSeed();
+    parametersToSet.use64 = sketch.getUse64();
+    parametersToSet.scale = sketch.getScale();
+    parametersToSet.fingerprintWhole = sketch.getFingerprintWhole();
+    parametersToSet.hashScheme = sketch.getHashScheme();
+    
+    if ( sketch.getUnicode() )
+    {
+        setAlphabetUnicode(parametersToSet);
+    }
+    else
+    {
+        string alphabet;
+        sketch.getAlphabetAsString(alphabet);
+        setAlphabetFromString(parametersToSet, alphabet.c_str());
+    }
+}
+
+void * serveConnection(void * arg)
+{
+    CommandServe::Connection * connection = (CommandServe::Connection *)arg;
+    CommandServe::Database & database = connection->database;
+
+    // a bad request (or running out of memory for one) costs its connection,
+    // not the server
+
+    try
+    {
+        while ( true )
+        {
+            ServeMessage request;
+            ServeMessage response;
+            uint8_t type;
+            string output;
+            bool success;
+
+            if ( ! readFrame(connection->fd, request.data) || ! request.getByte(type) )
+            {
+                break;
+            }
+
+            switch ( type )
+            {
+                case ServeParameters:
+                    putParameters(response, database.sketch);
+                    break;
+
+                case ServeDistance:
+                case ServeScreen:
+                case ServeContain:
+
+                    if ( type == ServeDistance )
+                    {
+                        success = serveDistance(request, database, output);
+                    }
+                    else if ( type == ServeScreen )
+                    {
+                        success = serveScreen(request, connection->fd, database, output);
+                    }
+                    else
+                    {
+                        success = serveContain(request, database, output);
+                    }
+
+                    response.putByte(success ? ServeOk : ServeError);
+                    response.putString(success || ! output.empty() ? output : "Malformed request.");
+                    break;
+
+                default:
+
+                    response.putByte(ServeError);
+                    response.putString("Unknown request.");
+            }
+
+            if ( ! writeFrame(connection->fd, response.data) )
+            {
+                break;
+            }
+        }
+    }
+    catch ( const exception & e )
+    {
+        cerr << "WARNING: Dropped a connection (" << e.what() << ")." << endl;
+    }
+
+    close(connection->fd);
+    delete connection;
+
+    return NULL;
+}
+
+bool serveContain(ServeMessage & request, CommandServe::Database & database, string & outputToSet)
+{
+    const Sketch & sketchRef = database.sketch;
+    Sketch::Parameters parameters;
+    double error;
+    vector<Sketch::Reference> references;
+
+    if ( ! request.getDouble(error) || ! getReferences(request, sketchRef.getUse64(), references) )
+    {
+        return false;
+    }
+
+    getDatabaseParameters(sketchRef, parameters);
+    parameters.error = error;
+
+    Sketch sketchQuery;
+    sketchQuery.initFromReferences(references, parameters);
+
+    // as in CommandContain::run()
+
+    uint64_t pairCount = sketchRef.getReferenceCount() * sketchQuery.getReferenceCount();
+    uint64_t pairsPerThread = pairCount / database.threads;
+
+    if ( pairsPerThread == 0 )
+    {
+        pairsPerThread = 1;
+    }
+
+    static uint64_t maxPairsPerThread = 0x1000;
+
+    if ( pairsPerThread > maxPairsPerThread )
+    {
+        pairsPerThread = maxPairsPerThread;
+    }
+
+    uint64_t iFloor = pairsPerThread / sketchRef.getReferenceCount();
+    uint64_t iMod = pairsPerThread % sketchRef.getReferenceCount();
+
+    PoolRequest threadPool(database);
+
+    for ( uint64_t i = 0, j = 0; i < sketchQuery.getReferenceCount(); i += iFloor, j += iMod )
+    {
+        if ( j >= sketchRef.getReferenceCount() )
+        {
+            if ( i == sketchQuery.getReferenceCount() - 1 )
+            {
+                break;
+            }
+
+            i++;
+            j -= sketchRef.getReferenceCount();
+        }
+
+        threadPool.run(contain, new CommandContain::ContainInput(sketchRef, sketchQuery, j, i, pairsPerThread, parameters));
+
+        while ( threadPool.outputAvailable() )
+        {
+            CommandContain::ContainOutput * output = threadPool.popOutputWhenAvailable(contain);
+            outputToSet.append(output->buffer.data(), output->buffer.size());
+            delete output;
+        }
+    }
+
+    while ( threadPool.running() )
+    {
+        CommandContain::ContainOutput * output = threadPool.popOutputWhenAvailable(contain);
+        outputToSet.append(output->buffer.data(), output->buffer.size());
+        delete output;
+    }
+
+    return true;
+}
+
+bool serveDistance(ServeMessage & request, CommandServe::Database & database, string & outputToSet)
+{
+    const Sketch & sketchRef = database.sketch;
+    Sketch::Parameters parameters;
+    double distanceMax;
+    double pValueMax;
+    uint8_t table;
+    uint8_t comment;
+    uint8_t fingerprint;
+    vector<Sketch::Reference> references;
+
+    if
+    (
+        ! request.getDouble(distanceMax) ||
+        ! request.getDouble(pValueMax) ||
+        ! request.getByte(table) ||
+        ! request.getByte(comment) ||
+        ! request.getByte(fingerprint) ||
+        ! getReferences(request, sketchRef.getUse64(), references)
+    )
+    {
+        return false;
+    }
+
+    getDatabaseParameters(sketchRef, parameters);
+
+    Sketch sketchQuery;
+    sketchQuery.initFromReferences(references, parameters);
+
+    if ( table )
+    {
+        outputToSet.append("#query");
+
+        for ( uint64_t i = 0; i < sketchRef.getReferenceCount(); i++ )
+        {
+            outputToSet.append("\t");
+            outputToSet.append(sketchRef.getReference(i).name);
+        }
+
+        outputToSet.append("\n");
+    }
+
+    // as in CommandDistance::run()
+
+    uint64_t pairCount = sketchRef.getReferenceCount() * sketchQuery.getReferenceCount();
+    uint64_t pairsPerThread = pairCount / database.threads;
+
+    if ( pairsPerThread == 0 )
+    {
+        pairsPerThread = 1;
+    }
+
+    static uint64_t maxPairsPerThread = 0x1000;
+
+    if ( pairsPerThread > maxPairsPerThread )
+    {
+        pairsPerThread = maxPairsPerThread;
+    }
+
+    uint64_t iFloor = pairsPerThread / sketchRef.getReferenceCount();
+    uint64_t iMod = pairsPerThread % sketchRef.getReferenceCount();
+
+    PoolRequest threadPool(database);
+
+    for ( uint64_t i = 0, j = 0; i < sketchQuery.getReferenceCount(); i += iFloor, j += iMod )
+    {
+        if ( j >= sketchRef.getReferenceCount() )
+        {
+            if ( i == sketchQuery.getReferenceCount() - 1 )
+            {
+                break;
+            }
+
+            i++;
+            j -= sketchRef.getReferenceCount();
+        }
+
+        threadPool.run(compare, new CommandDistance::CompareInput(sketchRef, sketchQuery, j, i, pairsPerThread, parameters, distanceMax, pValueMax, fingerprint, table, comment, false, database.pValueTable));
+
+        while ( threadPool.outputAvailable() )
+        {
+            CommandDistance::CompareOutput * output = threadPool.popOutputWhenAvailable(compare);
+            outputToSet.append(output->buffer.data(), output->buffer.size());
+            delete output;
+        }
+    }
+
+    while ( threadPool.running() )
+    {
+        CommandDistance::CompareOutput * output = threadPool.popOutputWhenAvailable(compare);
+        outputToSet.append(output->buffer.data(), output->buffer.size());
+        delete output;
+    }
+
+    return true;
+}
+
+void hashMixture(CommandServe::Database & database, vector<string> & inputs, robin_hood::unordered_map<uint64_t, std::atomic<uint32_t>> & hashCounts, robin_hood::unordered_set<MinHashHeap *> & minHashHeaps, const Sketch::Parameters & parameters, bool trans)
+{
+    PoolRequest threadPool(database);
+
+    for ( uint64_t i = 0; i < inputs.size(); i++ )
+    {
+        char * seqCopy = new char[inputs[i].length()];
+        memcpy(seqCopy, inputs[i].data(), inputs[i].length());
+
+        if ( minHashHeaps.begin() == minHashHeaps.end() )
+        {
+            minHashHeaps.emplace(new MinHashHeap(parameters.use64, parameters.minHashesPerWindow, 1, 0, getHashMaximum(parameters)));
+        }
+
+        threadPool.run(hashSequence, new CommandScreen::HashInput(hashCounts, *minHashHeaps.begin(), seqCopy, inputs[i].length(), parameters, trans));
+
+        minHashHeaps.erase(minHashHeaps.begin());
+
+        while ( threadPool.outputAvailable() )
+        {
+            useThreadOutput(threadPool.popOutputWhenAvailable(hashSequence), minHashHeaps);
+        }
+    }
+
+    while ( threadPool.running() )
+    {
+        useThreadOutput(threadPool.popOutputWhenAvailable(hashSequence), minHashHeaps);
+    }
+
+    inputs.clear();
+}
+
+bool serveScreen(ServeMessage & request, int fd, CommandServe::Database & database, string & outputToSet)
+{
+    const Sketch & sketch = database.sketch;
+    Sketch::Parameters parameters;
+    double pValueMax;
+    double identityMin;
+    bool success = request.getDouble(pValueMax) && request.getDouble(identityMin);
+
+    if ( sketch.getUnicode() )
+    {
+        outputToSet = "Screening against UTF-8 (--utf8) sketches is not supported.";
+        success = false;
+    }
+
+    // as in CommandScreen::run(), with the index standing in for its hash
+    // table: every k-mer of the mixture is counted if any reference has it
+
+    getDatabaseParameters(sketch, parameters);
+
+    string alphabet;
+    sketch.getAlphabetAsString(alphabet);
+    bool trans = (alphabet == alphabetProtein);
+
+    robin_hood::unordered_map<uint64_t, std::atomic<uint32_t>> hashCounts;
+    robin_hood::unordered_set<MinHashHeap *> minHashHeaps;
+
+    hashCounts.reserve(database.indexHashes.size());
+
+    for ( uint64_t i = 0; i < database.indexHashes.size(); i++ )
+    {
+        hashCounts[database.indexHashes[i]] = 0;
+    }
+
+    vector<string> inputs;
+    uint64_t count = 0;
+
+    // read the mixture to its empty frame, even after an error, so the next
+    // request starts at a frame boundary; frames are hashed a batch at a
+    // time, so the pool isn't held while waiting on the client
+
+    while ( true )
+    {
+        ServeMessage chunk;
+
+        if ( ! readFrame(fd, chunk.data) )
+        {
+            success = false;
+            break;
+        }
+
+        if ( chunk.data.empty() )
+        {
+            break;
+        }
+
+        string input;
+        string sequence;
+
+        while ( success && chunk.getRemaining() > 0 )
+        {
+            if ( ! chunk.getString(sequence) )
+            {
+                success = false;
+                break;
+            }
+
+            count++;
+
+            if ( sequence.length() >= parameters.kmerSize )
+            {
+                input.append(1, '*');
+                input.append(sequence);
+            }
+        }
+
+        if ( success && ! input.empty() )
+        {
+            inputs.push_back(input);
+        }
+
+        if ( inputs.size() >= (uint64_t)database.threads )
+        {
+            hashMixture(database, inputs, hashCounts, minHashHeaps, parameters, trans);
+        }
+    }
+
+    if ( success )
+    {
+        hashMixture(database, inputs, hashCounts, minHashHeaps, parameters, trans);
+    }
+
+    MinHashHeap minHashHeap(sketch.getUse64(), sketch.getMinHashesPerWindow(), 1, 0, getHashMaximum(parameters));
+
+    for ( robin_hood::unordered_set<MinHashHeap *>::const_iterator i = minHashHeaps.begin(); i != minHashHeaps.end(); i++ )
+    {
+        HashList hashList(sketch.getUse64());
+
+        (*i)->toHashList(hashList);
+
+        for ( int j = 0; j < hashList.size(); j++ )
+        {
+            minHashHeap.tryInsert(hashList.at(j));
+        }
+
+        delete *i;
+    }
+
+    if ( ! success )
+    {
+        return false;
+    }
+
+    if ( count == 0 )
+    {
+        outputToSet = "Did not find sequence records in the mixture.";
+        return false;
+    }
+
+    // score each reference by the hashes it shares with the mixture
+
+    uint64_t setSize = minHashHeap.estimateSetSize();
+    vector<uint64_t> shared(sketch.getReferenceCount(), 0);
+    vector<vector<uint32_t>> depths(sketch.getReferenceCount());
+
+    for ( uint64_t i = 0; i < database.indexHashes.size(); i++ )
+    {
+        uint32_t depth = hashCounts[database.indexHashes[i]];
+
+        if ( depth == 0 )
+        {
+            continue;
+        }
+
+        for ( uint64_t j = database.indexOffsets[i]; j < database.indexOffsets[i + 1]; j++ )
+        {
+            shared[database.indexReferences[j]]++;
+            depths[database.indexReferences[j]].push_back(depth);
+        }
+    }
+
+    OutputBuffer output;
+
+    for ( uint64_t i = 0; i < sketch.getReferenceCount(); i++ )
+    {
+        const Sketch::Reference & reference = sketch.getReference(i);
+
+        if ( shared[i] == 0 && identityMin >= 0.0 )
+        {
+            continue;
+        }
+
+        double identity = estimateIdentity(shared[i], reference.hashesSorted.size(), sketch.getKmerSize(), sketch.getKmerSpace());
+
+        if ( identity < identityMin )
+        {
+            continue;
+        }
+
+        double pValue = pValueWithin(shared[i], setSize, sketch.getKmerSpace(), reference.hashesSorted.size(), database.pValueTable, pValueMax);
+
+        if ( pValue > pValueMax )
+        {
+            continue;
+        }
+
+        sort(depths[i].begin(), depths[i].end());
+
+        output << identity << '\t' << shared[i] << '/' << (uint64_t)reference.hashesSorted.size() << '\t' << (shared[i] > 0 ? depths[i].at(shared[i] / 2) : 0) << '\t' << pValue << '\t' << reference.name << '\t' << reference.comment << '\n';
+    }
+
+    outputToSet.append(output.data(), output.size());
+
+    return true;
+}
+
+} // namespace mash
@@ -0,0 +1,129 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#ifndef INCLUDED_CommandServe
+#define INCLUDED_CommandServe
+
+#include "Command.h"
+#include "CommandScreen.h"
+#include "PValueTable.h"
+#include "ServeProtocol.h"
+#include "Sketch.h"
+#include "ThreadPool.h"
+#include <pthread.h>
+
+namespace mash {
+
+class CommandServe : public Command
+{
+public:
+
+    // Work for the thread pool of the server, which runs a function of the
+    // commands. run() returns a task holding the output (the pool deletes the
+    // one it was given, with its input).
+    //
+    struct Task
+    {
+        virtual ~Task() {}
+        virtual Task * run() = 0;
+    };
+
+    template <class TypeInput, class TypeOutput>
+    struct TaskFunction : public Task
+    {
+        TaskFunction(TypeOutput * (* functionNew)(TypeInput *), TypeInput * inputNew)
+            :
+            function(functionNew),
+            input(inputNew),
+            output(0)
+            {}
+
+        ~TaskFunction()
+        {
+            delete input;
+            delete output;
+        }
+
+        Task * run()
+        {
+            TaskFunction * result = new TaskFunction(function, 0);
+            result->output = function(input);
+            return result;
+        }
+
+        TypeOutput * (* function)(TypeInput *);
+        TypeInput * input;
+        TypeOutput * output;
+    };
+
+    static Task * runTask(Task * task) {return task->run();}
+
+    // Everything built once from the reference sketch and shared by all
+    // connections: read-only, except for the thread pool, which serves one
+    // request at a time (see PoolRequest in CommandServe.cpp).
+    //
+    struct Database
+    {
+        Database(const Sketch & sketchNew, int threadsNew)
+            :
+            sketch(sketchNew),
+            pValueTable(sketchNew.getScale() ? 0 : sketchNew.getMinHashesPerWindow()), // (none for scaled sketches, whose sizes vary)
+            threads(threadsNew),
+            threadPool(runTask, threadsNew)
+            {
+                pthread_mutex_init(&mutexPool, NULL);
+            }
+
+        ~Database()
+        {
+            pthread_mutex_destroy(&mutexPool);
+        }
+
+        const Sketch & sketch;
+        PValueTable pValueTable;
+        int threads;
+
+        ThreadPool<Task, Task> threadPool;
+        pthread_mutex_t mutexPool;
+
+        // Inverted index for screen (CSR): sorted distinct hashes of all
+        // references, the offset of each hash's references (plus an end
+        // offset) and the reference indices. It stands in for the hash table
+        // of CommandScreen::run().
+        //
+        std::vector<uint64_t> indexHashes;
+        std::vector<uint64_t> indexOffsets;
+        std::vector<uint32_t> indexReferences;
+    };
+
+    struct Connection
+    {
+        Connection(Database & databaseNew, int fdNew)
+            :
+            database(databaseNew),
+            fd(fdNew)
+            {}
+
+        Database & database;
+        int fd;
+    };
+
+    CommandServe();
+
+    int run() const; // override
+};
+
+void createScreenIndex(CommandServe::Database & database);
+void getDatabaseParameters(const Sketch & sketch, Sketch::Parameters & parametersToSet);
+void hashMixture(CommandServe::Database & database, std::vector<std::string> & inputs, robin_hood::unordered_map<uint64_t, std::atomic<uint32_t> > & hashCounts, robin_hood::unordered_set<MinHashHeap *> & minHashHeaps, const Sketch::Parameters & parameters, bool trans); // (clears inputs)
+void * serveConnection(void * arg);
+bool serveContain(ServeMessage & request, CommandServe::Database & database, std::string & outputToSet);
+bool serveDistance(ServeMessage & request, CommandServe::Database & database, std::string & outputToSet);
+bool serveScreen(ServeMessage & request, int fd, CommandServe::Database & database, std::string & outputToSet); // (reads the mixture from fd; false with a message, if any, in outputToSet)
+
+} // namespace mash
+
+#endif
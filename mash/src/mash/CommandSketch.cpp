@@ -6,8 +6,11 @@
 
 #include "CommandSketch.h"
 #include "Sketch.h"
+#include "SketchDatabase.h"
 #include "sketchParameterSetup.h"
 #include <iostream>
+#include <sstream>
+#include <stdlib.h>
 
 using std::cerr;
 using std::endl;
@@ -26,12 +29,17 @@ CommandSketch::CommandSketch()
     
     useOption("help");
     addOption("list", Option(Option::Boolean, "l", "Input", "List input. Lines in each <input> specify paths to sequence files, one per line.", ""));
-    addOption("prefix", Option(Option::File, "o", "Output", "Output prefix (first input file used if unspecified). The suffix '.msh' will be appended.", ""));
+    addOption("packed", Option(Option::Boolean, "-pack", "Output", "Store hashes delta-encoded and bit-packed, which makes sketch files smaller (typically 2-3x for 32-bit hashes and 1.4x for 64-bit). Such files can only be read by versions of Mash that support them.", ""));
+    addOption("prefix", Option(Option::File, "o", "Output", "Output prefix (first input file used if unspecified). The suffix '.msh' will be appended. If the prefix ends with '" + string(suffixSketchDatabase) + "', the sketches are instead added as a new segment of that sketch database, which is created if needed (see \"mash compact\").", ""));
     addOption("id", Option(Option::File, "I", "Sketch", "ID field for sketch of reads (instead of first sequence ID).", ""));
     addOption("comment", Option(Option::File, "C", "Sketch", "Comment for a sketch of reads (instead of first sequence comment).", ""));
     addOption("counts", Option(Option::Boolean, "M", "Sketch", "Store multiplicity of each k-mer in each sketch.", ""));
     addOption("fingerprint", Option(Option::Boolean, "fp", "Input", "Indicates that the input files are fingerprints instead of sequences.", "")); // Opzione Fingerprint!
+    addOption("fingerprintAcross", Option(Option::Boolean, "-fp-across", "Input", "With -fp and a k-finger size (-k), let k-fingers of split fingerprints (segments separated by '|') span the segments, rather than staying within each one. Without -k, each fingerprint line is a single k-finger.", ""));
+    addOption("fingerprintPacked", Option(Option::Boolean, "-fp-packed", "Input", "With -fp, hash k-fingers as packed integer keys (numbers below 128 take a byte) with a fast integer mixer, rather than MurmurHash3 of 8 bytes per number. Much faster for factor lengths; the sketches are only comparable with others made this way.", ""));
+    addOption("fingerprintKmers", Option(Option::String, "-fp-ks", "Input", "With -fp, sketch for each of these k-finger sizes (comma-separated, each at least 2; see -k) in one pass over the input. One sketch is written per size, with '.k<size>' added to the prefix (before '.msh' or '" + string(suffixSketchDatabase) + "').", ""));
     useSketchOptions();
+    useOption("scaled");
 }
 
 int CommandSketch::run() const
@@ -54,6 +62,40 @@ int CommandSketch::run() const
         return 1;
     }
 
+    // Dimensioni dei k-finger per lo sketch multiplo (--fp-ks)
+    vector<int> kmerSizes;
+    
+    if (options.at("fingerprintKmers").active)
+    {
+        if (!fingerprint || parameters.reads)
+        {
+            cerr << "ERROR: The option --fp-ks requires -fp (and cannot be used with reads)." << endl;
+            return 1;
+        }
+        
+        if (options.at("kmer").active)
+        {
+            cerr << "ERROR: The options --fp-ks and -k are incompatible." << endl;
+            return 1;
+        }
+        
+        std::istringstream fields(options.at("fingerprintKmers").argument);
+        string field;
+        
+        while (getline(fields, field, ','))
+        {
+            int kmerSize = atoi(field.c_str());
+            
+            if (kmerSize < 2 || kmerSize > 32)
+            {
+                cerr << "ERROR: Bad k-finger size \"" << field << "\" for --fp-ks (must be 2-32)." << endl;
+                return 1;
+            }
+            
+            kmerSizes.push_back(kmerSize);
+        }
+    }
+    
     vector<string> files;
     for (int i = 0; i < arguments.size(); i++)
     {
@@ -67,29 +109,44 @@ int CommandSketch::run() const
         }
     }
 
-    Sketch sketch;
+    // Uno sketch per dimensione dei k-finger, oppure uno solo
+    vector<Sketch> sketches(kmerSizes.size() ? kmerSizes.size() : 1);
 
     if (parameters.reads)
     {
-        sketch.initFromReads(files, parameters);
+        sketches[0].initFromReads(files, parameters);
+    }
+    else if (kmerSizes.size())
+    {
+        vector<Sketch *> sketchPointers;
+
+        for (int i = 0; i < sketches.size(); i++)
+        {
+            sketchPointers.push_back(&sketches[i]);
+        }
+
+        Sketch::initFromFingerprints(sketchPointers, files, parameters, kmerSizes);
     }
     else if (fingerprint)
     {
-        sketch.initFromFingerprints(files, parameters); // Nuova funzione per fingerprint
+        sketches[0].initFromFingerprints(files, parameters); // Nuova funzione per fingerprint
     }
     else
     {
-        sketch.initFromFiles(files, parameters, verbosity);
+        sketches[0].initFromFiles(files, parameters, verbosity);
     }
 
-    if (getOption("id").active)
+    for (int i = 0; i < sketches.size(); i++)
     {
-        sketch.setReferenceName(0, getOption("id").argument);
-    }
+        if (getOption("id").active)
+        {
+            sketches[i].setReferenceName(0, getOption("id").argument);
+        }
 
-    if (getOption("comment").active)
-    {
-        sketch.setReferenceComment(0, getOption("comment").argument);
+        if (getOption("comment").active)
+        {
+            sketches[i].setReferenceComment(0, getOption("comment").argument);
+        }
     }
 
     string prefix;
@@ -109,14 +166,43 @@ int CommandSketch::run() const
         }
     }
 
-    string suffix = parameters.windowed ? suffixSketchWindowed : suffixSketch;
-    if (!hasSuffix(prefix, suffix))
+    bool database = isSketchDatabase(prefix);
+    string suffix = database ? suffixSketchDatabase : parameters.windowed ? suffixSketchWindowed : suffixSketch;
+
+    if (database && parameters.windowed)
+    {
+        cerr << "ERROR: Windowed sketches cannot be added to a sketch database." << endl;
+        return 1;
+    }
+
+    if (hasSuffix(prefix, suffix))
     {
-        prefix += suffix;
+        prefix.resize(prefix.length() - suffix.length());
     }
 
-    cerr << "Writing to " << prefix << "..." << endl;
-    sketch.writeToCapnp(prefix.c_str());
+    for (int i = 0; i < sketches.size(); i++)
+    {
+        string file = prefix + (kmerSizes.size() ? ".k" + std::to_string(kmerSizes[i]) : "") + suffix;
+
+        if (database)
+        {
+            cerr << "Adding to " << file << "..." << endl;
+
+            if (appendToSketchDatabase(file, sketches[i], options.at("packed").active))
+            {
+                return 1;
+            }
+
+            continue;
+        }
+
+        cerr << "Writing to " << file << "..." << endl;
+
+        if (sketches[i].writeToCapnp(file.c_str(), options.at("packed").active))
+        {
+            return 1;
+        }
+    }
 
     return 0;
 }
@@ -1,18 +1,12 @@
 #include "CommandTriangle.h"
 #include "Sketch.h"
+#include "Stats.h"
 #include "sketchParameterSetup.h"
 #include <iostream>
 #include <zlib.h>
 #include "ThreadPool.h"
 #include <math.h>
 
-#ifdef USE_BOOST
-    #include <boost/math/distributions/binomial.hpp>
-    using namespace::boost::math;
-#else
-    #include <gsl/gsl_cdf.h>
-#endif
-
 using namespace::std;
 
 namespace mash {
@@ -31,7 +25,13 @@ CommandTriangle::CommandTriangle()
     addOption("edge", Option(Option::Boolean, "E", "Output", "Output edge list instead of Phylip matrix, with fields [seq1, seq2, dist, p-val, shared-hashes].", ""));
     addOption("pvalue", Option(Option::Number, "v", "Output", "Maximum p-value to report in edge list. Implies -" + getOption("edge").identifier + ".", "1.0", 0., 1.));
     addOption("distance", Option(Option::Number, "d", "Output", "Maximum distance to report in edge list. Implies -" + getOption("edge").identifier + ".", "1.0", 0., 1.));
-    addOption("fingerprint", Option(Option::Boolean, "fp", "Input", "Indicates that the input files are fingerprints instead of sequences.", "")); // Aggiunto
+    addOption("fingerprint", Option(Option::Boolean, "fp", "Input", "Indicates that the input files are fingerprints instead of sequences. Fingerprints are sketched as bottom-k sets of k-finger hashes, and the distance reported for them is the Jaccard distance.", "")); // Aggiunto
+    addOption("fingerprintAcross", Option(Option::Boolean, "-fp-across", "Input", "With -fp and a k-finger size (-k), let k-fingers of split fingerprints (segments separated by '|') span the segments, rather than staying within each one. Without -k, each fingerprint line is a single k-finger.", ""));
+    addOption("fingerprintPacked", Option(Option::Boolean, "-fp-packed", "Input", "With -fp, hash k-fingers as packed integer keys (numbers below 128 take a byte) with a fast integer mixer, rather than MurmurHash3 of 8 bytes per number. Much faster for factor lengths; the sketches are only comparable with others made this way.", ""));
+    addOption("weighted", Option(Option::Boolean, "-weighted", "Output", "Weight shared hashes by their counts, which the sketches must have (see sketch -M, or reads with -r). The distance is then one minus the weighted Jaccard (see dist --weighted).", ""));
+    addOption("binary", Option(Option::File, "B", "Output", "Write the lower-triangular matrix to a binary file at this path instead of text output (see \"mash matrix\"). Pairs that do not meet the thresholds are stored as blanks. The suffix '" + string(suffixMatrix) + "' is conventional.", ""));
+    addOption("half", Option(Option::Boolean, "Bh", "Output", "Store distances in the binary matrix as 16-bit floats (about 3 significant digits). Requires -B.", ""));
+    addOption("shared", Option(Option::Boolean, "Bn", "Output", "Store shared-hash counts in the binary matrix. Requires -B.", ""));
     useSketchOptions();
 }
 
@@ -50,8 +50,16 @@ int CommandTriangle::run() const
     bool fingerprint = options.at("fingerprint").active; // Aggiunto
     double pValueMax = options.at("pvalue").getArgumentAsNumber();
     double distanceMax = options.at("distance").getArgumentAsNumber();
+    bool binary = options.at("binary").active;
+    bool weighted = options.at("weighted").active;
     double pValuePeakToSet = 0;
 
+    if (!binary && (options.at("half").active || options.at("shared").active))
+    {
+        cerr << "ERROR: The options -" << options.at("half").identifier << " and -" << options.at("shared").identifier << " require -" << options.at("binary").identifier << "." << endl;
+        return 1;
+    }
+
     if (options.at("pvalue").active || options.at("distance").active)
     {
         edge = true;
@@ -142,26 +150,55 @@ int CommandTriangle::run() const
             warningCount++;
         }
     }
-    if (!edge)
+
+    // (before any output, so an error leaves no partial matrix or header)
+    if (weighted && !sketch.hasHashCounts())
+    {
+        cerr << "ERROR: The option -" << options.at("weighted").identifier << " requires sketches with hash counts (see sketch -M)." << endl;
+        return 1;
+    }
+
+    DistanceMatrixWriter matrixWriter;
+
+    if (binary)
+    {
+        vector<string> names;
+
+        for (uint64_t i = 0; i < sketch.getReferenceCount(); i++)
+        {
+            names.push_back(comment ? sketch.getReference(i).comment : sketch.getReference(i).name);
+        }
+
+        matrixWriter.open(options.at("binary").argument, DistanceMatrix::Triangle, names, names, options.at("half").active, options.at("shared").active);
+    }
+    else if (!edge)
     {
         cout << '\t' << sketch.getReferenceCount() << endl;
         cout << (comment ? sketch.getReference(0).comment : sketch.getReference(0).name) << endl;
     }
 
+    PValueTable pValueTable(sketch.getScale() ? 0 : sketch.getMinHashesPerWindow()); // (scaled: no fixed size)
     ThreadPool<TriangleInput, TriangleOutput> threadPool(compare, threads);
 
+    StatsPhase phase(Stats::Compare);
+
     for (uint64_t i = 1; i < sketch.getReferenceCount(); i++)
     {
-        threadPool.runWhenThreadAvailable(new TriangleInput(sketch, i, parameters, distanceMax, pValueMax, fingerprint)); // Passaggio del parametro fingerprint
+        threadPool.runWhenThreadAvailable(new TriangleInput(sketch, i, parameters, distanceMax, pValueMax, fingerprint, comment, edge, binary, pValueTable, weighted)); // Passaggio del parametro fingerprint
         while (threadPool.outputAvailable())
         {
-            writeOutput(threadPool.popOutputWhenAvailable(), comment, edge, pValuePeakToSet);
+            writeOutput(threadPool.popOutputWhenAvailable(), matrixWriter, pValuePeakToSet);
         }
     }
 
     while (threadPool.running())
     {
-        writeOutput(threadPool.popOutputWhenAvailable(), comment, edge, pValuePeakToSet);
+        writeOutput(threadPool.popOutputWhenAvailable(), matrixWriter, pValuePeakToSet);
+    }
+
+    if (binary)
+    {
+        matrixWriter.close();
     }
 
     if (!edge)
@@ -203,42 +240,34 @@ bool containsExtensionTXT(const std::vector<std::string>& strVec){
 
 
 
-void CommandTriangle::writeOutput(TriangleOutput * output, bool comment, bool edge, double & pValuePeakToSet) const
+void CommandTriangle::writeOutput(TriangleOutput * output, DistanceMatrixWriter & matrixWriter, double & pValuePeakToSet) const
 {
-    const Sketch & sketch = output->sketch;
-    const Sketch::Reference & ref = sketch.getReference(output->index);
-    
-    if (!edge)
-    {
-        cout << (comment ? ref.comment : ref.name);
-    }
-    
-    for (uint64_t i = 0; i < output->index; i++)
+    StatsPhase phase(Stats::Output);
+
+    if (matrixWriter.isOpen())
     {
-        const CommandDistance::CompareOutput::PairOutput * pair = &output->pairs[i];
-        
-        if (edge)
+        for (uint64_t i = 0; i < output->index; i++)
         {
-            if (pair->pass)
+            const CommandDistance::CompareOutput::PairOutput & pair = output->pairs[i];
+
+            if (pair.pass)
             {
-                const Sketch::Reference & qry = sketch.getReference(i);
-                cout << (comment ? ref.comment : ref.name) << '\t' << (comment ? qry.comment : qry.name) << '\t' << pair->distance << '\t' << pair->pValue << '\t' << pair->numer << '/' << pair->denom << endl;
+                matrixWriter.append(pair.distance, pair.numer, pair.denom);
+            }
+            else
+            {
+                matrixWriter.append(NAN, 0, 0);
             }
         }
-        else
-        {
-            cout << '\t' << pair->distance;
-        }
-        
-        if (pair->pValue > pValuePeakToSet)
-        {
-            pValuePeakToSet = pair->pValue;
-        }
+    }
+    else
+    {
+        output->buffer.write(stdout);
     }
     
-    if (!edge)
+    if (output->pValuePeak > pValuePeakToSet)
     {
-        cout << endl;
+        pValuePeakToSet = output->pValuePeak;
     }
     
     delete output;
@@ -252,53 +281,57 @@ CommandTriangle::TriangleOutput * compare(CommandTriangle::TriangleInput * input
 
     for (uint64_t i = 0; i < input->index; i++)
     {
-        if (input->isFingerprint) {
-            compareFingerprints(&output->pairs[i], sketch.getReference(input->index), sketch.getReference(i), sketchSize, input->maxDistance, input->maxPValue); // Nuovo confronto fingerprint
-        } else {
-            compareSketches(&output->pairs[i], sketch.getReference(input->index), sketch.getReference(i), sketchSize, sketch.getKmerSize(), sketch.getKmerSpace(), input->maxDistance, input->maxPValue);
+        compareSketches(&output->pairs[i], sketch.getReference(input->index), sketch.getReference(i), sketchSize, sketch.getKmerSize(), sketch.getKmerSpace(), input->maxDistance, input->maxPValue, input->pValueTable, input->isFingerprint, input->weighted);
+
+        if (output->pairs[i].pass && output->pairs[i].pValue > output->pValuePeak)
+        {
+            output->pValuePeak = output->pairs[i].pValue;
         }
     }
 
+    Stats::add(Stats::PairsCompared, input->index);
+
+    if (!input->binary)
+    {
+        formatOutput(output, input->comment, input->edge);
+    }
+
     return output;
 }
 
-void compareFingerprints(CommandDistance::CompareOutput::PairOutput * pair, const Sketch::Reference & ref1, const Sketch::Reference & ref2, uint64_t sketchSize, double maxDistance, double maxPValue)
+void formatOutput(CommandTriangle::TriangleOutput * output, bool comment, bool edge)
 {
-    int matches = 0;
-
-    int size1 = ref1.hashesSorted.size();
-    int size2 = ref2.hashesSorted.size();
-    int minSize = std::min(size1, size2);
-
-    for (int i = 0; i < minSize; i++)
+    OutputBuffer & buffer = output->buffer;
+    const Sketch & sketch = output->sketch;
+    const Sketch::Reference & ref = sketch.getReference(output->index);
+    
+    if (!edge)
     {
-        hash_u hash1 = ref1.hashesSorted.at(i);
-        hash_u hash2 = ref2.hashesSorted.at(i);
-
-        // Determiniamo se stiamo usando hash a 64-bit o a 32-bit basandoci sulla dimensione del valore restituito
-        if (hash1.hash64 != 0 || hash2.hash64 != 0) // Supponiamo che se `hash64` è diverso da 0, stiamo usando `hashes64`
+        buffer << (comment ? ref.comment : ref.name);
+    }
+    
+    for (uint64_t i = 0; i < output->index; i++)
+    {
+        const CommandDistance::CompareOutput::PairOutput * pair = &output->pairs[i];
+        
+        if (edge)
         {
-            if (hash1.hash64 == hash2.hash64)
+            if (pair->pass)
             {
-                matches++;
+                const Sketch::Reference & qry = sketch.getReference(i);
+                buffer << (comment ? ref.comment : ref.name) << '\t' << (comment ? qry.comment : qry.name) << '\t' << pair->distance << '\t' << pair->pValue << '\t' << pair->numer << '/' << pair->denom << '\n';
             }
         }
-        else // Altrimenti stiamo usando `hashes32`
+        else
         {
-            if (hash1.hash32 == hash2.hash32)
-            {
-                matches++;
-            }
+            buffer << '\t' << pair->distance;
         }
     }
-
-    // Calcola la distanza come 1 - proporzione di hash corrispondenti
-    pair->distance = 1.0 - (double(matches) / minSize);
-    pair->pValue = gsl_cdf_chisq_Q(matches, 1); // Esempio di calcolo p-value
-
-    pair->pass = (pair->distance <= maxDistance && pair->pValue <= maxPValue);
-    pair->numer = matches;
-    pair->denom = minSize;
+    
+    if (!edge)
+    {
+        buffer << '\n';
+    }
 }
 
 } // namespace mash
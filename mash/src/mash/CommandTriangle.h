@@ -13,14 +13,19 @@ public:
     
     struct TriangleInput
     {
-        TriangleInput(const Sketch & sketchNew, uint64_t indexNew, const Sketch::Parameters & parametersNew, double maxDistanceNew, double maxPValueNew, bool isFingerprintNew)
+        TriangleInput(const Sketch & sketchNew, uint64_t indexNew, const Sketch::Parameters & parametersNew, double maxDistanceNew, double maxPValueNew, bool isFingerprintNew, bool commentNew, bool edgeNew, bool binaryNew, const PValueTable & pValueTableNew, bool weightedNew = false)
             :
             sketch(sketchNew),
             index(indexNew),
             parameters(parametersNew),
             maxDistance(maxDistanceNew),
             maxPValue(maxPValueNew),
-            isFingerprint(isFingerprintNew)
+            isFingerprint(isFingerprintNew),
+            comment(commentNew),
+            edge(edgeNew),
+            binary(binaryNew),
+            pValueTable(pValueTableNew),
+            weighted(weightedNew)
             {}
         
         const Sketch & sketch;
@@ -29,6 +34,11 @@ public:
         double maxDistance;
         double maxPValue;
         bool isFingerprint;
+        bool comment;
+        bool edge;
+        bool binary; // leave formatting to the matrix writer
+        const PValueTable & pValueTable;
+        bool weighted; // use the hash counts (see compareSketches())
     };
     
     struct TriangleOutput
@@ -36,7 +46,8 @@ public:
         TriangleOutput(const Sketch & sketchNew, uint64_t indexNew)
             :
             sketch(sketchNew),
-            index(indexNew)
+            index(indexNew),
+            pValuePeak(0)
         {
             pairs = new CommandDistance::CompareOutput::PairOutput[index];
         }
@@ -50,6 +61,9 @@ public:
         uint64_t index;
         
         CommandDistance::CompareOutput::PairOutput * pairs;
+        
+        OutputBuffer buffer; // formatted row or edges, filled by the worker thread
+        double pValuePeak;
     };
     
     CommandTriangle();
@@ -62,12 +76,12 @@ private:
     
     double pValueMax;
     bool comment;
-    void writeOutput(TriangleOutput * output, bool comment, bool edge, double & pValuePeakToSet) const;
+    void writeOutput(TriangleOutput * output, DistanceMatrixWriter & matrixWriter, double & pValuePeakToSet) const;
 
 };
 
     CommandTriangle::TriangleOutput * compare(CommandTriangle::TriangleInput * input);
-    void compareFingerprints(CommandDistance::CompareOutput::PairOutput * pair, const Sketch::Reference & ref1, const Sketch::Reference & ref2, uint64_t sketchSize, double maxDistance, double maxPValue);
+    void formatOutput(CommandTriangle::TriangleOutput * output, bool comment, bool edge);
     bool containsExtensionMSH(const std::vector<std::string>& strVec) ;
     bool containsExtensionTXT(const std::vector<std::string>& strVec) ;
 } // namespace mash
@@ -0,0 +1,27 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#include "CountMinSketch.h"
+
+CountMinSketch::CountMinSketch(uint64_t bytes)
+{
+	// largest power-of-2 width that fits, with at least one counter per row
+
+	uint64_t width = 1;
+
+	while ( width * 2 * countMinDepth * sizeof(uint16_t) <= bytes )
+	{
+		width *= 2;
+	}
+
+	mask = width - 1;
+	counters.resize(width * countMinDepth);
+}
+
+void CountMinSketch::clear()
+{
+	counters.assign(counters.size(), 0);
+}
@@ -0,0 +1,86 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#ifndef CountMinSketch_h
+#define CountMinSketch_h
+
+#include <inttypes.h>
+#include <vector>
+
+// Approximate counts of hashes in a fixed amount of memory: countMinDepth
+// rows of 16-bit saturating counters, each row indexed by a different
+// function of the (remixed) hash, stored contiguously. Adding uses
+// conservative update (only the counters at the current minimum are raised),
+// which keeps overcounting from collisions low. Counts are never
+// underestimated, so a k-mer reaching a minimum count is never missed, but an
+// unlucky one may reach it early: with n distinct k-mers counted in rows of
+// width w, a k-mer seen once passes a minimum of 2 only if all four of its
+// counters were hit, roughly (n / w)^4 (about 1e-4 at n = w / 10). That
+// drift from exact counting is the only difference.
+//
+static const int countMinDepth = 4;
+static const uint64_t countMinBytesDefault = 1ull << 26; // (also the most sized from a genome)
+static const uint64_t countMinGenomeFactor = 8; // (counters per row for each base of genome)
+
+class CountMinSketch
+{
+public:
+
+	CountMinSketch(uint64_t bytes = countMinBytesDefault);
+
+	uint32_t add(uint64_t hash); // returns the new count
+	void clear();
+
+private:
+
+	uint64_t mask; // (width is a power of 2)
+	std::vector<uint16_t> counters; // countMinDepth rows
+};
+
+inline uint32_t CountMinSketch::add(uint64_t hash)
+{
+	// MurmurHash3's 64-bit finalizer, then double hashing for the rows
+
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ull;
+	hash ^= hash >> 33;
+
+	uint64_t step = (hash >> 32) | 1;
+	uint64_t width = mask + 1;
+	uint64_t indices[countMinDepth];
+	uint16_t count = UINT16_MAX;
+
+	for ( int i = 0; i < countMinDepth; i++ )
+	{
+		indices[i] = i * width + ((hash + i * step) & mask);
+
+		if ( counters[indices[i]] < count )
+		{
+			count = counters[indices[i]];
+		}
+	}
+
+	if ( count == UINT16_MAX )
+	{
+		return count;
+	}
+
+	count++;
+
+	for ( int i = 0; i < countMinDepth; i++ )
+	{
+		if ( counters[indices[i]] < count )
+		{
+			counters[indices[i]] = count;
+		}
+	}
+
+	return count;
+}
+
+#endif
@@ -0,0 +1,518 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#include "DistanceMatrix.h"
+#include <fcntl.h>
+#include <iostream>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace::std;
+
+namespace mash {
+
+static const char matrixMagic[8] = {'M', 'A', 'S', 'H', 'M', 'T', 'R', 'X'};
+static const uint32_t matrixVersion = 2; // (2: 64-bit shared counts)
+static const uint64_t matrixBlockCells = 1 << 16;
+
+uint64_t alignMatrixOffset(uint64_t offset)
+{
+	return (offset + 7) & ~uint64_t(7);
+}
+
+void writeMatrixAt(int fd, const string & file, const void * data, uint64_t length, uint64_t offset)
+{
+	const char * bytes = (const char *)data;
+
+	while ( length > 0 )
+	{
+		ssize_t written = pwrite(fd, bytes, length, offset);
+
+		if ( written <= 0 )
+		{
+			cerr << "ERROR: could not write to " << file << "." << endl;
+			exit(1);
+		}
+
+		bytes += written;
+		length -= written;
+		offset += written;
+	}
+}
+
+DistanceMatrix::DistanceMatrix()
+{
+	data = 0;
+	size = 0;
+	header = 0;
+}
+
+DistanceMatrix::~DistanceMatrix()
+{
+	if ( data != 0 )
+	{
+		munmap((void *)data, size);
+	}
+}
+
+uint64_t DistanceMatrix::getCellIndex(uint64_t row, uint64_t column) const
+{
+	if ( header->layout == Triangle )
+	{
+		return row * (row - 1) / 2 + column;
+	}
+
+	return row * header->columnCount + column;
+}
+
+string DistanceMatrix::getColumnName(uint64_t column) const
+{
+	return getName(column);
+}
+
+float DistanceMatrix::getDistance(uint64_t row, uint64_t column) const
+{
+	uint64_t index = getCellIndex(row, column);
+
+	if ( header->precision == 16 )
+	{
+		return halfToFloat(((const uint16_t *)(data + header->distancesOffset))[index]);
+	}
+
+	return ((const float *)(data + header->distancesOffset))[index];
+}
+
+string DistanceMatrix::getName(uint64_t index) const
+{
+	return string(names + nameOffsets[index], nameOffsets[index + 1] - nameOffsets[index]);
+}
+
+string DistanceMatrix::getRowName(uint64_t row) const
+{
+	return getName(header->layout == Triangle ? row : header->columnCount + row);
+}
+
+void DistanceMatrix::getShared(uint64_t row, uint64_t column, uint64_t & numeratorToSet, uint64_t & denominatorToSet) const
+{
+	const uint64_t * shared = (const uint64_t *)(data + header->sharedOffset) + 2 * getCellIndex(row, column);
+
+	numeratorToSet = shared[0];
+	denominatorToSet = shared[1];
+}
+
+int DistanceMatrix::load(const string & file)
+{
+	int fd = open(file.c_str(), O_RDONLY);
+
+	if ( fd < 0 )
+	{
+		cerr << "ERROR: could not open \"" << file << "\" for reading." << endl;
+		return 1;
+	}
+
+	struct stat fileInfo;
+
+	if ( fstat(fd, &fileInfo) == -1 )
+	{
+		cerr << "ERROR: could not get file stats for \"" << file << "\"." << endl;
+		::close(fd);
+		return 1;
+	}
+
+	size = fileInfo.st_size;
+
+	if ( size < sizeof(DistanceMatrixHeader) )
+	{
+		cerr << "ERROR: \"" << file << "\" is not a Mash distance matrix." << endl;
+		::close(fd);
+		return 1;
+	}
+
+	void * mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if ( mapped == MAP_FAILED )
+	{
+		cerr << "ERROR: could not memory-map file \"" << file << "\"." << endl;
+		return 1;
+	}
+
+	data = (const char *)mapped;
+	header = (const DistanceMatrixHeader *)data;
+
+	if ( memcmp(header->magic, matrixMagic, sizeof(matrixMagic)) != 0 )
+	{
+		cerr << "ERROR: \"" << file << "\" is not a Mash distance matrix." << endl;
+		return 1;
+	}
+
+	if ( header->version != matrixVersion )
+	{
+		cerr << "ERROR: \"" << file << "\" has an unsupported matrix version (" << header->version << ")." << endl;
+		return 1;
+	}
+
+	if ( ! checkLayout() )
+	{
+		cerr << "ERROR: \"" << file << "\" is truncated or corrupt." << endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+bool DistanceMatrix::checkLayout()
+{
+	// Every section must be aligned and lie within the file, and the counts
+	// must agree, before anything is indexed. Sizes are compared by division,
+	// so no product can overflow.
+
+	if
+	(
+		header->fileSize > size ||
+		( header->precision != 16 && header->precision != 32 ) ||
+		( header->layout != Triangle && header->layout != Rectangle ) ||
+		header->shared > 1
+	)
+	{
+		return false;
+	}
+
+	uint64_t rowCount = header->rowCount;
+	uint64_t columnCount = header->columnCount;
+
+	if ( header->layout == Triangle ? columnCount != rowCount || header->nameCount != rowCount : header->nameCount - rowCount != columnCount || header->nameCount < rowCount )
+	{
+		return false;
+	}
+
+	if
+	(
+		header->namesOffset % sizeof(uint64_t) != 0 ||
+		header->namesOffset > size ||
+		header->nameCount >= ( size - header->namesOffset ) / sizeof(uint64_t)
+	)
+	{
+		return false;
+	}
+
+	uint64_t rowLength = header->layout == Triangle ? rowCount - 1 : columnCount;
+
+	if ( rowCount != 0 && rowLength > UINT64_MAX / rowCount )
+	{
+		return false;
+	}
+
+	if ( header->cellCount != ( header->layout == Triangle ? ( rowCount > 0 ? rowCount * (rowCount - 1) / 2 : 0 ) : rowCount * columnCount ) )
+	{
+		return false;
+	}
+
+	if
+	(
+		header->distancesOffset % sizeof(uint64_t) != 0 ||
+		header->distancesOffset > size ||
+		header->cellCount > ( size - header->distancesOffset ) / ( header->precision / 8 )
+	)
+	{
+		return false;
+	}
+
+	if
+	(
+		header->shared &&
+		(
+			header->sharedOffset % sizeof(uint64_t) != 0 ||
+			header->sharedOffset > size ||
+			header->cellCount > ( size - header->sharedOffset ) / ( 2 * sizeof(uint64_t) )
+		)
+	)
+	{
+		return false;
+	}
+
+	nameOffsets = (const uint64_t *)(data + header->namesOffset);
+	names = (const char *)(nameOffsets + header->nameCount + 1);
+
+	uint64_t namesSize = size - ( names - data );
+
+	if ( nameOffsets[0] != 0 )
+	{
+		return false;
+	}
+
+	for ( uint64_t i = 0; i < header->nameCount; i++ )
+	{
+		if ( nameOffsets[i + 1] < nameOffsets[i] || nameOffsets[i + 1] > namesSize )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+DistanceMatrixWriter::DistanceMatrixWriter()
+{
+	fd = -1;
+}
+
+DistanceMatrixWriter::~DistanceMatrixWriter()
+{
+	if ( fd >= 0 )
+	{
+		close();
+	}
+}
+
+void DistanceMatrixWriter::append(double distance, uint64_t numerator, uint64_t denominator)
+{
+	if ( header.precision == 16 )
+	{
+		uint16_t value = floatToHalf(distance);
+		distances.insert(distances.end(), (const char *)&value, (const char *)&value + sizeof(value));
+	}
+	else
+	{
+		float value = distance;
+		distances.insert(distances.end(), (const char *)&value, (const char *)&value + sizeof(value));
+	}
+
+	if ( header.shared )
+	{
+		shared.push_back(numerator);
+		shared.push_back(denominator);
+	}
+
+	if ( distances.size() >= matrixBlockCells * header.precision / 8 )
+	{
+		flush();
+	}
+}
+
+void DistanceMatrixWriter::close()
+{
+	flush();
+
+	if ( cellsWritten != header.cellCount )
+	{
+		cerr << "WARNING: " << file << " is incomplete (" << cellsWritten << " of " << header.cellCount << " distances written)." << endl;
+	}
+
+	::close(fd);
+	fd = -1;
+}
+
+void DistanceMatrixWriter::flush()
+{
+	uint64_t bytes = header.precision / 8;
+	uint64_t cells = distances.size() / bytes;
+
+	if ( cells == 0 )
+	{
+		return;
+	}
+
+	if ( cellsWritten + cells > header.cellCount )
+	{
+		cerr << "ERROR: too many distances for matrix " << file << "." << endl;
+		exit(1);
+	}
+
+	writeMatrixAt(fd, file, distances.data(), distances.size(), header.distancesOffset + cellsWritten * bytes);
+
+	if ( header.shared )
+	{
+		writeMatrixAt(fd, file, shared.data(), shared.size() * sizeof(uint64_t), header.sharedOffset + cellsWritten * 2 * sizeof(uint64_t));
+	}
+
+	cellsWritten += cells;
+	distances.clear();
+	shared.clear();
+}
+
+void DistanceMatrixWriter::open(const string & fileNew, DistanceMatrix::Layout layout, const vector<string> & rowNames, const vector<string> & columnNames, bool half, bool sharedNew)
+{
+	file = fileNew;
+	fd = ::open(file.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+
+	if ( fd < 0 )
+	{
+		cerr << "ERROR: could not open " << file << " for writing." << endl;
+		exit(1);
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, matrixMagic, sizeof(matrixMagic));
+
+	header.version = matrixVersion;
+	header.layout = layout;
+	header.precision = half ? 16 : 32;
+	header.shared = sharedNew;
+	header.rowCount = rowNames.size();
+	header.columnCount = columnNames.size();
+
+	// name index
+
+	vector<uint64_t> nameOffsets(1, 0);
+	string nameCharacters;
+
+	for ( int pass = 0; pass < 2; pass++ )
+	{
+		if ( pass == 1 && layout == DistanceMatrix::Triangle )
+		{
+			break; // rows and columns share names
+		}
+
+		const vector<string> & namesPass = pass == 0 ? columnNames : rowNames;
+
+		for ( uint64_t i = 0; i < namesPass.size(); i++ )
+		{
+			nameCharacters.append(namesPass[i]);
+			nameOffsets.push_back(nameCharacters.size());
+		}
+	}
+
+	header.nameCount = nameOffsets.size() - 1;
+	header.namesOffset = sizeof(DistanceMatrixHeader);
+
+	if ( layout == DistanceMatrix::Triangle )
+	{
+		header.cellCount = header.rowCount > 0 ? header.rowCount * (header.rowCount - 1) / 2 : 0;
+	}
+	else
+	{
+		header.cellCount = header.rowCount * header.columnCount;
+	}
+
+	header.distancesOffset = alignMatrixOffset(header.namesOffset + nameOffsets.size() * sizeof(uint64_t) + nameCharacters.size());
+	header.fileSize = alignMatrixOffset(header.distancesOffset + header.cellCount * header.precision / 8);
+
+	if ( header.shared )
+	{
+		header.sharedOffset = header.fileSize;
+		header.fileSize += header.cellCount * 2 * sizeof(uint64_t);
+	}
+
+	if ( ftruncate(fd, header.fileSize) != 0 )
+	{
+		cerr << "ERROR: could not allocate " << header.fileSize << " bytes for " << file << "." << endl;
+		exit(1);
+	}
+
+	writeMatrixAt(fd, file, &header, sizeof(header), 0);
+	writeMatrixAt(fd, file, nameOffsets.data(), nameOffsets.size() * sizeof(uint64_t), header.namesOffset);
+	writeMatrixAt(fd, file, nameCharacters.data(), nameCharacters.size(), header.namesOffset + nameOffsets.size() * sizeof(uint64_t));
+
+	cellsWritten = 0;
+	distances.reserve(matrixBlockCells * header.precision / 8);
+
+	if ( header.shared )
+	{
+		shared.reserve(2 * matrixBlockCells);
+	}
+}
+
+uint16_t floatToHalf(float value)
+{
+	// IEEE 754 binary16, rounding to nearest even
+
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int32_t exponent = int32_t((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	if ( ((bits >> 23) & 0xff) == 0xff )
+	{
+		return sign | 0x7c00 | (mantissa ? 0x200 : 0); // inf or nan
+	}
+
+	if ( exponent >= 31 )
+	{
+		return sign | 0x7c00;
+	}
+
+	uint32_t shift = 13;
+	uint32_t half;
+
+	if ( exponent <= 0 )
+	{
+		// subnormal
+
+		if ( exponent < -10 )
+		{
+			return sign;
+		}
+
+		mantissa |= 0x800000;
+		shift = 14 - exponent;
+		half = mantissa >> shift;
+	}
+	else
+	{
+		half = (exponent << 10) | (mantissa >> shift);
+	}
+
+	uint32_t remainder = mantissa & ((1 << shift) - 1);
+	uint32_t halfway = 1 << (shift - 1);
+
+	if ( remainder > halfway || ( remainder == halfway && ( half & 1 ) ) )
+	{
+		half++; // (a carry into the exponent is still correct)
+	}
+
+	return sign | half;
+}
+
+float halfToFloat(uint16_t value)
+{
+	uint32_t sign = uint32_t(value & 0x8000) << 16;
+	int32_t exponent = (value >> 10) & 0x1f;
+	uint32_t mantissa = value & 0x3ff;
+	uint32_t bits;
+
+	if ( exponent == 0 )
+	{
+		if ( mantissa == 0 )
+		{
+			bits = sign;
+		}
+		else
+		{
+			// subnormal; normalize
+
+			exponent = 1;
+
+			while ( ! ( mantissa & 0x400 ) )
+			{
+				mantissa <<= 1;
+				exponent--;
+			}
+
+			bits = sign | ((exponent + 127 - 15) << 23) | ((mantissa & 0x3ff) << 13);
+		}
+	}
+	else if ( exponent == 31 )
+	{
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else
+	{
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	}
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+} // namespace mash
@@ -0,0 +1,126 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#ifndef INCLUDED_DistanceMatrix
+#define INCLUDED_DistanceMatrix
+
+#include <inttypes.h>
+#include <string>
+#include <vector>
+
+namespace mash {
+
+static const char * suffixMatrix = ".mdm";
+
+// Binary distance matrix written by "mash triangle -B" and "mash dist -B" and
+// read back by "mash matrix". All fields are native-endian and every section
+// starts on an 8-byte boundary, so the file can be memory-mapped and indexed
+// directly:
+//
+//   header      DistanceMatrixHeader
+//   names       (nameCount + 1) uint64 offsets into the characters that follow
+//               (names are not terminated); for Triangle the row and column
+//               names are the same N names, for Rectangle the column
+//               (reference) names come first, then the row (query) names
+//   distances   float32 or float16 per cell, row by row; NaN marks a pair that
+//               did not pass the distance or p-value thresholds
+//   shared      optional (numerator, denominator) uint64 pair per cell
+//
+// Triangle is the strict lower triangle of an N x N matrix, so row i has i
+// cells and cell (i, j) is at i * (i - 1) / 2 + j. Rectangle has rowCount x
+// columnCount cells, with cell (i, j) at i * columnCount + j.
+//
+struct DistanceMatrixHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t layout;
+	uint32_t precision; // bits per distance (32 or 16)
+	uint32_t shared; // whether the shared-hash section is present
+	uint64_t rowCount;
+	uint64_t columnCount;
+	uint64_t nameCount;
+	uint64_t namesOffset;
+	uint64_t distancesOffset;
+	uint64_t sharedOffset;
+	uint64_t cellCount;
+	uint64_t fileSize;
+};
+
+class DistanceMatrix
+{
+public:
+
+	enum Layout
+	{
+		Triangle,
+		Rectangle
+	};
+
+	DistanceMatrix();
+	~DistanceMatrix();
+
+	uint64_t getCellCount() const {return header->cellCount;}
+	uint64_t getCellIndex(uint64_t row, uint64_t column) const;
+	uint64_t getColumnCount() const {return header->columnCount;}
+	std::string getColumnName(uint64_t column) const;
+	float getDistance(uint64_t row, uint64_t column) const;
+	Layout getLayout() const {return Layout(header->layout);}
+	int getPrecision() const {return header->precision;}
+	uint64_t getRowCount() const {return header->rowCount;}
+	uint64_t getRowLength(uint64_t row) const {return header->layout == Triangle ? row : header->columnCount;}
+	std::string getRowName(uint64_t row) const;
+	void getShared(uint64_t row, uint64_t column, uint64_t & numeratorToSet, uint64_t & denominatorToSet) const;
+	bool hasShared() const {return header->shared;}
+	int load(const std::string & file); // (checks the layout against the file size)
+
+private:
+
+	bool checkLayout();
+	std::string getName(uint64_t index) const;
+
+	const char * data;
+	uint64_t size;
+	const DistanceMatrixHeader * header;
+	const uint64_t * nameOffsets;
+	const char * names;
+};
+
+// Streams cells to a binary matrix in row order, as they come out of the
+// ordered thread pool. Cells are converted and buffered in blocks and each
+// section is written at its own offset, so nothing proportional to the
+// matrix is held in memory.
+//
+class DistanceMatrixWriter
+{
+public:
+
+	DistanceMatrixWriter();
+	~DistanceMatrixWriter();
+
+	void append(double distance, uint64_t numerator, uint64_t denominator);
+	void close();
+	bool isOpen() const {return fd >= 0;}
+	void open(const std::string & file, DistanceMatrix::Layout layout, const std::vector<std::string> & rowNames, const std::vector<std::string> & columnNames, bool half, bool shared);
+
+private:
+
+	void flush();
+
+	int fd;
+	DistanceMatrixHeader header;
+	std::string file;
+	uint64_t cellsWritten;
+	std::vector<char> distances;
+	std::vector<uint64_t> shared;
+};
+
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t value);
+
+} // namespace mash
+
+#endif
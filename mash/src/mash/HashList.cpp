@@ -1,4 +1,5 @@
 #include "HashList.h"
+#include "RadixSort.h"
 #include <algorithm>
 
 hash_u HashList::at(int index) const
@@ -55,10 +56,22 @@ void HashList::sort()
 {
     if ( use64 )
     {
-        std::sort(hashes64.begin(), hashes64.end());
+        radixSort(hashes64);
     }
     else
     {
-        std::sort(hashes32.begin(), hashes32.end());
+        radixSort(hashes32);
+    }
+}
+
+void HashList::unique()
+{
+    if ( use64 )
+    {
+        hashes64.erase(std::unique(hashes64.begin(), hashes64.end()), hashes64.end());
+    }
+    else
+    {
+        hashes32.erase(std::unique(hashes32.begin(), hashes32.end()), hashes32.end());
     }
 }
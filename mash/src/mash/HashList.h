@@ -19,9 +19,12 @@ public:
     void setUse64(bool use64New) {use64 = use64New;}
     int size() const {return use64 ? hashes64.size() : hashes32.size();}
     void sort();
+    void unique(); // (of a sorted list)
     void push_back32(hash32_t hash) {hashes32.push_back(hash);}
     void push_back64(hash64_t hash) {hashes64.push_back(hash);}
     bool get64() const {return use64;}
+    const hash32_t * data32() const {return hashes32.data();}
+    const hash64_t * data64() const {return hashes64.data();}
 
     // Nuovo metodo add
     void add(const hash_u& hash) {
@@ -5,6 +5,7 @@
 // See the LICENSE.txt file included with this software for license information.
 
 #include "HashSet.h"
+#include "RadixSort.h"
 #include <utility>
 
 uint32_t HashSet::count(hash_u hash) const
@@ -77,44 +78,53 @@ void HashSet::insert(hash_u hash, uint32_t count)
 
 void HashSet::toHashList(HashList & hashList, std::vector<uint32_t> & counts) const
 {
+    // Radix sorted with the counts carried along, in linear time; the map's
+    // order is arbitrary, so there's nothing to gain from a comparison sort.
+    
+    std::vector<uint32_t> countsSorted;
+    
     if ( use64 )
     {
-    	typedef std::pair<hash64_t, uint32_t> hashCount64;
+    	std::vector<hash64_t> hashesSorted;
     	
-    	std::vector <hashCount64> sortList;
+    	hashesSorted.reserve(hashes64.size());
+    	countsSorted.reserve(hashes64.size());
     	
         for ( auto i = hashes64.begin(); i != hashes64.end(); i++ )
         {
-            sortList.push_back(hashCount64(i->first, i->second));
+            hashesSorted.push_back(i->first);
+            countsSorted.push_back(i->second);
         }
         
-        std::sort(sortList.begin(), sortList.end(), [](hashCount64 a, hashCount64 b){return a.first < b.first;});
+        radixSort(hashesSorted, countsSorted);
         
-        for ( auto i = sortList.begin(); i != sortList.end(); i++ )
+        for ( auto i = hashesSorted.begin(); i != hashesSorted.end(); i++ )
         {
-            hashList.push_back64(i->first);
-            counts.push_back(i->second);
+            hashList.push_back64(*i);
         }
     }
     else
     {
-    	typedef std::pair<hash32_t, uint32_t> hashCount32;
+    	std::vector<hash32_t> hashesSorted;
     	
-    	std::vector <hashCount32> sortList;
+    	hashesSorted.reserve(hashes32.size());
+    	countsSorted.reserve(hashes32.size());
     	
         for ( auto i = hashes32.begin(); i != hashes32.end(); i++ )
         {
-            sortList.push_back(hashCount32(i->first, i->second));
+            hashesSorted.push_back(i->first);
+            countsSorted.push_back(i->second);
         }
         
-        std::sort(sortList.begin(), sortList.end(), [](hashCount32 a, hashCount32 b){return a.first < b.first;});
+        radixSort(hashesSorted, countsSorted);
         
-        for ( auto i = sortList.begin(); i != sortList.end(); i++ )
+        for ( auto i = hashesSorted.begin(); i != hashesSorted.end(); i++ )
         {
-            hashList.push_back32(i->first);
-            counts.push_back(i->second);
+            hashList.push_back32(*i);
         }
     }
+    
+    counts.insert(counts.end(), countsSorted.begin(), countsSorted.end());
 }
 
 void HashSet::toHashList(HashList & hashList) const
@@ -0,0 +1,38 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#include "HyperLogLog.h"
+#include <math.h>
+
+HyperLogLog::HyperLogLog(int precisionNew) :
+	precision(precisionNew)
+{
+	clear();
+}
+
+void HyperLogLog::clear()
+{
+	registers.assign(1ull << precision, 0);
+	inverseSum = registers.size();
+	zeros = registers.size();
+}
+
+double HyperLogLog::estimate() const
+{
+	double m = registers.size();
+	double alpha = 0.7213 / (1. + 1.079 / m);
+	double raw = alpha * m * m / inverseSum;
+
+	// Small sets leave registers empty; counting those is more accurate.
+	// (With 64-bit remixed hashes, no large-range correction is needed.)
+
+	if ( raw <= 2.5 * m && zeros != 0 )
+	{
+		return m * log(m / zeros);
+	}
+
+	return raw;
+}
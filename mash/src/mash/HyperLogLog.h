@@ -0,0 +1,64 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#ifndef HyperLogLog_h
+#define HyperLogLog_h
+
+#include <inttypes.h>
+#include <vector>
+
+// Estimates the number of distinct hashes added, in 2^precision one-byte
+// registers (4 KB by default, for a standard error of about 1.6%). Hashes
+// are remixed first, so 32-bit hashes spread over all registers too. The
+// harmonic sum is kept up to date as registers grow, so estimate() is
+// constant time and can be checked after every read.
+//
+class HyperLogLog
+{
+public:
+
+	HyperLogLog(int precisionNew = 12);
+
+	void add(uint64_t hash);
+	void clear();
+	double estimate() const;
+
+private:
+
+	int precision;
+	std::vector<uint8_t> registers;
+
+	double inverseSum; // sum of 2^-register
+	uint64_t zeros; // (for linear counting of small sets)
+};
+
+inline void HyperLogLog::add(uint64_t hash)
+{
+	// MurmurHash3's 64-bit finalizer
+
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ull;
+	hash ^= hash >> 33;
+
+	uint64_t index = hash >> (64 - precision);
+	uint64_t rest = hash << precision;
+	uint8_t rank = rest ? __builtin_clzll(rest) + 1 : 64 - precision + 1;
+
+	if ( rank > registers[index] )
+	{
+		if ( registers[index] == 0 )
+		{
+			zeros--;
+		}
+
+		inverseSum += 1. / (1ull << rank) - 1. / (1ull << registers[index]);
+		registers[index] = rank;
+	}
+}
+
+#endif
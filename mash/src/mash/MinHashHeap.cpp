@@ -1,26 +1,41 @@
 
 #include "MinHashHeap.h"
+#include "Stats.h"
 #include <iostream>
 
 using namespace::std;
 
-MinHashHeap::MinHashHeap(bool use64New, uint64_t cardinalityMaximumNew, uint64_t multiplicityMinimumNew, uint64_t memoryBoundBytes) :
+MinHashHeap::MinHashHeap(bool use64New, uint64_t cardinalityMaximumNew, uint64_t multiplicityMinimumNew, uint64_t memoryBoundBytes, uint64_t hashMaximumNew) :
 	use64(use64New),
 	hashes(use64New),
-	hashesQueue(use64New),
-	hashesPending(use64New),
-	hashesQueuePending(use64New)
+	hashesQueue(use64New)
 {
 	cardinalityMaximum = cardinalityMaximumNew;
 	multiplicityMinimum = multiplicityMinimumNew;
+	hashMaximum = hashMaximumNew;
 	
 	multiplicitySum = 0;
 	
-	if ( memoryBoundBytes == 0 )
+	hyperLogLog = 0;
+	hashesTried = 0;
+	
+	inserts = 0;
+	rejections = 0;
+	
+	bloomFilter = 0;
+	countMin = 0;
+	countMinBytes = 0;
+	
+	if ( multiplicityMinimum > 1 )
 	{
-		bloomFilter = 0;
+		// Fixed memory, however many error k-mers there are. Once kept, a
+		// hash is counted exactly in the set; if it's then pushed out, it's
+		// above the heap forever after, so its copies need no tracking. The
+		// sketch is only allocated once a copy needs counting.
+		
+		countMinBytes = memoryBoundBytes ? memoryBoundBytes : countMinBytesDefault;
 	}
-	else
+	else if ( memoryBoundBytes != 0 )
 	{
 		bloom_parameters bloomParams;
 		
@@ -43,10 +58,23 @@ MinHashHeap::MinHashHeap(bool use64New, uint64_t cardinalityMaximumNew, uint64_t
 
 MinHashHeap::~MinHashHeap()
 {
+	Stats::add(Stats::HeapInserts, inserts);
+	Stats::add(Stats::HeapRejections, rejections);
+	
 	if ( bloomFilter != 0 )
 	{
 		delete bloomFilter;
 	}
+	
+	if ( countMin != 0 )
+	{
+		delete countMin;
+	}
+	
+	if ( hyperLogLog != 0 )
+	{
+		delete hyperLogLog;
+	}
 }
 
 void MinHashHeap::clear()
@@ -54,93 +82,112 @@ void MinHashHeap::clear()
 	hashes.clear();
 	hashesQueue.clear();
 	
-	hashesPending.clear();
-	hashesQueuePending.clear();
-	
 	if ( bloomFilter != 0 )
 	{
 		bloomFilter->clear();
 	}
 	
+	if ( countMin != 0 )
+	{
+		countMin->clear();
+	}
+	
+	if ( hyperLogLog != 0 )
+	{
+		hyperLogLog->clear();
+	}
+	
 	multiplicitySum = 0;
+	hashesTried = 0;
+}
+
+void MinHashHeap::countDistinct()
+{
+	if ( hyperLogLog == 0 )
+	{
+		hyperLogLog = new HyperLogLog();
+	}
 }
 
 void MinHashHeap::tryInsert(hash_u hash)
 {
+	if ( hyperLogLog != 0 )
+	{
+		hyperLogLog->add(use64 ? hash.hash64 : hash.hash32);
+		hashesTried++;
+	}
+	
 	if
 	(
-		hashes.size() < cardinalityMaximum ||
-		hashLessThan(hash, hashesQueue.top(), use64)
+		hashMaximum != 0 ?
+			(use64 ? hash.hash64 : hash.hash32) >= hashMaximum :
+			hashes.size() >= cardinalityMaximum && ! hashLessThan(hash, hashesQueue.top(), use64)
 	)
 	{
-		if ( hashes.count(hash) == 0 )
+		rejections++;
+		return;
+	}
+	
+	inserts++;
+	
+	if ( hashes.count(hash) != 0 )
+	{
+		hashes.insert(hash, 1);
+		multiplicitySum++;
+		return;
+	}
+	
+	uint32_t count; // copies so far, once enough to keep it
+	
+	if ( bloomFilter != 0 )
+	{
+		const unsigned char * data = use64 ? (const unsigned char *)&hash.hash64 : (const unsigned char *)&hash.hash32;
+		size_t length = use64 ? 8 : 4;
+		
+		if ( ! bloomFilter->contains(data, length) )
 		{
-			if ( bloomFilter != 0 )
-			{
-                const unsigned char * data = use64 ? (const unsigned char *)&hash.hash64 : (const unsigned char *)&hash.hash32;
-            	size_t length = use64 ? 8 : 4;
-            	
-                if ( bloomFilter->contains(data, length) )
-                {
-					hashes.insert(hash, 2);
-					hashesQueue.push(hash);
-					multiplicitySum += 2;
-	                kmersUsed++;
-                }
-            	else
-            	{
-	                bloomFilter->insert(data, length);
-	                kmersTotal++;
-	            }
-			}
-			else if ( multiplicityMinimum == 1 || hashesPending.count(hash) == multiplicityMinimum - 1 )
-			{
-				hashes.insert(hash, multiplicityMinimum);
-				hashesQueue.push(hash);
-				multiplicitySum += multiplicityMinimum;
-				
-				if ( multiplicityMinimum > 1 )
-				{
-					// just remove from set for now; will be removed from
-					// priority queue when it's on top
-					//
-					hashesPending.erase(hash);
-				}
-			}
-			else
-			{
-				if ( hashesPending.count(hash) == 0 )
-				{
-					hashesQueuePending.push(hash);
-				}
-			
-				hashesPending.insert(hash, 1);
-			}
+			bloomFilter->insert(data, length);
+			kmersTotal++;
+			return;
 		}
-		else
+		
+		count = 2;
+		kmersUsed++;
+	}
+	else if ( countMinBytes != 0 )
+	{
+		if ( countMin == 0 )
 		{
-			hashes.insert(hash, 1);
-			multiplicitySum++;
+			countMin = new CountMinSketch(countMinBytes);
 		}
 		
-		if ( hashes.size() > cardinalityMaximum )
+		if ( countMin->add(use64 ? hash.hash64 : hash.hash32) < multiplicityMinimum )
 		{
-			multiplicitySum -= hashes.count(hashesQueue.top());
-			hashes.erase(hashesQueue.top());
-			
-			// loop since there could be zombie hashes (gone from hashesPending)
-			//
-			while ( hashesQueuePending.size() > 0 && hashLessThan(hashesQueue.top(), hashesQueuePending.top(), use64) )
-			{
-				if ( hashesPending.count(hashesQueuePending.top()) )
-				{
-					hashesPending.erase(hashesQueuePending.top());
-				}
-				
-				hashesQueuePending.pop();
-			}
-			
-			hashesQueue.pop();
+			return;
 		}
+		
+		count = multiplicityMinimum;
+	}
+	else
+	{
+		count = 1;
+	}
+	
+	hashes.insert(hash, count);
+	multiplicitySum += count;
+	
+	if ( hashMaximum != 0 )
+	{
+		// a fixed threshold, so nothing is evicted and the queue isn't needed
+		return;
+	}
+	
+	hashesQueue.push(hash);
+	
+	if ( hashes.size() > cardinalityMaximum )
+	{
+		multiplicitySum -= hashes.count(hashesQueue.top());
+		hashes.erase(hashesQueue.top());
+		hashesQueue.pop();
 	}
 }
@@ -3,7 +3,9 @@
 
 #include "HashList.h"
 #include "HashPriorityQueue.h"
+#include "CountMinSketch.h"
 #include "HashSet.h"
+#include "HyperLogLog.h"
 #include <math.h>
 #include "bloom_filter.hpp"
 
@@ -11,11 +13,22 @@ class MinHashHeap
 {
 public:
 
-	MinHashHeap(bool use64New, uint64_t cardinalityMaximumNew, uint64_t multiplicityMinimumNew = 1, uint64_t memoryBoundBytes = 0);
+	// With hashMaximumNew, the heap is scaled (FracMinHash): every hash below
+	// it is kept, whatever the count, and cardinalityMaximumNew is ignored.
+	// With multiplicityMinimumNew above 1, copies of hashes not yet kept are
+	// counted in a count-min sketch of memoryBoundBytes (or a default size),
+	// allocated when first needed; otherwise memoryBoundBytes gives a Bloom
+	// filter that keeps hashes seen twice.
+	//
+	MinHashHeap(bool use64New, uint64_t cardinalityMaximumNew, uint64_t multiplicityMinimumNew = 1, uint64_t memoryBoundBytes = 0, uint64_t hashMaximumNew = 0);
 	~MinHashHeap();
 	void clear();
+	void countDistinct(); // (all hashes tried, before any filtering; see estimateDistinct())
+	double estimateCoverage() const;
+	double estimateDistinct() const;
 	double estimateMultiplicity() const;
 	double estimateSetSize() const;
+	uint64_t getHashesTried() const {return hashesTried;} // (when counting distinct)
 	void toHashList(HashList & hashList, std::vector<uint32_t> & counts) const;
 	void toHashList(HashList & hashList) const;
 	void tryInsert(hash_u hash);
@@ -27,11 +40,12 @@ private:
 	HashSet hashes;
 	HashPriorityQueue hashesQueue;
 	
-	HashSet hashesPending;
-	HashPriorityQueue hashesQueuePending;
+	CountMinSketch * countMin; // (0 until a copy needs counting)
+	uint64_t countMinBytes; // (0 unless multiplicityMinimum > 1)
 	
 	uint64_t cardinalityMaximum;
 	uint64_t multiplicityMinimum;
+	uint64_t hashMaximum; // (0 if not scaled)
 	
 	uint64_t multiplicitySum;
 	
@@ -39,10 +53,18 @@ private:
     
     uint64_t kmersTotal;
     uint64_t kmersUsed;
+    
+    HyperLogLog * hyperLogLog; // (0 unless counting distinct hashes)
+    uint64_t hashesTried;
+    
+    uint64_t inserts; // (for Stats)
+    uint64_t rejections;
 };
 
+inline double MinHashHeap::estimateCoverage() const {return hyperLogLog != 0 && hashesTried ? hashesTried / hyperLogLog->estimate() : 0;}
+inline double MinHashHeap::estimateDistinct() const {return hyperLogLog != 0 ? hyperLogLog->estimate() : 0;}
 inline double MinHashHeap::estimateMultiplicity() const {return hashes.size() ? (double)multiplicitySum / hashes.size() : 0;}
-inline double MinHashHeap::estimateSetSize() const {return hashes.size() ? pow(2.0, use64 ? 64.0 : 32.0) * (double)hashes.size() / (use64 ? (double)hashesQueue.top().hash64 : (double)hashesQueue.top().hash32) : 0;}
+inline double MinHashHeap::estimateSetSize() const {return hashMaximum ? pow(2.0, use64 ? 64.0 : 32.0) * (double)hashes.size() / hashMaximum : hashes.size() ? pow(2.0, use64 ? 64.0 : 32.0) * (double)hashes.size() / (use64 ? (double)hashesQueue.top().hash64 : (double)hashesQueue.top().hash32) : 0;}
 inline void MinHashHeap::toHashList(HashList & hashList, std::vector<uint32_t> & counts) const {hashes.toHashList(hashList, counts);}
 inline void MinHashHeap::toHashList(HashList & hashList) const {hashes.toHashList(hashList);}
 
@@ -0,0 +1,391 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#include "MinHashWindow.h"
+#include <algorithm>
+
+using namespace::std;
+
+bool candidateLessThan(const MinHashWindow::Candidate & a, const MinHashWindow::Candidate & b)
+{
+	return a.hash < b.hash || ( a.hash == b.hash && a.position < b.position );
+}
+
+bool candidateHashLessThan(const MinHashWindow::Candidate & a, hash64_t hash)
+{
+	return a.hash < hash;
+}
+
+MinHashWindow::MinHashWindow(uint32_t windowSizeNew, uint32_t minHashesNew)
+{
+	windowSize = windowSizeNew > 0 ? windowSizeNew : 1;
+	minHashes = minHashesNew;
+
+	if ( minHashes == 0 || minHashes > windowSize )
+	{
+		// every distinct hash in a window is a min-hash
+
+		minHashes = windowSize;
+	}
+
+	count = 0;
+	front = 0;
+
+	hashes.resize(windowSize);
+	flags.resize(windowSize, 0);
+
+	if ( minHashes == 1 )
+	{
+		minimums.resize(windowSize);
+		minimumsStart = 0;
+		minimumsSize = 0;
+	}
+	else
+	{
+		candidatesMax = 2 * minHashes + 64;
+
+		if ( candidatesMax > windowSize )
+		{
+			candidatesMax = windowSize;
+		}
+
+		candidates.reserve(candidatesMax + 1);
+		candidatesComplete = true;
+	}
+
+	shifted = false;
+	moved = false;
+}
+
+bool MinHashWindow::flush(uint32_t & positionToSet, hash64_t & hashToSet)
+{
+	// report the remaining min-hash loci of the last window
+
+	while ( front < count )
+	{
+		uint32_t slot = front % windowSize;
+
+		front++;
+
+		if ( flags[slot] )
+		{
+			flags[slot] = 0;
+			positionToSet = front - 1;
+			hashToSet = hashes[slot];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool MinHashWindow::push(hash64_t hash, uint32_t & positionToSet, hash64_t & hashToSet)
+{
+	uint32_t position = count;
+	uint32_t slot = position % windowSize;
+	bool popped = false;
+
+	if ( position >= windowSize )
+	{
+		// pop the front of the window, which occupies the slot being reused
+
+		hash64_t hashFront = hashes[slot];
+
+		if ( minHashes == 1 )
+		{
+			if ( minimumsSize > 0 && minimums[minimumsStart].position == front )
+			{
+				minimumsStart = minimumsStart + 1 == windowSize ? 0 : minimumsStart + 1;
+				minimumsSize--;
+			}
+		}
+		else
+		{
+			removeCandidate(hashFront, front, position);
+		}
+
+		if ( flags[slot] )
+		{
+			flags[slot] = 0;
+			positionToSet = front;
+			hashToSet = hashFront;
+			popped = true;
+		}
+
+		front++;
+	}
+
+	hashes[slot] = hash;
+	count++;
+
+	if ( minHashes == 1 )
+	{
+		// keep earlier loci with equal hashes so the leftmost is the minimum
+
+		while ( minimumsSize > 0 )
+		{
+			uint32_t back = minimumsStart + minimumsSize - 1;
+
+			if ( back >= windowSize )
+			{
+				back -= windowSize;
+			}
+
+			if ( minimums[back].hash <= hash )
+			{
+				break;
+			}
+
+			minimumsSize--;
+		}
+
+		uint32_t back = minimumsStart + minimumsSize;
+
+		if ( back >= windowSize )
+		{
+			back -= windowSize;
+		}
+
+		minimums[back].hash = hash;
+		minimums[back].position = position;
+		minimumsSize++;
+
+		if ( count >= windowSize )
+		{
+			flags[minimums[minimumsStart].position % windowSize] = 1;
+		}
+
+		return popped;
+	}
+
+	insertCandidate(hash, position);
+
+	if ( count == windowSize )
+	{
+		// first complete window
+
+		for ( uint32_t i = 0; i < candidates.size() && i < minHashes; i++ )
+		{
+			flags[candidates[i].position % windowSize] = 1;
+		}
+	}
+	else if ( count > windowSize )
+	{
+		// Flag loci that have just become min-hashes: the new k-mer, the new
+		// leftmost occurrence of the hash that was popped, and the hash that
+		// took the place of the popped one if it left the bottom h.
+
+		uint32_t index = findCandidate(hash);
+
+		if ( index < minHashes )
+		{
+			flags[candidates[index].position % windowSize] = 1;
+		}
+
+		if ( moved )
+		{
+			index = findCandidate(movedHash);
+
+			if ( index < minHashes )
+			{
+				flags[candidates[index].position % windowSize] = 1;
+			}
+		}
+
+		if ( shifted && candidates.size() >= minHashes )
+		{
+			flags[candidates[minHashes - 1].position % windowSize] = 1;
+		}
+	}
+
+	shifted = false;
+	moved = false;
+
+	return popped;
+}
+
+uint32_t MinHashWindow::findCandidate(hash64_t hash) const
+{
+	vector<Candidate>::const_iterator i = lower_bound(candidates.begin(), candidates.end(), hash, candidateHashLessThan);
+
+	if ( i == candidates.end() || i->hash != hash )
+	{
+		return candidates.size();
+	}
+
+	return i - candidates.begin();
+}
+
+void MinHashWindow::insertCandidate(hash64_t hash, uint32_t position)
+{
+	vector<Candidate>::iterator i = lower_bound(candidates.begin(), candidates.end(), hash, candidateHashLessThan);
+
+	if ( i != candidates.end() && i->hash == hash )
+	{
+		i->count++;
+		return;
+	}
+
+	Candidate candidate;
+
+	candidate.hash = hash;
+	candidate.position = position;
+	candidate.count = 1;
+
+	if ( i == candidates.end() )
+	{
+		if ( ! candidatesComplete )
+		{
+			// larger than every tracked hash, so cannot be in the bottom h
+			return;
+		}
+
+		if ( candidates.size() == candidatesMax )
+		{
+			candidatesComplete = false;
+			return;
+		}
+
+		candidates.push_back(candidate);
+		return;
+	}
+
+	candidates.insert(i, candidate);
+
+	if ( candidates.size() > candidatesMax )
+	{
+		candidates.pop_back();
+		candidatesComplete = false;
+	}
+}
+
+void MinHashWindow::rebuildCandidates(uint32_t start, uint32_t end)
+{
+	// Recover the smallest distinct hashes (with their counts and leftmost
+	// positions) of positions [start, end) from the ring buffer. This happens
+	// roughly once per window length, so its cost is amortized.
+
+	rebuildBuffer.clear();
+
+	for ( uint32_t i = start; i < end; i++ )
+	{
+		Candidate candidate;
+
+		candidate.hash = hashes[i % windowSize];
+		candidate.position = i;
+		candidate.count = 1;
+
+		rebuildBuffer.push_back(candidate);
+	}
+
+	vector<Candidate>::iterator last = rebuildBuffer.end();
+
+	if ( rebuildBuffer.size() > candidatesMax )
+	{
+		// Only the lowest candidatesMax need sorting unless repeats leave
+		// fewer distinct hashes than that among them.
+
+		last = rebuildBuffer.begin() + candidatesMax;
+		nth_element(rebuildBuffer.begin(), last, rebuildBuffer.end(), candidateLessThan);
+		sort(rebuildBuffer.begin(), last, candidateLessThan);
+
+		uint32_t distinct = 1;
+
+		for ( vector<Candidate>::iterator i = rebuildBuffer.begin() + 1; i != last; i++ )
+		{
+			if ( i->hash != (i - 1)->hash )
+			{
+				distinct++;
+			}
+		}
+
+		if ( distinct < candidatesMax || last->hash == (last - 1)->hash )
+		{
+			last = rebuildBuffer.end();
+			sort(rebuildBuffer.begin(), last, candidateLessThan);
+		}
+	}
+	else
+	{
+		sort(rebuildBuffer.begin(), last, candidateLessThan);
+	}
+
+	candidates.clear();
+	candidatesComplete = true;
+
+	for ( vector<Candidate>::iterator i = rebuildBuffer.begin(); i != last; i++ )
+	{
+		if ( candidates.size() > 0 && candidates.back().hash == i->hash )
+		{
+			candidates.back().count++;
+		}
+		else if ( candidates.size() == candidatesMax )
+		{
+			candidatesComplete = false;
+			break;
+		}
+		else
+		{
+			candidates.push_back(*i);
+		}
+	}
+
+	if ( last != rebuildBuffer.end() )
+	{
+		candidatesComplete = false;
+	}
+}
+
+void MinHashWindow::removeCandidate(hash64_t hash, uint32_t position, uint32_t end)
+{
+	uint32_t index = findCandidate(hash);
+
+	if ( index == candidates.size() )
+	{
+		return;
+	}
+
+	Candidate & candidate = candidates[index];
+
+	if ( candidate.count > 1 )
+	{
+		candidate.count--;
+
+		if ( candidate.position == position )
+		{
+			// advance to the next occurrence
+
+			for ( uint32_t i = position + 1; i < end; i++ )
+			{
+				if ( hashes[i % windowSize] == hash )
+				{
+					candidate.position = i;
+					break;
+				}
+			}
+
+			if ( index < minHashes )
+			{
+				moved = true;
+				movedHash = hash;
+			}
+		}
+
+		return;
+	}
+
+	candidates.erase(candidates.begin() + index);
+
+	if ( index < minHashes )
+	{
+		shifted = true;
+	}
+
+	if ( candidates.size() < minHashes && ! candidatesComplete )
+	{
+		rebuildCandidates(position + 1, end);
+	}
+}
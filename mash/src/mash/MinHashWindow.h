@@ -0,0 +1,80 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#ifndef MinHashWindow_h
+#define MinHashWindow_h
+
+#include "hash.h"
+#include <vector>
+
+// Rolling window over the k-mer hashes of a sequence that reports every
+// position whose hash is one of the h smallest distinct hashes in at least one
+// full window (only the leftmost occurrence of a repeated hash in a window
+// counts). Positions are reported in increasing order as they leave the
+// window, followed by the remainder of the last window on flush().
+//
+// For h = 1 the window is a monotonic deque over a ring buffer. For h > 1 the
+// smallest distinct hashes are kept in a short sorted array (between h and 2h
+// entries) that is rebuilt from the ring buffer only when it runs dry, so no
+// memory is allocated per k-mer in either case.
+//
+class MinHashWindow
+{
+public:
+
+	struct Candidate
+	{
+		hash64_t hash;
+		uint32_t position; // leftmost occurrence in the window
+		uint32_t count;
+	};
+
+	MinHashWindow(uint32_t windowSizeNew, uint32_t minHashesNew);
+
+	bool flush(uint32_t & positionToSet, hash64_t & hashToSet);
+	bool push(hash64_t hash, uint32_t & positionToSet, hash64_t & hashToSet);
+
+private:
+
+	uint32_t findCandidate(hash64_t hash) const;
+	void insertCandidate(hash64_t hash, uint32_t position);
+	void rebuildCandidates(uint32_t start, uint32_t end);
+	void removeCandidate(hash64_t hash, uint32_t position, uint32_t end);
+
+	uint32_t windowSize;
+	uint32_t minHashes;
+	uint32_t count; // k-mers pushed so far
+	uint32_t front; // first position of the current window
+
+	// hashes and min-hash flags of the current window, indexed by position
+	// modulo the window size
+	//
+	std::vector<hash64_t> hashes;
+	std::vector<char> flags;
+
+	// h = 1: loci with strictly increasing hashes (ring buffer; counts unused)
+	//
+	std::vector<Candidate> minimums;
+	uint32_t minimumsStart;
+	uint32_t minimumsSize;
+
+	// h > 1: the smallest distinct hashes of the window, sorted by hash. Either
+	// at least h are present or the window has no others (complete).
+	//
+	std::vector<Candidate> candidates;
+	uint32_t candidatesMax;
+	bool candidatesComplete;
+	std::vector<Candidate> rebuildBuffer;
+
+	// set while removing the front of the window so push() can flag loci that
+	// became min-hashes
+	//
+	bool shifted;
+	bool moved;
+	hash64_t movedHash;
+};
+
+#endif
@@ -0,0 +1,225 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#include "OutputBuffer.h"
+#include <math.h>
+
+using namespace::std;
+
+OutputBuffer::OutputBuffer(uint64_t capacity)
+{
+	buffer.reserve(capacity);
+}
+
+void OutputBuffer::write(FILE * file)
+{
+	fwrite(buffer.data(), 1, buffer.size(), file);
+	buffer.clear();
+}
+
+OutputBuffer & OutputBuffer::operator<<(double number)
+{
+	char output[16];
+	buffer.append(output, formatDouble(number, output));
+	return *this;
+}
+
+OutputBuffer & OutputBuffer::operator<<(long long number)
+{
+	if ( number < 0 )
+	{
+		buffer.push_back('-');
+		return *this << (unsigned long long)(-(number + 1)) + 1;
+	}
+
+	return *this << (unsigned long long)number;
+}
+
+OutputBuffer & OutputBuffer::operator<<(unsigned long long number)
+{
+	char output[20];
+	buffer.append(output, formatInteger(number, output));
+	return *this;
+}
+
+struct PowersOfTen
+{
+	double powers[2 * 310 + 1]; // (10^-310 to 10^310)
+
+	PowersOfTen()
+	{
+		for ( int i = 0; i < sizeof(powers) / sizeof(double); i++ )
+		{
+			powers[i] = pow(10., i - 310);
+		}
+	}
+};
+
+int formatDouble(double number, char * output)
+{
+	// Scale to six digits and round. Exact decimal rounding is only needed
+	// when the scaled value is very close to a half (or the exponent is
+	// extreme), so those cases are left to snprintf.
+
+	static const int precision = 6;
+	static const PowersOfTen table; // (built once, thread-safe, by the first caller)
+	const double * powers = table.powers;
+
+	double magnitude = fabs(number);
+
+	if ( magnitude == 0 )
+	{
+		if ( signbit(number) )
+		{
+			output[0] = '-';
+			output[1] = '0';
+			return 2;
+		}
+
+		output[0] = '0';
+		return 1;
+	}
+
+	if ( ! ( magnitude > 1e-290 && magnitude < 1e290 ) )
+	{
+		// tiny, huge, nan or inf
+
+		return snprintf(output, 16, "%g", number);
+	}
+
+	int exponent = floor(log10(magnitude));
+	double scaled = magnitude * powers[310 + precision - 1 - exponent];
+
+	if ( scaled < 1e5 )
+	{
+		exponent--;
+		scaled = magnitude * powers[310 + precision - 1 - exponent];
+	}
+	else if ( scaled >= 1e6 )
+	{
+		exponent++;
+		scaled = magnitude * powers[310 + precision - 1 - exponent];
+	}
+
+	double fraction = scaled - floor(scaled);
+
+	if ( fabs(fraction - .5) < 1e-6 )
+	{
+		return snprintf(output, 16, "%g", number);
+	}
+
+	uint64_t digits = scaled + .5;
+
+	if ( digits >= 1000000 )
+	{
+		digits /= 10;
+		exponent++;
+	}
+
+	char digitChars[precision];
+
+	for ( int i = precision - 1; i >= 0; i-- )
+	{
+		digitChars[i] = '0' + digits % 10;
+		digits /= 10;
+	}
+
+	int significant = precision;
+
+	while ( significant > 1 && digitChars[significant - 1] == '0' )
+	{
+		significant--;
+	}
+
+	int length = 0;
+
+	if ( number < 0 )
+	{
+		output[length++] = '-';
+	}
+
+	if ( exponent < -4 || exponent >= precision )
+	{
+		output[length++] = digitChars[0];
+
+		if ( significant > 1 )
+		{
+			output[length++] = '.';
+
+			for ( int i = 1; i < significant; i++ )
+			{
+				output[length++] = digitChars[i];
+			}
+		}
+
+		output[length++] = 'e';
+		output[length++] = exponent < 0 ? '-' : '+';
+
+		int exponentAbs = exponent < 0 ? -exponent : exponent;
+
+		if ( exponentAbs >= 100 )
+		{
+			output[length++] = '0' + exponentAbs / 100;
+		}
+
+		output[length++] = '0' + exponentAbs / 10 % 10;
+		output[length++] = '0' + exponentAbs % 10;
+	}
+	else if ( exponent < 0 )
+	{
+		output[length++] = '0';
+		output[length++] = '.';
+
+		for ( int i = -1; i > exponent; i-- )
+		{
+			output[length++] = '0';
+		}
+
+		for ( int i = 0; i < significant; i++ )
+		{
+			output[length++] = digitChars[i];
+		}
+	}
+	else
+	{
+		for ( int i = 0; i <= exponent; i++ )
+		{
+			output[length++] = digitChars[i];
+		}
+
+		if ( significant > exponent + 1 )
+		{
+			output[length++] = '.';
+
+			for ( int i = exponent + 1; i < significant; i++ )
+			{
+				output[length++] = digitChars[i];
+			}
+		}
+	}
+
+	return length;
+}
+
+int formatInteger(uint64_t number, char * output)
+{
+	char reversed[20];
+	int length = 0;
+
+	do
+	{
+		reversed[length++] = '0' + number % 10;
+		number /= 10;
+	}
+	while ( number > 0 );
+
+	for ( int i = 0; i < length; i++ )
+	{
+		output[i] = reversed[length - i - 1];
+	}
+
+	return length;
+}
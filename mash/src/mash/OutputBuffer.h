@@ -0,0 +1,55 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#ifndef OutputBuffer_h
+#define OutputBuffer_h
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string>
+
+// Text output accumulated in memory so it can be formatted in worker threads
+// and written by the main thread as a single block. Numbers are formatted the
+// same way as the default std::ostream formatting (6 significant digits for
+// floating point), without going through iostreams or the locale.
+//
+class OutputBuffer
+{
+public:
+
+	OutputBuffer(uint64_t capacity = 1 << 16);
+
+	void append(const char * data, uint64_t length) {buffer.append(data, length);}
+	void clear() {buffer.clear();}
+	const char * data() const {return buffer.data();}
+	uint64_t size() const {return buffer.size();}
+	void write(FILE * file = stdout);
+
+	OutputBuffer & operator<<(char c) {buffer.push_back(c); return *this;}
+	OutputBuffer & operator<<(const char * string) {buffer.append(string); return *this;}
+	OutputBuffer & operator<<(const std::string & string) {buffer.append(string); return *this;}
+	OutputBuffer & operator<<(double number);
+	OutputBuffer & operator<<(float number) {return *this << double(number);}
+	OutputBuffer & operator<<(int number) {return *this << (long long)number;}
+	OutputBuffer & operator<<(unsigned int number) {return *this << (unsigned long long)number;}
+	OutputBuffer & operator<<(long number) {return *this << (long long)number;}
+	OutputBuffer & operator<<(unsigned long number) {return *this << (unsigned long long)number;}
+	OutputBuffer & operator<<(long long number);
+	OutputBuffer & operator<<(unsigned long long number);
+
+private:
+
+	std::string buffer;
+};
+
+// Writes a double as printf("%g") would (6 significant digits) and returns the
+// number of characters written (at most 15, not terminated).
+//
+int formatDouble(double number, char * output);
+
+int formatInteger(uint64_t number, char * output);
+
+#endif
@@ -0,0 +1,160 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#include "PValueTable.h"
+#include "Stats.h"
+#include <math.h>
+
+#ifdef USE_BOOST
+    #include <boost/math/distributions/binomial.hpp>
+    using namespace::boost::math;
+#else
+    #include <gsl/gsl_cdf.h>
+#endif
+
+namespace mash {
+
+// Relative accuracy assumed for the library CDF; estimates are only used
+// when they are this far (plus their own error) from a decision.
+//
+static const double pValueLibraryError = 1e-9;
+
+// Largest ratio between consecutive tail terms for which the direct sum is
+// used (beyond this it converges too slowly).
+//
+static const double pValueRatioMax = 0.9;
+
+bool nearRoundingBoundary(double value, double tolerance)
+{
+	// Would the six significant digits printed for the value (%g) change
+	// anywhere within value * (1 +/- tolerance)?
+
+	int exponent = floor(log10(value));
+	double scaled = value / pow(10., exponent - 5);
+
+	if ( scaled < 1e5 || scaled >= 1e6 )
+	{
+		return true; // (log10 was off by one; don't bother)
+	}
+
+	return fabs(scaled - floor(scaled) - .5) <= scaled * tolerance + 1e-6;
+}
+
+PValueTable::PValueTable(uint64_t sketchSizeNew)
+{
+	sketchSize = sketchSizeNew;
+	logChoose.resize(sketchSize + 1);
+
+	for ( uint64_t i = 0; i <= sketchSize; i++ )
+	{
+		logChoose[i] = lgamma(sketchSize + 1.) - lgamma(i + 1.) - lgamma(sketchSize - i + 1.);
+	}
+}
+
+double PValueTable::getPValue(uint64_t x, uint64_t n, double r, double maxPValue) const
+{
+	if ( x == 0 )
+	{
+		return 1.;
+	}
+
+	double pValue;
+
+	if ( estimate(x, n, r, maxPValue, pValue) )
+	{
+		return pValue;
+	}
+
+	Stats::add(Stats::PValuesLibrary, 1);
+	return binomialTail(x, n, r);
+}
+
+bool PValueTable::estimate(uint64_t x, uint64_t n, double r, double maxPValue, double & pValueToSet) const
+{
+	if ( x > n || r <= 0 || r >= 1 )
+	{
+		return false;
+	}
+
+	// ratio of the (x+1)th term to the xth; the ratios fall from there on
+
+	double odds = r / (1. - r);
+	double ratio = double(n - x) / (x + 1) * odds;
+
+	if ( ratio > pValueRatioMax )
+	{
+		return false;
+	}
+
+	double logR = log(r);
+	double log1MinusR = log1p(-r);
+	double logBinomial = n == sketchSize ?
+		logChoose[x] :
+		lgamma(n + 1.) - lgamma(x + 1.) - lgamma(n - x + 1.);
+
+	double logTerm = logBinomial + x * logR + (n - x) * log1MinusR;
+
+	if ( logTerm - log1p(-ratio) < -747 )
+	{
+		// below half the smallest denormal, so the CDF rounds to 0 as well
+
+		pValueToSet = 0;
+		return true;
+	}
+
+	if ( logTerm < -700 )
+	{
+		return false; // near underflow
+	}
+
+	// sum the tail relative to its first term
+
+	double sum = 1;
+	double term = 1;
+
+	for ( uint64_t i = x; i < n; i++ )
+	{
+		term *= double(n - i) / (i + 1) * odds;
+		sum += term;
+
+		if ( term < sum * 1e-17 )
+		{
+			break;
+		}
+	}
+
+	double pValue = exp(logTerm) * sum;
+
+	// Error of the estimate is dominated by cancellation in the log terms,
+	// each of which is accurate to a few ulps of its magnitude.
+
+	double magnitude = fabs(logBinomial) + fabs(x * logR) + fabs((n - x) * log1MinusR) + 1;
+	double tolerance = 8 * magnitude * 2.2e-16 + pValueLibraryError;
+
+	if ( maxPValue >= 0 && fabs(pValue - maxPValue) <= (pValue > maxPValue ? pValue : maxPValue) * tolerance )
+	{
+		return false;
+	}
+
+	if ( nearRoundingBoundary(pValue, tolerance) )
+	{
+		return false;
+	}
+
+	pValueToSet = pValue;
+	return true;
+}
+
+double binomialTail(uint64_t x, uint64_t n, double r)
+{
+#ifdef USE_BOOST
+	return cdf(complement(binomial(n, r), x - 1));
+#else
+	return gsl_cdf_binomial_Q(x - 1, r, n);
+#endif
+}
+
+} // namespace mash
@@ -0,0 +1,47 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#ifndef INCLUDED_PValueTable
+#define INCLUDED_PValueTable
+
+#include <inttypes.h>
+#include <vector>
+
+namespace mash {
+
+// Upper binomial tail P(X >= x) for X ~ Binomial(n, r), which is the p-value
+// of seeing x shared min-hashes by chance.
+//
+// The CDF from GSL (or Boost) is replaced, where it is safe, by summing the
+// tail directly from its first term, with log binomial coefficients for the
+// sketch size taken from a table built once per run (read-only, so it can be
+// shared by all compare threads). When x is above the mean the terms fall
+// off geometrically and only a few are needed. The library CDF is still used
+// when the estimate is not accurate enough to give the same six printed
+// digits and the same threshold decision: near the mean, near underflow,
+// close to a rounding boundary or close to the p-value threshold.
+//
+class PValueTable
+{
+public:
+
+	PValueTable(uint64_t sketchSizeNew);
+
+	double getPValue(uint64_t x, uint64_t n, double r, double maxPValue = -1) const;
+
+private:
+
+	bool estimate(uint64_t x, uint64_t n, double r, double maxPValue, double & pValueToSet) const;
+
+	uint64_t sketchSize;
+	std::vector<double> logChoose; // log C(sketchSize, x)
+};
+
+double binomialTail(uint64_t x, uint64_t n, double r);
+
+} // namespace mash
+
+#endif
@@ -0,0 +1,232 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#include "PackedHashes.h"
+
+using namespace::std;
+
+class BitWriter
+{
+public:
+
+	BitWriter(vector<uint8_t> & outNew) : out(outNew), bitBuffer(0), bitCount(0) {}
+
+	void flush()
+	{
+		if ( bitCount > 0 )
+		{
+			out.push_back(bitBuffer);
+		}
+
+		bitBuffer = 0;
+		bitCount = 0;
+	}
+
+	void put(uint64_t value, int width)
+	{
+		if ( width > 32 )
+		{
+			put(value & 0xffffffff, 32);
+			put(value >> 32, width - 32);
+			return;
+		}
+
+		// (fewer than 8 bits are ever held, so 32 more always fit)
+
+		bitBuffer |= (value & ((1ull << width) - 1)) << bitCount;
+		bitCount += width;
+
+		while ( bitCount >= 8 )
+		{
+			out.push_back(bitBuffer & 0xff);
+			bitBuffer >>= 8;
+			bitCount -= 8;
+		}
+	}
+
+private:
+
+	vector<uint8_t> & out;
+	uint64_t bitBuffer;
+	int bitCount;
+};
+
+int getBitWidth(uint64_t value)
+{
+	int width = 0;
+
+	while ( value != 0 )
+	{
+		width++;
+		value >>= 1;
+	}
+
+	return width;
+}
+
+bool packHashes(const HashList & hashes, vector<uint8_t> & packedToSet)
+{
+	bool use64 = hashes.get64();
+	uint64_t count = hashes.size();
+
+	packedToSet.clear();
+
+	for ( uint64_t i = 1; i < count; i++ )
+	{
+		if ( use64 ? hashes.data64()[i] <= hashes.data64()[i - 1] : hashes.data32()[i] <= hashes.data32()[i - 1] )
+		{
+			return false;
+		}
+	}
+
+	packedToSet.reserve(count * (use64 ? 8 : 4) / 2);
+
+	for ( uint64_t value = count; ; value >>= 7 )
+	{
+		packedToSet.push_back((value & 0x7f) | (value >= 0x80 ? 0x80 : 0));
+
+		if ( value < 0x80 )
+		{
+			break;
+		}
+	}
+
+	BitWriter writer(packedToSet);
+	uint64_t gaps[packedHashesBlock];
+	uint64_t previous = 0;
+
+	for ( uint64_t i = 0; i < count; i += packedHashesBlock )
+	{
+		uint64_t blockSize = count - i < packedHashesBlock ? count - i : packedHashesBlock;
+		uint64_t gapMax = 0;
+
+		for ( uint64_t j = 0; j < blockSize; j++ )
+		{
+			uint64_t hash = use64 ? hashes.data64()[i + j] : hashes.data32()[i + j];
+
+			gaps[j] = hash - previous;
+			previous = hash;
+
+			if ( gaps[j] > gapMax )
+			{
+				gapMax = gaps[j];
+			}
+		}
+
+		int width = getBitWidth(gapMax);
+
+		packedToSet.push_back(width);
+
+		for ( uint64_t j = 0; j < blockSize; j++ )
+		{
+			writer.put(gaps[j], width);
+		}
+
+		writer.flush();
+	}
+
+	return true;
+}
+
+PackedHashReader::PackedHashReader(const uint8_t * dataNew, uint64_t sizeNew)
+	:
+	data(dataNew),
+	end(dataNew + sizeNew),
+	count(0),
+	index(0),
+	previous(0),
+	truncated(false),
+	width(0),
+	bitBuffer(0),
+	bitCount(0)
+{
+	for ( int shift = 0; data < end && shift < 64; shift += 7 )
+	{
+		uint8_t byte = *data++;
+
+		count |= uint64_t(byte & 0x7f) << shift;
+
+		if ( (byte & 0x80) == 0 )
+		{
+			break;
+		}
+	}
+
+	// Distinct sorted gaps take at least a bit each (only the first can be
+	// zero), so a larger count means corrupt data; bounding it keeps callers
+	// from sizing lists to it before next() finds the data short.
+
+	if ( count > 8 * uint64_t(end - data) + 1 )
+	{
+		count = 8 * uint64_t(end - data) + 1;
+		truncated = true;
+	}
+}
+
+bool PackedHashReader::next(uint64_t & hashToSet)
+{
+	if ( index == count || truncated )
+	{
+		return false;
+	}
+
+	if ( index % packedHashesBlock == 0 )
+	{
+		// next block; drop the padding of the last one
+
+		bitBuffer = 0;
+		bitCount = 0;
+
+		if ( data == end )
+		{
+			truncated = true;
+			return false;
+		}
+
+		width = *data++;
+	}
+
+	previous += getBits(width);
+	index++;
+
+	if ( truncated )
+	{
+		return false;
+	}
+
+	hashToSet = previous;
+
+	return true;
+}
+
+uint64_t PackedHashReader::getBits(int width)
+{
+	if ( width > 32 )
+	{
+		uint64_t low = getBits(32);
+
+		return low | getBits(width - 32) << 32;
+	}
+
+	while ( bitCount < width )
+	{
+		if ( data == end )
+		{
+			truncated = true;
+			return 0;
+		}
+
+		bitBuffer |= uint64_t(*data++) << bitCount;
+		bitCount += 8;
+	}
+
+	uint64_t value = bitBuffer & ((1ull << width) - 1);
+
+	bitBuffer >>= width;
+	bitCount -= width;
+
+	return value;
+}
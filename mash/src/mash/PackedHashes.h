@@ -0,0 +1,56 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#ifndef PackedHashes_h
+#define PackedHashes_h
+
+#include "HashList.h"
+#include <inttypes.h>
+#include <vector>
+
+// Compact encoding of a sorted, distinct hash list: the count (as a varint),
+// then blocks of up to packedHashesBlock gaps (each hash minus the previous,
+// the first from 0), each block a byte giving the bit width of its largest
+// gap followed by the gaps at that width, least significant bit first and
+// padded to a byte.
+//
+static const int packedHashesBlock = 128;
+
+// Returns false, leaving 'packedToSet' empty, if the list is not sorted
+// and distinct, in which case it should be stored as is.
+//
+bool packHashes(const HashList & hashes, std::vector<uint8_t> & packedToSet);
+
+// Decodes packed hashes one at a time, so a reader can stop early (for
+// example at a smaller sketch size) without unpacking the rest.
+//
+class PackedHashReader
+{
+public:
+
+	PackedHashReader(const uint8_t * dataNew, uint64_t sizeNew);
+
+	bool next(uint64_t & hashToSet); // false once done or if the data is short
+	uint64_t size() const {return count;} // (bounded by what the data could hold)
+
+private:
+
+	uint64_t getBits(int width);
+
+	const uint8_t * data;
+	const uint8_t * end;
+
+	uint64_t count;
+	uint64_t index;
+	uint64_t previous;
+	bool truncated;
+
+	int width;
+	uint64_t bitBuffer;
+	int bitCount;
+};
+
+#endif
@@ -0,0 +1,26 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#ifndef RadixSort_h
+#define RadixSort_h
+
+#include <inttypes.h>
+#include <vector>
+
+// Sorts unsigned integer keys (hashes) ascending with an LSD radix sort, 11
+// bits per pass, moving each payload (e.g. a count) with its key. Passes on
+// digits that are the same for every key are skipped, as the high ones often
+// are for min-hashes (all small). Short lists use std::sort instead.
+//
+template <class TypeKey>
+void radixSort(std::vector<TypeKey> & keys);
+
+template <class TypeKey, class TypePayload>
+void radixSort(std::vector<TypeKey> & keys, std::vector<TypePayload> & payloads);
+
+#include "RadixSort.hxx"
+
+#endif
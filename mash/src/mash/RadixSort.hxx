@@ -0,0 +1,145 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#include "RadixSort.h"
+#include <algorithm>
+#include <numeric>
+#include <string.h>
+
+static const size_t radixSortMinimum = 256; // (below this, std::sort is faster)
+static const int radixBits = 11; // per pass (6 passes for 64-bit keys, 3 for 32-bit)
+static const int radixBuckets = 1 << radixBits;
+
+template <class TypeKey>
+inline int radixPasses() {return (sizeof(TypeKey) * 8 + radixBits - 1) / radixBits;}
+
+// Counts every digit of every key in one read of the keys, giving bucket
+// offsets for each pass and whether the pass is needed.
+//
+template <class TypeKey>
+void radixHistograms(const std::vector<TypeKey> & keys, std::vector<uint64_t> & offsetsToSet, std::vector<bool> & passesToSet)
+{
+	const int passes = radixPasses<TypeKey>();
+
+	offsetsToSet.assign(passes * radixBuckets, 0);
+	passesToSet.assign(passes, false);
+
+	for ( size_t i = 0; i < keys.size(); i++ )
+	{
+		TypeKey key = keys[i];
+
+		for ( int p = 0; p < passes; p++ )
+		{
+			offsetsToSet[p * radixBuckets + ((key >> (p * radixBits)) & (radixBuckets - 1))]++;
+		}
+	}
+
+	for ( int p = 0; p < passes; p++ )
+	{
+		uint64_t * offsets = offsetsToSet.data() + p * radixBuckets;
+		uint64_t sum = 0;
+
+		// needed unless every key has the same digit here
+
+		passesToSet[p] = std::find(offsets, offsets + radixBuckets, keys.size()) == offsets + radixBuckets;
+
+		for ( int d = 0; d < radixBuckets; d++ )
+		{
+			uint64_t count = offsets[d];
+			offsets[d] = sum;
+			sum += count;
+		}
+	}
+}
+
+template <class TypeKey>
+void radixSort(std::vector<TypeKey> & keys)
+{
+	if ( keys.size() < radixSortMinimum )
+	{
+		std::sort(keys.begin(), keys.end());
+		return;
+	}
+
+	std::vector<uint64_t> offsets;
+	std::vector<bool> passes;
+
+	radixHistograms(keys, offsets, passes);
+
+	std::vector<TypeKey> buffer(keys.size());
+
+	for ( int p = 0; p < radixPasses<TypeKey>(); p++ )
+	{
+		if ( ! passes[p] )
+		{
+			continue;
+		}
+
+		uint64_t * offsetsPass = offsets.data() + p * radixBuckets;
+
+		for ( size_t i = 0; i < keys.size(); i++ )
+		{
+			buffer[offsetsPass[(keys[i] >> (p * radixBits)) & (radixBuckets - 1)]++] = keys[i];
+		}
+
+		keys.swap(buffer);
+	}
+}
+
+template <class TypeKey, class TypePayload>
+void radixSort(std::vector<TypeKey> & keys, std::vector<TypePayload> & payloads)
+{
+	if ( keys.size() < radixSortMinimum )
+	{
+		// sort an index, then gather
+
+		std::vector<uint32_t> order(keys.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {return keys[a] < keys[b];});
+
+		std::vector<TypeKey> keysSorted(keys.size());
+		std::vector<TypePayload> payloadsSorted(keys.size());
+
+		for ( size_t i = 0; i < order.size(); i++ )
+		{
+			keysSorted[i] = keys[order[i]];
+			payloadsSorted[i] = payloads[order[i]];
+		}
+
+		keys.swap(keysSorted);
+		payloads.swap(payloadsSorted);
+		return;
+	}
+
+	std::vector<uint64_t> offsets;
+	std::vector<bool> passes;
+
+	radixHistograms(keys, offsets, passes);
+
+	std::vector<TypeKey> buffer(keys.size());
+	std::vector<TypePayload> bufferPayloads(keys.size());
+
+	for ( int p = 0; p < radixPasses<TypeKey>(); p++ )
+	{
+		if ( ! passes[p] )
+		{
+			continue;
+		}
+
+		uint64_t * offsetsPass = offsets.data() + p * radixBuckets;
+
+		for ( size_t i = 0; i < keys.size(); i++ )
+		{
+			uint64_t position = offsetsPass[(keys[i] >> (p * radixBits)) & (radixBuckets - 1)]++;
+
+			buffer[position] = keys[i];
+			bufferPayloads[position] = payloads[i];
+		}
+
+		keys.swap(buffer);
+		payloads.swap(bufferPayloads);
+	}
+}
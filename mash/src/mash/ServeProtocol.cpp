@@ -0,0 +1,540 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#include "ServeProtocol.h"
+#include "kseq.h"
+#include <algorithm>
+#include <errno.h>
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <zlib.h>
+
+using namespace::std;
+
+KSEQ_INIT(gzFile, gzread)
+
+namespace mash {
+
+void ServeMessage::putString(const string & value)
+{
+	putInteger(value.length());
+	data.append(value);
+}
+
+bool ServeMessage::getByte(uint8_t & valueToSet)
+{
+	return getData(&valueToSet, sizeof(uint8_t));
+}
+
+bool ServeMessage::getDouble(double & valueToSet)
+{
+	return getData(&valueToSet, sizeof(double));
+}
+
+bool ServeMessage::getInteger(uint64_t & valueToSet)
+{
+	return getData(&valueToSet, sizeof(uint64_t));
+}
+
+bool ServeMessage::getString(string & valueToSet)
+{
+	uint64_t length;
+
+	if ( ! getInteger(length) || length > data.length() - position )
+	{
+		return false;
+	}
+
+	valueToSet.assign(data, position, length);
+	position += length;
+
+	return true;
+}
+
+bool ServeMessage::getData(void * dataToSet, uint64_t size)
+{
+	if ( size > data.length() - position )
+	{
+		return false;
+	}
+
+	memcpy(dataToSet, data.data() + position, size);
+	position += size;
+
+	return true;
+}
+
+bool readAll(int fd, char * buffer, uint64_t size)
+{
+	while ( size > 0 )
+	{
+		ssize_t count = read(fd, buffer, size);
+
+		if ( count < 0 && errno == EINTR )
+		{
+			continue;
+		}
+
+		if ( count <= 0 )
+		{
+			return false;
+		}
+
+		buffer += count;
+		size -= count;
+	}
+
+	return true;
+}
+
+bool writeAll(int fd, const char * buffer, uint64_t size)
+{
+	while ( size > 0 )
+	{
+		ssize_t count = write(fd, buffer, size);
+
+		if ( count < 0 && errno == EINTR )
+		{
+			continue;
+		}
+
+		if ( count <= 0 )
+		{
+			return false;
+		}
+
+		buffer += count;
+		size -= count;
+	}
+
+	return true;
+}
+
+bool readFrame(int fd, string & payloadToSet)
+{
+	uint64_t length;
+
+	if ( ! readAll(fd, (char *)&length, sizeof(uint64_t)) )
+	{
+		return false;
+	}
+
+	if ( length > serveFrameMax )
+	{
+		return false;
+	}
+
+	// grow with the data that actually arrives, rather than trusting the
+	// length with one allocation
+
+	payloadToSet.clear();
+
+	while ( payloadToSet.length() < length )
+	{
+		uint64_t offset = payloadToSet.length();
+		uint64_t size = min(length - offset, max(offset, serveChunkSize));
+
+		payloadToSet.resize(offset + size);
+
+		if ( ! readAll(fd, &payloadToSet[offset], size) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool writeFrame(int fd, const string & payload)
+{
+	uint64_t length = payload.length();
+
+	return writeAll(fd, (const char *)&length, sizeof(uint64_t)) && writeAll(fd, payload.data(), length);
+}
+
+void putParameters(ServeMessage & message, const Sketch & sketch)
+{
+	string alphabet;
+	sketch.getAlphabetAsString(alphabet);
+
+	message.putInteger(sketch.getKmerSize());
+	message.putString(alphabet);
+	message.putByte(sketch.getPreserveCase());
+	message.putByte(sketch.getUse64());
+	message.putInteger(sketch.getHashSeed());
+	message.putInteger(sketch.getMinHashesPerWindow());
+	message.putByte(sketch.getNoncanonical());
+	message.putInteger(sketch.getReferenceCount());
+	message.putByte(sketch.getUnicode());
+	message.putByte(sketch.getFingerprintWhole());
+	message.putByte(sketch.getHashScheme());
+	message.putInteger(sketch.getScale());
+}
+
+bool getParameters(ServeMessage & message, Sketch::Parameters & parametersToSet)
+{
+	uint64_t kmerSize;
+	string alphabet;
+	uint8_t preserveCase;
+	uint8_t use64;
+	uint64_t seed;
+	uint64_t minHashesPerWindow;
+	uint8_t noncanonical;
+	uint64_t referenceCount;
+	uint8_t unicode;
+	uint8_t fingerprintWhole;
+	uint8_t hashScheme;
+	uint64_t scale;
+
+	if
+	(
+		! message.getInteger(kmerSize) ||
+		! message.getString(alphabet) ||
+		! message.getByte(preserveCase) ||
+		! message.getByte(use64) ||
+		! message.getInteger(seed) ||
+		! message.getInteger(minHashesPerWindow) ||
+		! message.getByte(noncanonical) ||
+		! message.getInteger(referenceCount) ||
+		! message.getByte(unicode) ||
+		! message.getByte(fingerprintWhole) ||
+		! message.getByte(hashScheme) ||
+		! message.getInteger(scale)
+	)
+	{
+		return false;
+	}
+
+	parametersToSet.kmerSize = kmerSize;
+	parametersToSet.preserveCase = preserveCase;
+	parametersToSet.use64 = use64;
+	parametersToSet.seed = seed;
+	parametersToSet.minHashesPerWindow = minHashesPerWindow;
+	parametersToSet.noncanonical = noncanonical;
+	parametersToSet.fingerprintWhole = fingerprintWhole;
+	parametersToSet.hashScheme = hashScheme;
+	parametersToSet.scale = scale;
+
+	if ( unicode )
+	{
+		setAlphabetUnicode(parametersToSet);
+	}
+	else
+	{
+		setAlphabetFromString(parametersToSet, alphabet.c_str());
+	}
+
+	return true;
+}
+
+void putReferences(ServeMessage & message, const Sketch & sketch)
+{
+	message.putInteger(sketch.getReferenceCount());
+
+	for ( uint64_t i = 0; i < sketch.getReferenceCount(); i++ )
+	{
+		const Sketch::Reference & reference = sketch.getReference(i);
+		const HashList & hashes = reference.hashesSorted;
+
+		message.putString(reference.name);
+		message.putString(reference.comment);
+		message.putInteger(reference.length);
+		message.putInteger(hashes.size());
+
+		if ( hashes.get64() )
+		{
+			message.data.append((const char *)hashes.data64(), hashes.size() * sizeof(uint64_t));
+		}
+		else
+		{
+			message.data.append((const char *)hashes.data32(), hashes.size() * sizeof(uint32_t));
+		}
+	}
+}
+
+bool getReferences(ServeMessage & message, bool use64, vector<Sketch::Reference> & referencesToSet)
+{
+	uint64_t count;
+
+	// (each reference takes at least its four integers)
+
+	if ( ! message.getInteger(count) || count > message.getRemaining() / (4 * sizeof(uint64_t)) )
+	{
+		return false;
+	}
+
+	referencesToSet.resize(count);
+
+	for ( uint64_t i = 0; i < count; i++ )
+	{
+		Sketch::Reference & reference = referencesToSet[i];
+		uint64_t hashCount;
+
+		if
+		(
+			! message.getString(reference.name) ||
+			! message.getString(reference.comment) ||
+			! message.getInteger(reference.length) ||
+			! message.getInteger(hashCount) ||
+			hashCount > message.getRemaining() / (use64 ? sizeof(uint64_t) : sizeof(uint32_t))
+		)
+		{
+			return false;
+		}
+
+		reference.id = reference.name;
+		reference.countsSorted = false;
+		reference.hashesSorted.setUse64(use64);
+		reference.hashesSorted.resize(hashCount);
+
+		if ( use64 )
+		{
+			vector<uint64_t> hashes(hashCount);
+
+			if ( ! message.getData(hashes.data(), hashCount * sizeof(uint64_t)) )
+			{
+				return false;
+			}
+
+			for ( uint64_t j = 0; j < hashCount; j++ )
+			{
+				reference.hashesSorted.set64(j, hashes[j]);
+			}
+		}
+		else
+		{
+			vector<uint32_t> hashes(hashCount);
+
+			if ( ! message.getData(hashes.data(), hashCount * sizeof(uint32_t)) )
+			{
+				return false;
+			}
+
+			for ( uint64_t j = 0; j < hashCount; j++ )
+			{
+				reference.hashesSorted.set32(j, hashes[j]);
+			}
+		}
+	}
+
+	return true;
+}
+
+int connectServer(const string & socketPath)
+{
+	struct sockaddr_un address;
+
+	if ( socketPath.length() >= sizeof(address.sun_path) )
+	{
+		cerr << "ERROR: The socket path " << socketPath << " is too long." << endl;
+		return -1;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socketPath.c_str());
+
+	if ( fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0 )
+	{
+		cerr << "ERROR: Could not connect to a server at " << socketPath << " (start one with \"mash serve\")." << endl;
+
+		if ( fd >= 0 )
+		{
+			close(fd);
+		}
+
+		return -1;
+	}
+
+	return fd;
+}
+
+bool exchange(int fd, const string & payload, ServeMessage & responseToSet)
+{
+	if ( ! writeFrame(fd, payload) || ! readFrame(fd, responseToSet.data) )
+	{
+		cerr << "ERROR: Lost connection to the server." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool getResponse(int fd, ServeMessage & response)
+{
+	uint8_t status;
+	string output;
+
+	if ( ! readFrame(fd, response.data) )
+	{
+		cerr << "ERROR: Lost connection to the server." << endl;
+		return false;
+	}
+
+	if ( ! response.getByte(status) || ! response.getString(output) )
+	{
+		cerr << "ERROR: Bad response from the server." << endl;
+		return false;
+	}
+
+	if ( status != ServeOk )
+	{
+		cerr << "ERROR: " << output << endl;
+		return false;
+	}
+
+	fwrite(output.data(), 1, output.size(), stdout);
+
+	return true;
+}
+
+int runServerQuery(const string & socket, ServeMessage & request, const vector<string> & queryFiles, bool fingerprint, bool contain, int threads)
+{
+	int fd = connectServer(socket);
+
+	if ( fd < 0 )
+	{
+		return 1;
+	}
+
+	// sketch the queries to match the database
+
+	ServeMessage requestParameters;
+	ServeMessage responseParameters;
+	Sketch::Parameters parameters;
+
+	requestParameters.putByte(ServeParameters);
+
+	if ( ! exchange(fd, requestParameters.data, responseParameters) )
+	{
+		close(fd);
+		return 1;
+	}
+
+	if ( ! getParameters(responseParameters, parameters) )
+	{
+		cerr << "ERROR: Bad response from the server." << endl;
+		close(fd);
+		return 1;
+	}
+
+	parameters.parallelism = threads;
+
+	Sketch sketchQuery;
+
+	if ( fingerprint && ! hasSuffix(queryFiles[0], suffixSketch) )
+	{
+		sketchQuery.initFromFingerprints(queryFiles, parameters);
+	}
+	else
+	{
+		sketchQuery.initFromFiles(queryFiles, parameters, 0, true, contain);
+	}
+
+	putReferences(request, sketchQuery);
+
+	ServeMessage response;
+
+	if ( ! writeFrame(fd, request.data) )
+	{
+		cerr << "ERROR: Lost connection to the server." << endl;
+		close(fd);
+		return 1;
+	}
+
+	bool success = getResponse(fd, response);
+
+	close(fd);
+
+	return success ? 0 : 1;
+}
+
+int runServerScreen(const string & socket, ServeMessage & request, const vector<string> & mixtureFiles)
+{
+	for ( int i = 1; i < mixtureFiles.size(); i++ )
+	{
+		if ( mixtureFiles[i] == "-" )
+		{
+			cerr << "ERROR: '-' for stdin must be the first mixture." << endl;
+			return 1;
+		}
+	}
+
+	int fd = connectServer(socket);
+
+	if ( fd < 0 )
+	{
+		return 1;
+	}
+
+	bool connected = writeFrame(fd, request.data);
+	ServeMessage chunk;
+
+	for ( int i = 0; i < mixtureFiles.size() && connected; i++ )
+	{
+		gzFile file = mixtureFiles[i] == "-" ? gzdopen(fileno(stdin), "r") : gzopen(mixtureFiles[i].c_str(), "r");
+
+		if ( file == 0 )
+		{
+			cerr << "ERROR: could not open " << mixtureFiles[i] << endl;
+			close(fd);
+			return 1;
+		}
+
+		kseq_t * seq = kseq_init(file);
+		int l;
+
+		while ( connected && (l = kseq_read(seq)) >= 0 )
+		{
+			chunk.putString(string(seq->seq.s, l));
+
+			if ( chunk.data.length() >= serveChunkSize )
+			{
+				connected = writeFrame(fd, chunk.data);
+				chunk.data.clear();
+			}
+		}
+
+		kseq_destroy(seq);
+		gzclose(file);
+
+		if ( connected && l < -1 )
+		{
+			cerr << "ERROR: reading " << mixtureFiles[i] << endl;
+			close(fd);
+			return 1;
+		}
+	}
+
+	// the rest, then an empty frame to end the mixture
+
+	if ( connected && ! chunk.data.empty() )
+	{
+		connected = writeFrame(fd, chunk.data);
+	}
+
+	if ( ! connected || ! writeFrame(fd, string()) )
+	{
+		cerr << "ERROR: Lost connection to the server." << endl;
+		close(fd);
+		return 1;
+	}
+
+	ServeMessage response;
+	bool success = getResponse(fd, response);
+
+	close(fd);
+
+	return success ? 0 : 1;
+}
+
+} // namespace mash
@@ -0,0 +1,95 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#ifndef INCLUDED_ServeProtocol
+#define INCLUDED_ServeProtocol
+
+#include "Sketch.h"
+#include <string>
+#include <vector>
+
+namespace mash {
+
+// Protocol between "mash serve" and the dist, screen and contain commands
+// when they are given --server. Messages are framed as a 64-bit payload
+// length followed by the payload, in host byte order (the socket is local).
+//
+// A request payload is a type byte followed by its fields. ServeParameters
+// has none, and is answered with the sketching parameters of the database so
+// the client can sketch its queries to match. Query requests carry their
+// options and then the query sketches (see putReferences()), and are answered
+// with a status byte and either the output, formatted as the command would
+// have written it, or an error message.
+//
+// ServeScreen is followed by the mixture itself rather than a sketch of it,
+// since screening counts every k-mer: frames of sequences (see
+// putString()), of about serveChunkSize bytes each, ended by an empty frame.
+//
+enum ServeRequest
+{
+	ServeParameters = 'P',
+	ServeDistance = 'D',
+	ServeScreen = 'S',
+	ServeContain = 'C'
+};
+
+enum ServeStatus
+{
+	ServeOk = 0,
+	ServeError = 1
+};
+
+static const char * serveSocketDefault = "mash.sock";
+static const uint64_t serveChunkSize = 1 << 20;
+static const uint64_t serveFrameMax = 1ull << 32; // (longer frames are refused)
+
+class ServeMessage
+{
+public:
+
+	ServeMessage() : position(0) {}
+
+	void putByte(uint8_t value) {data.push_back(value);}
+	void putDouble(double value) {data.append((const char *)&value, sizeof(double));}
+	void putInteger(uint64_t value) {data.append((const char *)&value, sizeof(uint64_t));}
+	void putString(const std::string & value);
+
+	bool getByte(uint8_t & valueToSet);
+	bool getData(void * dataToSet, uint64_t size);
+	bool getDouble(double & valueToSet);
+	bool getInteger(uint64_t & valueToSet);
+	bool getString(std::string & valueToSet);
+	uint64_t getRemaining() const {return data.length() - position;}
+
+	std::string data;
+
+private:
+
+	uint64_t position;
+};
+
+bool readFrame(int fd, std::string & payloadToSet);
+bool writeFrame(int fd, const std::string & payload);
+
+void putParameters(ServeMessage & message, const Sketch & sketch);
+bool getParameters(ServeMessage & message, Sketch::Parameters & parametersToSet);
+void putReferences(ServeMessage & message, const Sketch & sketch);
+bool getReferences(ServeMessage & message, bool use64, std::vector<Sketch::Reference> & referencesToSet);
+
+// Sketches the query files with the parameters of the server's database,
+// sends them with the request fields already in 'request' and writes the
+// output to stdout. Returns an exit code for the command.
+//
+int runServerQuery(const std::string & socket, ServeMessage & request, const std::vector<std::string> & queryFiles, bool fingerprint, bool contain, int threads);
+
+// Sends the request fields already in 'request', followed by the sequences of
+// the mixture files ("-" for stdin), and writes the output to stdout.
+//
+int runServerScreen(const std::string & socket, ServeMessage & request, const std::vector<std::string> & mixtureFiles);
+
+} // namespace mash
+
+#endif
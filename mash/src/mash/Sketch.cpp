@@ -12,15 +12,18 @@
 #include <fcntl.h>
 #include <map>
 #include "kseq.h"
+#include "MinHashWindow.h"
+#include "PackedHashes.h"
+#include "SketchDatabase.h"
+#include "Stats.h"
 #include "MurmurHash3.h"
 #include <assert.h>
-#include <queue>
-#include <deque>
 #include <set>
 #include "Command.h" // TEMP for column printing
 #include <sys/stat.h>
 #include <capnp/message.h>
 #include <capnp/serialize.h>
+#include <kj/exception.h>
 #include <sys/mman.h>
 #include <math.h>
 #include <list>
@@ -28,13 +31,13 @@
 #include <fstream>
 #include <sstream>
 #include <numeric>
+#include <algorithm>
 
 
 
 
 #define SET_BINARY_MODE(file)
 #define CHUNK 16384
-#define LIMIT_READ_FINGERPRINT 1000000
 KSEQ_INIT(gzFile, gzread)
 
 using namespace std;
@@ -43,6 +46,12 @@ typedef map < Sketch::hash_t, vector<Sketch::PositionHash> > LociByHash_map;
 
 void Sketch::getAlphabetAsString(string & alphabet) const
 {
+	if ( parameters.unicode )
+	{
+		alphabet = alphabetUnicode;
+		return;
+	}
+	
 	for ( int i = 0; i < 256; i++ )
 	{
 		if ( parameters.alphabet[i] )
@@ -53,108 +62,404 @@ void Sketch::getAlphabetAsString(string & alphabet) const
 }
 
 
-void Sketch::initFromFingerprints(const vector<string> &files, const Parameters &parametersNew)
+// A batch of fingerprint lines, hashed by hashFingerprints() (in a worker
+// thread if there are several) for each sketch being made.
+//
+struct FingerprintBatch
 {
-    parameters = parametersNew;
+    FingerprintBatch(const vector<Sketch *> & sketchesNew) : sketches(sketchesNew) {}
     
-    int counterLine = 0;
-    robin_hood::unordered_set<string> processedIDs; // Usare unordered_set per ID unici
-                                                     // Vettore per memorizzare le reference finali
-    string lastID = ""; // Memorizza l'ultimo ID letto
+    const vector<Sketch *> & sketches;
+    
+    vector<string> ids;
+    vector<uint64_t> numbers; // of all lines
+    vector<uint64_t> segmentEnds; // (in numbers)
+    vector<uint64_t> lineEnds; // (in segmentEnds)
+};
 
-    cout << "Initializing from fingerprints..." << endl;
+struct FingerprintHashes
+{
+    vector<string> ids;
+    vector<vector<hash_u>> hashes; // of all lines, for each sketch
+    vector<vector<uint64_t>> lineEnds; // (in hashes)
+};
 
-    for (const string &file : files)
+// Parses a fingerprint line: an ID, then numbers separated by whitespace, in
+// segments separated by '|' (as written for split fingerprints). Parsing stops
+// at anything else, as istream extraction would. Returns the segment count.
+//
+uint64_t parseFingerprintLine(const char * line, const char * end, string & idToSet, vector<uint64_t> & numbersToAppend, vector<uint64_t> & segmentEndsToAppend)
+{
+    const char * position = line;
+    uint64_t segments = 0;
+    
+    while ( position < end && isspace(*position) )
     {
-        cout << "Processing file: " << file << endl;
-
-        ifstream inputFile(file);
-
-        if (!inputFile)
+        position++;
+    }
+    
+    const char * idStart = position;
+    
+    while ( position < end && ! isspace(*position) )
+    {
+        position++;
+    }
+    
+    idToSet.assign(idStart, position - idStart);
+    
+    while ( true )
+    {
+        while ( position < end && isspace(*position) )
         {
-            cerr << "ERROR: Could not open fingerprint file " << file << " for reading." << endl;
-            exit(1);
+            position++;
         }
-
-        string line;
-        Reference* currentReference = nullptr; // Puntatore alla reference corrente
-
-        while (getline(inputFile, line) && counterLine < LIMIT_READ_FINGERPRINT)
+        
+        if ( position < end && *position == '|' )
+        {
+            segmentEndsToAppend.push_back(numbersToAppend.size());
+            segments++;
+            position++;
+            continue;
+        }
+        
+        if ( position == end || *position < '0' || *position > '9' )
+        {
+            break;
+        }
+        
+        uint64_t number = 0;
+        
+        while ( position < end && *position >= '0' && *position <= '9' )
         {
-            //cout << "Reading line: " << counterLine + 1 << endl;
-            counterLine++;
+            number = number * 10 + (*position - '0');
+            position++;
+        }
+        
+        numbersToAppend.push_back(number);
+    }
+    
+    segmentEndsToAppend.push_back(numbersToAppend.size());
+    
+    return segments + 1;
+}
 
-            vector<uint64_t> fingerprint;
+inline hash_u hashFingerprint(const uint64_t * numbers, uint64_t count, const Sketch::Parameters & parameters)
+{
+    if ( parameters.hashScheme == hashSchemePackedKeys )
+    {
+        return getHashFingerPrintPacked(numbers, count, parameters.seed, parameters.use64);
+    }
+    
+    return getHashFingerPrint(numbers, count * sizeof(uint64_t), parameters.seed, parameters.use64);
+}
 
-            istringstream ss(line);
+FingerprintHashes * hashFingerprints(FingerprintBatch * input)
+{
+    // With a k-finger size (-k), each line is a whole fingerprint whose
+    // segments are cut into k-fingers (spanning segments if fingerprintAcross);
+    // otherwise (fingerprintWhole) each line is one k-finger.
+    
+    FingerprintHashes * output = new FingerprintHashes();
+    
+    output->ids.swap(input->ids);
+    output->hashes.resize(input->sketches.size());
+    output->lineEnds.resize(input->sketches.size());
+    
+    for ( int s = 0; s < input->sketches.size(); s++ )
+    {
+        const Sketch::Parameters & parameters = input->sketches[s]->getParameters();
+        uint64_t k = parameters.fingerprintWhole ? 0 : parameters.kmerSize;
+        
+        vector<hash_u> & hashes = output->hashes[s];
+        vector<uint64_t> & lineEnds = output->lineEnds[s];
+        
+        hashes.reserve(input->numbers.size());
+        
+        uint64_t segment = 0;
+        uint64_t start = 0;
+        
+        for ( uint64_t i = 0; i < input->lineEnds.size(); i++ )
+        {
+            for ( ; segment < input->lineEnds[i]; segment++ )
+            {
+                uint64_t end = input->segmentEnds[segment];
+                
+                if ( parameters.fingerprintAcross && segment + 1 < input->lineEnds[i] )
+                {
+                    continue;
+                }
+                
+                if ( k == 0 )
+                {
+                    hashes.push_back(hashFingerprint(input->numbers.data() + start, end - start, parameters));
+                }
+                else
+                {
+                    for ( uint64_t j = start; j + k <= end; j++ )
+                    {
+                        hashes.push_back(hashFingerprint(input->numbers.data() + j, k, parameters));
+                    }
+                }
+                
+                start = end;
+            }
             
-            uint64_t number;
-            string id;
-            ss >> id;
+            lineEnds.push_back(hashes.size());
+        }
+    }
+    
+    return output;
+}
 
-            //cout << "Processing ID: " << id << endl;
+void Sketch::initFromFingerprints(const vector<string> &files, const Parameters &parametersNew)
+{
+    initFromFingerprints(vector<Sketch *>(1, this), files, parametersNew, vector<int>(1, parametersNew.kmerSize));
+}
 
-            while (ss >> number)
+void Sketch::initFromFingerprints(const vector<Sketch *> & sketches, const vector<string> &files, const Parameters &parametersNew, const vector<int> & kmerSizes)
+{
+    // Input is read in fixed-size chunks and parsed in place into batches of
+    // lines, which are hashed (by the thread pool, in order) and fed to the
+    // heap of their ID. A heap is turned into a reference as soon as the ID
+    // changes, so memory holds a few chunks and batches, one heap and the
+    // finished (bounded) sketches, however large the input is. Lines of the
+    // same ID must be consecutive. Each k-finger size gets its own sketch
+    // (and heaps), sharing the reading and parsing.
+    
+    static const uint64_t chunkSize = 1 << 20;
+    static const uint64_t batchSize = 1 << 16; // (numbers)
+    
+    const Parameters & parameters = parametersNew;
+    bool split = false; // (lines are cut into k-fingers for some sketch)
+    
+    for (int s = 0; s < sketches.size(); s++)
+    {
+        Parameters & parametersSketch = sketches[s]->parameters;
+        
+        parametersSketch = parametersNew;
+        
+        if (kmerSizes[s] != parametersNew.kmerSize)
+        {
+            parametersSketch.kmerSize = kmerSizes[s];
+            parametersSketch.fingerprintWhole = false;
+            parametersSketch.use64 = pow(parametersSketch.alphabetSize, parametersSketch.kmerSize) > pow(2, 32);
+        }
+        
+        split = split || !parametersSketch.fingerprintWhole;
+    }
+    
+    StatsPhase phase(Stats::Sketch);
+    
+    uint64_t counterLine = 0;
+    uint64_t counterHash = 0;
+    uint64_t bytes = 0;
+    
+    vector<char> chunk(chunkSize);
+    string lineSpanning; // start of a line cut off by the end of a chunk
+    string id;
+    
+    ThreadPool<FingerprintBatch, FingerprintHashes> threadPool(hashFingerprints, parameters.parallelism);
+    FingerprintBatch * batch = new FingerprintBatch(sketches);
+    
+    // Reference corrente di ogni sketch, con il suo bottom-k (come per le sequenze)
+    vector<Reference> referencesCurrent(sketches.size());
+    vector<MinHashHeap *> minHashHeaps(sketches.size(), nullptr);
+    
+    auto finishReference = [&](int s)
+    {
+        if (minHashHeaps[s] != nullptr)
+        {
+            setMinHashesForReference(referencesCurrent[s], *minHashHeaps[s]);
+            sketches[s]->references.push_back(std::move(referencesCurrent[s]));
+            delete minHashHeaps[s];
+            minHashHeaps[s] = nullptr;
+        }
+    };
+    
+    auto useHashes = [&](FingerprintHashes * output)
+    {
+        for (int s = 0; s < sketches.size(); s++)
+        {
+            const Parameters & parametersSketch = sketches[s]->parameters;
+            Reference & reference = referencesCurrent[s];
+            const vector<uint64_t> & lineEnds = output->lineEnds[s];
+            uint64_t start = 0;
+            
+            for (uint64_t i = 0; i < output->ids.size(); i++)
             {
-                fingerprint.push_back(number);
-                if (ss.peek() == ' ') ss.ignore();
+                // Nuovo ID (o nuovo file): nuova reference
+                if (minHashHeaps[s] == nullptr || output->ids[i] != reference.id)
+                {
+                    finishReference(s);
+                    
+                    reference = Reference();
+                    minHashHeaps[s] = new MinHashHeap(parametersSketch.use64, parametersSketch.minHashesPerWindow, 1, 0, getHashMaximum(parametersSketch));
+                    reference.id = output->ids[i];
+                    reference.length = 0; // Numero di k-finger della reference
+                    reference.name = reference.id;
+                    reference.comment = "FingerPrint : " + reference.id;
+                    reference.hashesSorted.setUse64(parametersSketch.use64);
+                }
+                
+                for (uint64_t j = start; j < lineEnds[i]; j++)
+                {
+                    minHashHeaps[s]->tryInsert(output->hashes[s][j]);
+                }
+                
+                reference.length += lineEnds[i] - start;
+                start = lineEnds[i];
             }
-
-            // Verifica se l'ID è diverso dall'ultimo ID
-            if (id != lastID)
+            
+            counterHash += output->hashes[s].size();
+        }
+        
+        delete output;
+    };
+    
+    auto runBatch = [&]()
+    {
+        if (batch->ids.size() == 0)
+        {
+            return;
+        }
+        
+        threadPool.runWhenThreadAvailable(batch);
+        batch = new FingerprintBatch(sketches);
+        
+        while (threadPool.outputAvailable())
+        {
+            useHashes(threadPool.popOutputWhenAvailable());
+        }
+    };
+    
+    auto addLine = [&](const char * line, const char * end, const string & file)
+    {
+        counterLine++;
+        bytes += end - line + 1;
+        
+        if (parseFingerprintLine(line, end, id, batch->numbers, batch->segmentEnds) > 1 && !split)
+        {
+            cerr << "ERROR: The fingerprint file " << file << " has split fingerprints ('|' at line " << counterLine << "); give a k-finger size (-k) to cut them into k-fingers." << endl;
+            exit(1);
+        }
+        
+        batch->ids.push_back(id);
+        batch->lineEnds.push_back(batch->segmentEnds.size());
+        
+        if (batch->numbers.size() >= batchSize)
+        {
+            runBatch();
+        }
+    };
+    
+    cout << "Initializing from fingerprints..." << endl;
+    
+    for (const string &file : files)
+    {
+        cout << "Processing file: " << file << endl;
+        
+        FILE * inputFile = fopen(file.c_str(), "r");
+        
+        if (inputFile == NULL)
+        {
+            cerr << "ERROR: Could not open fingerprint file " << file << " for reading." << endl;
+            exit(1);
+        }
+        
+        lineSpanning.clear();
+        
+        size_t length;
+        
+        while ((length = fread(chunk.data(), 1, chunkSize, inputFile)) > 0)
+        {
+            const char * position = chunk.data();
+            const char * end = position + length;
+            
+            while (position < end)
             {
-                // Nuovo ID, crea una nuova reference
-                if (currentReference != nullptr)
+                const char * newline = (const char *)memchr(position, '\n', end - position);
+                
+                if (newline == nullptr)
                 {
-                    //cout << "Adding reference for ID: " << lastID << endl;
-                    // Aggiungi la reference al vettore
-                    references.push_back(*currentReference);
-                    delete currentReference;
+                    lineSpanning.append(position, end - position);
+                    break;
                 }
-
-                currentReference = new Reference;
-                currentReference->id = id; // Assegna l'ID estratto alla struttura Reference
-                currentReference->length = fingerprint.size(); // Numero di elementi nel fingerprint
-                currentReference->name = ""+id;
-                currentReference->comment = "FingerPrint : " + currentReference->id;
-                currentReference->hashesSorted.setUse64(parameters.use64);
-
-                // Aggiungi l'ID al set di ID processati
-                processedIDs.insert(id);
-
-                // Aggiorna l'ultimo ID
-                lastID = id;
-
-                //cout << "Created new reference for ID: " << id << endl;
+                
+                if (lineSpanning.length())
+                {
+                    lineSpanning.append(position, newline - position);
+                    addLine(lineSpanning.data(), lineSpanning.data() + lineSpanning.length(), file);
+                    lineSpanning.clear();
+                }
+                else
+                {
+                    addLine(position, newline, file);
+                }
+                
+                position = newline + 1;
             }
-
-            // Calcola Hash in base64 
-            hash_u hash = getHashFingerPrint(fingerprint, fingerprint.size() * sizeof(uint64_t), parameters.seed, parameters.use64);
-            currentReference->hashesSorted.add(hash); // Usa il metodo add
-            currentReference->length = currentReference->length+fingerprint.size();
-
-            //cout << "Added hash for ID: " << id << endl;
         }
-
-        if (currentReference != nullptr)
+        
+        if (ferror(inputFile))
+        {
+            cerr << "ERROR: Could not read fingerprint file " << file << "." << endl;
+            exit(1);
+        }
+        
+        fclose(inputFile);
+        
+        if (lineSpanning.length())
         {
-            //cout << "Adding last reference for file: " << file << endl;
-            // Aggiungi l'ultima reference processata al vettore
-            references.push_back(*currentReference);
-            delete currentReference;
+            // last line, without a newline
+            addLine(lineSpanning.data(), lineSpanning.data() + lineSpanning.length(), file);
+            bytes--;
+        }
+        
+        // Le reference non continuano tra un file e l'altro
+        runBatch();
+        
+        while (threadPool.running())
+        {
+            useHashes(threadPool.popOutputWhenAvailable());
+        }
+        
+        for (int s = 0; s < sketches.size(); s++)
+        {
+            finishReference(s);
         }
     }
-
-    //cout << "Creating index..." << endl;
-    createIndex();
+    
+    delete batch;
+    
+    Stats::add(Stats::BytesRead, bytes);
+    Stats::add(Stats::RecordsRead, counterLine);
+    Stats::add(Stats::KmersHashed, counterHash);
+    
+    for (int s = 0; s < sketches.size(); s++)
+    {
+        sketches[s]->createIndex();
+    }
+    
     cout << "Initialization complete." << endl;
 }
     
 
 
-const vector<Sketch::Locus> & Sketch::getLociByHash(Sketch::hash_t hash) const
+uint64_t Sketch::getLociByHash(Sketch::hash_t hash, const Sketch::Locus * & lociToSet) const
 {
-    return lociByHash.at(hash);
+    const hash_t * hashes = locusIndex.getHashes();
+    const hash_t * i = lower_bound(hashes, hashes + locusIndex.getHashCount(), hash);
+    
+    if ( i == hashes + locusIndex.getHashCount() || *i != hash )
+    {
+        return 0;
+    }
+    
+    const uint64_t * offsets = locusIndex.getOffsets() + (i - hashes);
+    
+    lociToSet = locusIndex.getLoci() + offsets[0];
+    
+    return offsets[1] - offsets[0];
 }
 
 int Sketch::getMinKmerSize(uint64_t reference) const
@@ -200,10 +505,20 @@ uint64_t Sketch::getReferenceIndex(string id) const
     }
 }
 
+void Sketch::initFromReferences(vector<Reference> & referencesNew, const Parameters & parametersNew)
+{
+    parameters = parametersNew;
+    references.swap(referencesNew);
+    
+    createIndex();
+}
+
 void Sketch::initFromReads(const vector<string> & files, const Parameters & parametersNew)
 {
     parameters = parametersNew;
     
+    StatsPhase phase(Stats::Sketch);
+    
 	useThreadOutput(sketchFile(new SketchInput(files, 0, 0, "", "", parameters)));
 	
     createIndex();
@@ -246,10 +561,27 @@ La funzione initFromFiles è progettata per gestire in modo robusto l'inizializz
 Utilizza un approccio multithread per migliorare le prestazioni durante il caricamento e la costruzione degli sketch. Se un file non rispetta i parametri attesi, viene saltato con un messaggio di avvertimento, garantendo che solo i file compatibili vengano inclusi nel processo di sketching.
  */
 
-int Sketch::initFromFiles(const vector<string> & files, const Parameters & parametersNew, int verbosity, bool enforceParameters, bool contain)
+int Sketch::initFromFiles(const vector<string> & filesNew, const Parameters & parametersNew, int verbosity, bool enforceParameters, bool contain)
 {
     parameters = parametersNew;
     
+    // databases load as their segments, in order
+    //
+    vector<string> files;
+    expandSketchDatabases(filesNew, files);
+    
+    bool loading = true;
+    
+    for ( int i = 0; i < files.size(); i++ )
+    {
+    	if ( ! hasSuffix(files[i], parameters.windowed ? suffixSketchWindowed : suffixSketch) )
+    	{
+    		loading = false;
+    	}
+    }
+    
+    StatsPhase phase(loading ? Stats::Load : Stats::Sketch);
+    
 	ThreadPool<Sketch::SketchInput, Sketch::SketchOutput> threadPool(0, parameters.parallelism);
 	
     for ( int i = 0; i < files.size(); i++ )
@@ -285,6 +617,18 @@ int Sketch::initFromFiles(const vector<string> & files, const Parameters & param
 				cerr << "\nWARNING: The sketch " << files[i] << " has a seed size (" << sketchTest.getHashSeed() << ") that does not match the current seed (" << parameters.seed << "). This file will be skipped." << endl << endl;
 				continue;
             }
+            
+            if ( sketchTest.getHashScheme() != parameters.hashScheme )
+            {
+				cerr << "\nWARNING: The sketch " << files[i] << " was hashed with a different scheme (" << (sketchTest.getHashScheme() == hashSchemePackedKeys ? "packed k-finger keys" : "MurmurHash3") << ") than the current one. This file will be skipped." << endl << endl;
+				continue;
+            }
+            if ( sketchTest.getScale() != parameters.scale )
+            {
+				cerr << "\nWARNING: The sketch " << files[i] << " has a scale (" << sketchTest.getScale() << ") that does not match the current scale (" << parameters.scale << "; 0 is bottom-k). This file will be skipped." << endl << endl;
+				continue;
+            }
+            
 			if ( sketchTest.getKmerSize() != parameters.kmerSize )
 			{
 				cerr << "\nWARNING: The sketch " << files[i] << " has a kmer size (" << sketchTest.getKmerSize() << ") that does not match the current kmer size (" << parameters.kmerSize << "). This file will be skipped." << endl << endl;
@@ -449,8 +793,15 @@ uint64_t Sketch::initParametersFromCapnp(const char * file)
     
     parameters.counts = referencesReader[0].hasCounts32();
    	parameters.seed = reader.getHashSeed();
+   	parameters.hashScheme = reader.getHashScheme();
+   	parameters.scale = reader.getScale();
+   	parameters.fingerprintWhole = reader.getFingerprintWhole() && parameters.kmerSize == 1; // (only whole lines leave k at 1)
     
-    if ( reader.hasAlphabet() )
+    if ( reader.getUnicode() )
+    {
+    	setAlphabetUnicode(parameters);
+    }
+    else if ( reader.hasAlphabet() )
     {
     	setAlphabetFromString(parameters, reader.getAlphabet().cStr());
     }
@@ -523,6 +874,41 @@ bool Sketch::sketchFileBySequence(FILE * file, ThreadPool<Sketch::SketchInput, S
 
 void Sketch::useThreadOutput(SketchOutput * output)
 {
+	if ( references.size() == 0 && output->locusIndex.getHashCount() != 0 )
+	{
+		// a windowed sketch file with an index; use it as is, unless other
+		// inputs follow
+		
+		swap(locusIndex, output->locusIndex);
+	}
+	else
+	{
+		// Sequence indices of an index are relative to its file, so combining
+		// falls back to per-reference loci, which are rebased by position in
+		// positionHashesByReference, and the index is rebuilt (createIndex()).
+		
+		if ( locusIndex.getHashCount() != 0 )
+		{
+			positionHashesByReference.resize(references.size());
+			getPositionHashesFromIndex(positionHashesByReference, locusIndex);
+			locusIndex.clear();
+		}
+		
+		if ( output->locusIndex.getHashCount() != 0 )
+		{
+			output->positionHashesByReference.resize(output->references.size());
+			getPositionHashesFromIndex(output->positionHashesByReference, output->locusIndex);
+		}
+	}
+	
+	if ( locusIndex.getHashCount() == 0 )
+	{
+		// keep loci aligned with their references, whatever each input had
+		
+		positionHashesByReference.resize(references.size());
+		output->positionHashesByReference.resize(output->references.size());
+	}
+	
 	references.insert(references.end(), output->references.begin(), output->references.end());
 	positionHashesByReference.insert(positionHashesByReference.end(), output->positionHashesByReference.begin(), output->positionHashesByReference.end());
 	delete output;
@@ -533,14 +919,39 @@ bool Sketch::writeToFile() const
     return writeToCapnp(file.c_str()) == 0;
 }
 
-int Sketch::writeToCapnp(const char * file) const
+static int writeMessageToFile(capnp::MessageBuilder & message, int fd, const char * file)
+{
+    // A full disk shows up as a Cap'n Proto exception or, for buffered data,
+    // only when closing; either way the caller gets 1 and can remove the file.
+    
+    try
+    {
+        writeMessageToFd(fd, message);
+    }
+    catch ( const kj::Exception & e )
+    {
+        cerr << "ERROR: could not write " << file << ": " << e.getDescription().cStr() << endl;
+        close(fd);
+        return 1;
+    }
+    
+    if ( close(fd) != 0 )
+    {
+        cerr << "ERROR: could not write " << file << "." << endl;
+        return 1;
+    }
+    
+    return 0;
+}
+
+int Sketch::writeToCapnp(const char * file, bool packed) const
 {
     int fd = open(file, O_CREAT | O_WRONLY | O_TRUNC , 0644);
     
     if ( fd < 0 )
     {
         cerr << "ERROR: could not open " << file << " for writing.\n";
-        exit(1);
+        return 1;
     }
     
     capnp::MallocMessageBuilder message;
@@ -557,12 +968,19 @@ int Sketch::writeToCapnp(const char * file) const
         referenceBuilder.setName(references[i].name);
         referenceBuilder.setComment(references[i].comment);
         referenceBuilder.setLength64(references[i].length);
+        referenceBuilder.setKmersDistinct(references[i].kmersDistinct);
+        referenceBuilder.setKmersTotal(references[i].kmersTotal);
         
         if ( references[i].hashesSorted.size() != 0 )
         {
             const HashList & hashes = references[i].hashesSorted;
+            vector<uint8_t> hashesPacked;
             
-            if ( parameters.use64 )
+            if ( packed && packHashes(hashes, hashesPacked) )
+            {
+                memcpy(referenceBuilder.initHashesPacked(hashesPacked.size()).begin(), hashesPacked.data(), hashesPacked.size());
+            }
+            else if ( parameters.use64 )
             {
                 capnp::List<uint64_t>::Builder hashes64Builder = referenceBuilder.initHashes64(hashes.size());
             
@@ -597,31 +1015,55 @@ int Sketch::writeToCapnp(const char * file) const
         }
     }
     
+    // The locus list is kept for readers without locus index support. If the
+    // loci came from an index, recover them per reference.
+    //
+    vector<vector<PositionHash>> positionHashesFromIndex;
+    const vector<vector<PositionHash>> * positionHashes = &positionHashesByReference;
+    
+    if ( positionHashesByReference.size() == 0 && locusIndex.getLociCount() != 0 )
+    {
+        positionHashesFromIndex.resize(references.size());
+        getPositionHashesFromIndex(positionHashesFromIndex, locusIndex);
+        positionHashes = &positionHashesFromIndex;
+    }
+    
     int locusCount = 0;
     
-    for ( int i = 0; i < positionHashesByReference.size(); i++ )
+    for ( int i = 0; i < positionHashes->size(); i++ )
     {
-        locusCount += positionHashesByReference.at(i).size();
+        locusCount += positionHashes->at(i).size();
     }
     
     capnp::MinHash::LocusList::Builder locusListBuilder = builder.initLocusList();
     capnp::List<capnp::MinHash::LocusList::Locus>::Builder lociBuilder = locusListBuilder.initLoci(locusCount);
     
-    int locusIndex = 0;
+    int locusListIndex = 0;
     
-    for ( int i = 0; i < positionHashesByReference.size(); i++ )
+    for ( int i = 0; i < positionHashes->size(); i++ )
     {
-        for ( int j = 0; j < positionHashesByReference.at(i).size(); j++ )
+        for ( int j = 0; j < positionHashes->at(i).size(); j++ )
         {
-            capnp::MinHash::LocusList::Locus::Builder locusBuilder = lociBuilder[locusIndex];
-            locusIndex++;
+            capnp::MinHash::LocusList::Locus::Builder locusBuilder = lociBuilder[locusListIndex];
+            locusListIndex++;
             
             locusBuilder.setSequence(i);
-            locusBuilder.setPosition(positionHashesByReference.at(i).at(j).position);
-            locusBuilder.setHash64(positionHashesByReference.at(i).at(j).hash);
+            locusBuilder.setPosition(positionHashes->at(i).at(j).position);
+            locusBuilder.setHash64(positionHashes->at(i).at(j).hash);
         }
     }
     
+    if ( locusIndex.getLociCount() != 0 )
+    {
+        capnp::MinHash::LocusIndex::Builder locusIndexBuilder = builder.initLocusIndex();
+        uint64_t hashCount = locusIndex.getHashCount();
+        uint64_t lociCount = locusIndex.getLociCount();
+        
+        memcpy(locusIndexBuilder.initHashes(hashCount * sizeof(hash_t)).begin(), locusIndex.getHashes(), hashCount * sizeof(hash_t));
+        memcpy(locusIndexBuilder.initOffsets((hashCount + 1) * sizeof(uint64_t)).begin(), locusIndex.getOffsets(), (hashCount + 1) * sizeof(uint64_t));
+        memcpy(locusIndexBuilder.initLoci(lociCount * sizeof(Locus)).begin(), locusIndex.getLoci(), lociCount * sizeof(Locus));
+    }
+    
     builder.setKmerSize(parameters.kmerSize);
     builder.setHashSeed(parameters.seed);
     builder.setError(parameters.error);
@@ -630,15 +1072,16 @@ int Sketch::writeToCapnp(const char * file) const
     builder.setConcatenated(parameters.concatenated);
     builder.setNoncanonical(parameters.noncanonical);
     builder.setPreserveCase(parameters.preserveCase);
+    builder.setUnicode(parameters.unicode);
+    builder.setHashScheme(parameters.hashScheme);
+    builder.setScale(parameters.scale);
+    builder.setFingerprintWhole(parameters.fingerprintWhole);
     
     string alphabet;
     getAlphabetAsString(alphabet);
     builder.setAlphabet(alphabet);
     
-    writeMessageToFd(fd, message);
-    close(fd);
-    
-    return 0;
+    return writeMessageToFile(message, fd, file);
 }
 
 void Sketch::createIndex()
@@ -648,21 +1091,179 @@ void Sketch::createIndex()
         referenceIndecesById[references[i].id] = i;
     }
     
-    for ( int i = 0; i < positionHashesByReference.size(); i++ )
+    if ( locusIndex.getHashCount() == 0 )
     {
-        for ( int j = 0; j < positionHashesByReference.at(i).size(); j++ )
+        // group loci by hash; sequence and position break ties so the order
+        // within each hash matches the order of the sketch
+        
+        struct HashLocus
         {
-            const PositionHash & positionHash = positionHashesByReference.at(i).at(j);
+            hash_t hash;
+            uint32_t sequence;
+            uint32_t position;
             
-            lociByHash[positionHash.hash].push_back(Locus(i, positionHash.position));
+            bool operator<(const HashLocus & other) const
+            {
+                if ( hash != other.hash )
+                {
+                    return hash < other.hash;
+                }
+                
+                return sequence < other.sequence || ( sequence == other.sequence && position < other.position );
+            }
+        };
+        
+        vector<HashLocus> hashLoci;
+        
+        for ( int i = 0; i < positionHashesByReference.size(); i++ )
+        {
+            for ( int j = 0; j < positionHashesByReference.at(i).size(); j++ )
+            {
+                const PositionHash & positionHash = positionHashesByReference.at(i).at(j);
+                HashLocus hashLocus = {positionHash.hash, (uint32_t)i, positionHash.position};
+                
+                hashLoci.push_back(hashLocus);
+            }
         }
+        
+        sort(hashLoci.begin(), hashLoci.end());
+        
+        vector<hash_t> locusHashes;
+        vector<uint64_t> locusOffsets;
+        vector<Locus> loci;
+        
+        loci.reserve(hashLoci.size());
+        
+        for ( uint64_t i = 0; i < hashLoci.size(); i++ )
+        {
+            if ( i == 0 || hashLoci[i].hash != hashLoci[i - 1].hash )
+            {
+                locusHashes.push_back(hashLoci[i].hash);
+                locusOffsets.push_back(i);
+            }
+            
+            loci.push_back(Locus(hashLoci[i].sequence, hashLoci[i].position));
+        }
+        
+        locusOffsets.push_back(loci.size());
+        locusIndex.setBuilt(locusHashes, locusOffsets, loci);
+        
+        // the index replaces the per-reference lists (see writeToCapnp())
+        //
+        vector<vector<PositionHash>>().swap(positionHashesByReference);
     }
     
     kmerSpace = pow(parameters.alphabetSize, parameters.kmerSize);
 }
 
+static const uint32_t symbolInvalid = 0xffffffff;
+
+// Decodes UTF-8 into code points. Malformed bytes, controls and spaces (which
+// can't be part of a k-mer) become symbolInvalid, one per byte.
+//
+void decodeUtf8(const char * seq, uint64_t length, vector<uint32_t> & symbolsToSet)
+{
+	const unsigned char * bytes = (const unsigned char *)seq;
+	
+	symbolsToSet.clear();
+	symbolsToSet.reserve(length);
+	
+	for ( uint64_t i = 0; i < length; )
+	{
+		unsigned char byte = bytes[i];
+		int extra;
+		uint32_t symbol;
+		
+		if ( byte < 0x80 )
+		{
+			symbolsToSet.push_back(byte <= ' ' || byte == 0x7f ? symbolInvalid : byte);
+			i++;
+			continue;
+		}
+		else if ( (byte & 0xe0) == 0xc0 )
+		{
+			extra = 1;
+			symbol = byte & 0x1f;
+		}
+		else if ( (byte & 0xf0) == 0xe0 )
+		{
+			extra = 2;
+			symbol = byte & 0x0f;
+		}
+		else if ( (byte & 0xf8) == 0xf0 )
+		{
+			extra = 3;
+			symbol = byte & 0x07;
+		}
+		else
+		{
+			symbolsToSet.push_back(symbolInvalid);
+			i++;
+			continue;
+		}
+		
+		int j = 1;
+		
+		for ( ; j <= extra && i + j < length && (bytes[i + j] & 0xc0) == 0x80; j++ )
+		{
+			symbol = symbol << 6 | (bytes[i + j] & 0x3f);
+		}
+		
+		if ( j <= extra )
+		{
+			symbolsToSet.push_back(symbolInvalid);
+			i++;
+			continue;
+		}
+		
+		symbolsToSet.push_back(symbol);
+		i += extra + 1;
+	}
+}
+
+void addMinHashesUnicode(MinHashHeap & minHashHeap, const char * seq, uint64_t length, const Sketch::Parameters & parameters)
+{
+	// Same as for bytes, over code points (hashed as 32-bit little-endian
+	// values), decoded once per sequence. There is no reverse complement.
+	
+	uint64_t kmerSize = parameters.kmerSize;
+	vector<uint32_t> symbols;
+	
+	decodeUtf8(seq, length, symbols);
+	
+	uint64_t valid = 0; // run of valid symbols ending at i
+	uint64_t hashed = 0;
+	
+	for ( uint64_t i = 0; i < symbols.size(); i++ )
+	{
+		if ( symbols[i] == symbolInvalid )
+		{
+			valid = 0;
+			continue;
+		}
+		
+		if ( ++valid < kmerSize )
+		{
+			continue;
+		}
+		
+		const char * kmer = (const char *)(symbols.data() + i + 1 - kmerSize);
+		
+		minHashHeap.tryInsert(getHash(kmer, kmerSize * sizeof(uint32_t), parameters.seed, parameters.use64));
+		hashed++;
+	}
+	
+	Stats::add(Stats::KmersHashed, hashed);
+}
+
 void addMinHashes(MinHashHeap & minHashHeap, char * seq, uint64_t length, const Sketch::Parameters & parameters)
 {
+    if ( parameters.unicode )
+    {
+        addMinHashesUnicode(minHashHeap, seq, length, parameters);
+        return;
+    }
+    
     int kmerSize = parameters.kmerSize;
     uint64_t mins = parameters.minHashesPerWindow;
     bool noncanonical = parameters.noncanonical;
@@ -690,6 +1291,7 @@ void addMinHashes(MinHashHeap & minHashHeap, char * seq, uint64_t length, const
     }
     
     uint64_t j = 0;
+    uint64_t hashed = 0;
     
     for ( uint64_t i = 0; i < length - kmerSize + 1; i++ )
     {
@@ -726,334 +1328,405 @@ void addMinHashes(MinHashHeap & minHashHeap, char * seq, uint64_t length, const
         hash_u hash = getHash(kmer, kmerSize, parameters.seed, parameters.use64);
         
 		minHashHeap.tryInsert(hash);
+		hashed++;
     }
     
+    Stats::add(Stats::KmersHashed, hashed);
+    
     if ( ! noncanonical )
     {
         delete [] seqRev;
     }
 }
 
+uint64_t getCountMinBytes(const Sketch::Parameters & parameters, uint64_t kmersMaximum)
+{
+	// The count-min sketch only needs room for the distinct k-mers it will
+	// see, so a sequence of known length, or a genome size given with -g,
+	// can shrink it below the default; -b always wins.
+	
+	if ( parameters.memoryBound != 0 )
+	{
+		return parameters.memoryBound;
+	}
+	
+	uint64_t kmers = kmersMaximum;
+	
+	if ( kmers == 0 && parameters.genomeSize != 0 )
+	{
+		// (error k-mers from reads can outnumber the genome's several times)
+		
+		kmers = parameters.genomeSize * countMinGenomeFactor;
+	}
+	
+	if ( kmers == 0 )
+	{
+		return countMinBytesDefault;
+	}
+	
+	if ( parameters.scale != 0 )
+	{
+		kmers = kmers / parameters.scale + 1; // (only hashes below the maximum are counted)
+	}
+	
+	if ( kmers > countMinBytesDefault / (countMinDepth * sizeof(uint16_t)) )
+	{
+		return countMinBytesDefault;
+	}
+	
+	return kmers * countMinDepth * sizeof(uint16_t);
+}
+
+uint64_t getHashMaximum(const Sketch::Parameters & parameters)
+{
+	if ( parameters.scale == 0 )
+	{
+		return 0;
+	}
+	
+	// keeps about 1/scale of the hash space
+	
+	return parameters.use64 ? UINT64_MAX / parameters.scale : (1ull << 32) / parameters.scale;
+}
+
 void getMinHashPositions(vector<Sketch::PositionHash> & positionHashes, char * seq, uint32_t length, const Sketch::Parameters & parameters, int verbosity)
 {
     // Find positions whose hashes are min-hashes in any window of a sequence
     
     int kmerSize = parameters.kmerSize;
-    int mins = parameters.minHashesPerWindow;
-    int windowSize = parameters.windowSize;
+    uint32_t windowSize = parameters.windowSize;
     
-    int nextValidKmer = 0;
-    
-    if ( windowSize > length - kmerSize + 1 )
+    if ( length < kmerSize )
     {
-        windowSize = length - kmerSize + 1;
+        return;
     }
     
-    if ( verbosity > 1 ) cout << seq << endl << endl;
+    uint32_t kmers = length - kmerSize + 1;
     
-    // Associate positions with flags so they can be marked as min-hashes
-    // at any point while the window is moved across them
-    //
-    struct CandidateLocus
+    if ( windowSize > kmers )
     {
-        CandidateLocus(int positionNew)
-            :
-            position(positionNew),
-            isMinmer(false)
-            {}
-        
-        int position;
-        bool isMinmer;
-    };
+        windowSize = kmers;
+    }
     
-    // All potential min-hash loci in the current window organized by their
-    // hashes so repeats can be grouped and so the sorted keys can be used to
-    // keep track of the current h bottom hashes. A deque is used here (rather
-    // than a standard queue) for each list of candidate loci for the sake of
-    // debug output; the performance difference seems to be negligible.
-    //
-    map<Sketch::hash_t, deque<CandidateLocus>> candidatesByHash;
+    MinHashWindow window(windowSize, parameters.minHashesPerWindow);
     
-    // Keep references to the candidate loci in the map in the order of the
-    // current window, allowing them to be popped off in the correct order as
-    // the window is incremented.
-    //
-    queue<map<Sketch::hash_t, deque<CandidateLocus>>::iterator> windowQueue;
+    uint32_t position;
+    Sketch::hash_t hash;
     
-    // Keep a reference to the "hth" min-hash to determine efficiently whether
-    // new hashes are min-hashes. It must be decremented when a hash is inserted
-    // before it.
-    //
-    map<Sketch::hash_t, deque<CandidateLocus>>::iterator maxMinmer = candidatesByHash.end();
+    for ( uint32_t i = 0; i < kmers; i++ )
+    {
+        if ( window.push(getHash(seq + i, kmerSize, parameters.seed, parameters.use64).hash64, position, hash) ) // TODO: dynamic
+        {
+            positionHashes.push_back(Sketch::PositionHash(position, hash));
+        }
+    }
     
-    // A reference to the list of potential candidates that has just been pushed
-    // onto the back of the rolling window. During the loop, it will be assigned
-    // to either an existing list (if the kmer is repeated), a new list, or a
-    // dummy iterator (for invalid kmers).
-    //
-    map<Sketch::hash_t, deque<CandidateLocus>>::iterator newCandidates;
+    Stats::add(Stats::KmersHashed, kmers);
     
-    int unique = 0;
+    // finalize remaining min-hashes from the last window
+    //
+    while ( window.flush(position, hash) )
+    {
+        positionHashes.push_back(Sketch::PositionHash(position, hash));
+    }
     
-    for ( int i = 0; i < length - kmerSize + 1; i++ )
+    if ( verbosity > 1 )
     {
-        // Increment the next valid kmer if needed. Invalid kmers must still be
-        // processed to keep the queue filled, but will be associated with a
-        // dummy iterator. (Currently disabled to allow all kmers; see below)
-        //
-        if ( i >= nextValidKmer )
-        {
-            for ( int j = i; j < i + kmerSize; j++ )
-            {
-                char c = seq[j];
-                
-                if ( c != 'A' && c != 'C' && c != 'G' && c != 'T' )
-                {
-                    // Uncomment to skip invalid kmers
-                    //
-                    //nextValidKmer = j + 1;
-                    
-                    break;
-                }
-            }
-        }
-        
-        if ( i < nextValidKmer && verbosity > 1 )
+        cout << endl << "Minmers:" << endl;
+    
+        for ( int i = 0; i < positionHashes.size(); i++ )
         {
-            cout << "  [";
-        
-            for ( int j = i; j < i + kmerSize; j++ )
-            {
-                cout << seq[j];
-            }
-            
-            cout << "]" << endl;
+            cout << "   " << positionHashes.at(i).position << '\t' << positionHashes.at(i).hash << endl;
         }
         
-        if ( i >= nextValidKmer )
+        cout << endl;
+    }
+    
+    if ( verbosity > 0 ) cout << "   " << positionHashes.size() << " minmers across " << kmers - windowSize + 1 << " windows." << endl << endl;
+}
+
+void Sketch::LocusIndex::clear()
+{
+	vector<hash_t>().swap(hashesBuilt);
+	vector<uint64_t>().swap(offsetsBuilt);
+	vector<Locus>().swap(lociBuilt);
+	
+	mapping.reset();
+	hashCount = 0;
+	lociCount = 0;
+}
+
+void Sketch::LocusIndex::setBuilt(vector<hash_t> & hashes, vector<uint64_t> & offsets, vector<Locus> & loci)
+{
+	clear();
+	
+	hashesBuilt.swap(hashes);
+	offsetsBuilt.swap(offsets);
+	lociBuilt.swap(loci);
+	
+	hashCount = hashesBuilt.size();
+	lociCount = lociBuilt.size();
+}
+
+bool Sketch::LocusIndex::setMapped(const shared_ptr<const void> & mappingNew, const void * hashes, uint64_t hashesBytes, const void * offsets, uint64_t offsetsBytes, const void * loci, uint64_t lociBytes, uint64_t sequenceCount)
+{
+	// Check everything lookups rely on, since the file could be anything:
+	// sizes and alignment, sorted hashes, offsets from 0 to the loci count
+	// and never decreasing, and loci within the references.
+	
+	if
+	(
+		hashesBytes % sizeof(hash_t) != 0 ||
+		offsetsBytes != hashesBytes / sizeof(hash_t) * sizeof(uint64_t) + sizeof(uint64_t) ||
+		lociBytes % sizeof(Locus) != 0 ||
+		(uintptr_t)hashes % alignof(hash_t) != 0 ||
+		(uintptr_t)offsets % alignof(uint64_t) != 0 ||
+		(uintptr_t)loci % alignof(Locus) != 0
+	)
+	{
+		return false;
+	}
+	
+	uint64_t hashCountNew = hashesBytes / sizeof(hash_t);
+	uint64_t lociCountNew = lociBytes / sizeof(Locus);
+	const hash_t * hashesNew = (const hash_t *)hashes;
+	const uint64_t * offsetsNew = (const uint64_t *)offsets;
+	const Locus * lociNew = (const Locus *)loci;
+	
+	if ( offsetsNew[0] != 0 || offsetsNew[hashCountNew] != lociCountNew )
+	{
+		return false;
+	}
+	
+	for ( uint64_t i = 0; i < hashCountNew; i++ )
+	{
+		if ( offsetsNew[i + 1] < offsetsNew[i] || ( i > 0 && hashesNew[i] <= hashesNew[i - 1] ) )
+		{
+			return false;
+		}
+	}
+	
+	for ( uint64_t i = 0; i < lociCountNew; i++ )
+	{
+		if ( lociNew[i].sequence >= sequenceCount )
+		{
+			return false;
+		}
+	}
+	
+	clear();
+	
+	mapping = mappingNew;
+	hashesMapped = hashesNew;
+	offsetsMapped = offsetsNew;
+	lociMapped = lociNew;
+	hashCount = hashCountNew;
+	lociCount = lociCountNew;
+	
+	return true;
+}
+
+void getPositionHashesFromIndex(vector<vector<Sketch::PositionHash>> & positionHashesByReference, const Sketch::LocusIndex & locusIndex)
+{
+    // Invert a locus index into per-reference lists ordered by position
+    
+    const Sketch::hash_t * locusHashes = locusIndex.getHashes();
+    const uint64_t * locusOffsets = locusIndex.getOffsets();
+    const Sketch::Locus * loci = locusIndex.getLoci();
+    
+    for ( uint64_t i = 0; i < locusIndex.getHashCount(); i++ )
+    {
+        for ( uint64_t j = locusOffsets[i]; j < locusOffsets[i + 1]; j++ )
         {
-            Sketch::hash_t hash = getHash(seq + i, kmerSize, parameters.seed, parameters.use64).hash64; // TODO: dynamic
+            const Sketch::Locus & locus = loci[j];
             
-            if ( verbosity > 1 )
+            if ( locus.sequence >= positionHashesByReference.size() )
             {
-                cout << "   ";
-            
-                for ( int j = i; j < i + kmerSize; j++ )
-                {
-                    cout << seq[j]; 
-                }
-            
-                cout << "   " << i << '\t' << hash << endl;
+                positionHashesByReference.resize(locus.sequence + 1);
             }
             
-            // Get the list of candidate loci for the current hash (if it is a
-            // repeat) or insert a new list.
-            //
-            pair<map<Sketch::hash_t, deque<CandidateLocus>>::iterator, bool> inserted =
-                candidatesByHash.insert(pair<Sketch::hash_t, deque<CandidateLocus>>(hash, deque<CandidateLocus>()));
-            newCandidates = inserted.first;
-            
-            // Add the new candidate locus to the list
-            //
-            newCandidates->second.push_back(CandidateLocus(i));
-            
-            if
-            (
-                inserted.second && // inserted; decrement maxMinmer if...
-                (
-                    (
-                        // ...just reached number of mins
-                        
-                        maxMinmer == candidatesByHash.end() &&
-                        candidatesByHash.size() == mins
-                    ) ||
-                    (
-                        // ...inserted before maxMinmer
-                        
-                        maxMinmer != candidatesByHash.end() &&
-                        newCandidates->first < maxMinmer->first
-                    )
-                )
-            )
-            {
-                maxMinmer--;
-                
-                if ( i >= windowSize )
-                {
-                    unique++;
-                }
-            }
-        }
-        else
-        {
-            // Invalid kmer; use a dummy iterator to pad the queue
-            
-            newCandidates = candidatesByHash.end();
+            positionHashesByReference[locus.sequence].push_back(Sketch::PositionHash(locus.position, locusHashes[i]));
         }
+    }
+    
+    for ( uint64_t i = 0; i < positionHashesByReference.size(); i++ )
+    {
+        vector<Sketch::PositionHash> & positionHashes = positionHashesByReference[i];
         
-        // Push the new reference to the list of candidate loci for the new kmer
-        // on the back of the window to roll it.
-        //
-        windowQueue.push(newCandidates);
+        sort(positionHashes.begin(), positionHashes.end(), [](const Sketch::PositionHash & a, const Sketch::PositionHash & b) {return a.position < b.position;});
+    }
+}
+
+bool hasSuffix(string const & whole, string const & suffix)
+{
+    if (whole.length() >= suffix.length())
+    {
+        return 0 == whole.compare(whole.length() - suffix.length(), suffix.length(), suffix);
+    }
+    
+    return false;
+}
+
+void loadReferenceFromCapnp(capnp::MinHash::ReferenceList::Reference::Reader referenceReader, const Sketch::Parameters & parameters, const char * file, Sketch::Reference & reference)
+{
+    reference.name = referenceReader.getName();
+    reference.comment = referenceReader.getComment();
+    
+    if ( referenceReader.getLength64() )
+    {
+    	reference.length = referenceReader.getLength64();
+    }
+    else
+    {
+        reference.length = referenceReader.getLength();
+    }
+    
+    reference.kmersDistinct = referenceReader.getKmersDistinct();
+    reference.kmersTotal = referenceReader.getKmersTotal();
+    
+    reference.hashesSorted.setUse64(parameters.use64);
+    uint64_t hashCount;
+    bool sorted = true;
+    
+    if ( referenceReader.hasHashesPacked() )
+    {
+        // sorted and distinct by construction, so decoding can stop at
+        // the sketch size
         
-        // A reference to the front of the window, to be popped off if the
-        // window has grown to full size. This reference can be a dummy if the
-        // window is not full size or if the front of the window is a dummy
-        // representing an invalid kmer.
-        //
-        map<Sketch::hash_t, deque<CandidateLocus>>::iterator windowFront = candidatesByHash.end();
+        capnp::Data::Reader packedReader = referenceReader.getHashesPacked();
+        PackedHashReader hashesReader(packedReader.begin(), packedReader.size());
         
-        if ( windowQueue.size() > windowSize )
+        hashCount = hashesReader.size();
+        
+        if ( hashCount > parameters.minHashesPerWindow )
         {
-            windowFront = windowQueue.front();
-            windowQueue.pop();
-            
-            if ( verbosity > 1 ) cout << "   \tPOP: " << windowFront->first << endl;
+            hashCount = parameters.minHashesPerWindow;
         }
         
-        if ( windowFront != candidatesByHash.end() )
+        reference.hashesSorted.resize(hashCount);
+        
+        for ( uint64_t j = 0; j < hashCount; j++ )
         {
-            deque<CandidateLocus> & frontCandidates = windowFront->second;
+            uint64_t hash;
             
-            if ( frontCandidates.front().isMinmer )
+            if ( ! hashesReader.next(hash) )
             {
-                if ( verbosity > 1 ) cout << "   \t   minmer: " << frontCandidates.front().position << '\t' << windowFront->first << endl;
-                positionHashes.push_back(Sketch::PositionHash(frontCandidates.front().position, windowFront->first));
+                cerr << "ERROR: The hashes of " << reference.name << " in " << file << " are truncated." << endl;
+                exit(1);
             }
             
-            if ( frontCandidates.size() > 1 )
+            if ( parameters.use64 )
             {
-                frontCandidates.pop_front();
-                
-                // Since this is a repeated hash, only the locus in the front of
-                // the list was considered min-hash loci. Check if the new front
-                // will become a min-hash so it can be flagged.
-                //
-                if ( maxMinmer == candidatesByHash.end() || ( i >= windowSize && windowFront->first <= maxMinmer->first) )
-                {
-                    frontCandidates.front().isMinmer = true;
-                }
+                reference.hashesSorted.set64(j, hash);
             }
             else
             {
-                // The list for this hash is no longer needed; destroy it,
-                // repositioning the reference to the hth min-hash if
-                // necessary.
-                
-                if ( maxMinmer != candidatesByHash.end() && windowFront->first <= maxMinmer->first )
-                {
-                    maxMinmer++;
-                    
-                    if ( maxMinmer != candidatesByHash.end() )
-                    {
-                        maxMinmer->second.front().isMinmer = true;
-                    }
-                    
-                    unique++;
-                }
-            
-                candidatesByHash.erase(windowFront);
+                reference.hashesSorted.set32(j, hash);
             }
         }
-        
-        if ( i == windowSize - 1 )
+    }
+    else if ( parameters.use64 )
+    {
+        capnp::List<uint64_t>::Reader hashesReader = referenceReader.getHashes64();
+    
+    	hashCount = hashesReader.size();
+    	
+    	if ( hashCount > parameters.minHashesPerWindow )
+    	{
+    		hashCount = parameters.minHashesPerWindow;
+    	}
+    	
+        reference.hashesSorted.resize(hashCount);
+    
+        for ( uint64_t j = 0; j < hashCount; j++ )
         {
-            // first complete window; mark min-hashes
+            reference.hashesSorted.set64(j, hashesReader[j]);
             
-            for ( map<Sketch::hash_t, deque<CandidateLocus>>::iterator j = candidatesByHash.begin(); j != maxMinmer; j++ )
+            if ( j > 0 && hashesReader[j] <= hashesReader[j - 1] )
             {
-                j->second.front().isMinmer = true;
+            	sorted = false;
             }
-            
-            if ( maxMinmer != candidatesByHash.end() )
-            {
-                maxMinmer->second.front().isMinmer = true;
-            }
-            
-            unique++;
-        }
-        
-        // Mark the candidate that was pushed on the back of the window queue
-        // earlier as a min-hash if necessary
-        //
-        if ( newCandidates != candidatesByHash.end() && i >= windowSize && (maxMinmer == candidatesByHash.end() || newCandidates->first <= maxMinmer->first) )
-        {
-            newCandidates->second.front().isMinmer = true;
         }
         
-        if ( verbosity > 1 )
+        if ( ! sorted )
         {
-            for ( map<Sketch::hash_t, deque<CandidateLocus>>::iterator j = candidatesByHash.begin(); j != candidatesByHash.end(); j++ )
+        	reference.hashesSorted.resize(hashesReader.size());
+        	
+            for ( uint64_t j = 0; j < hashesReader.size(); j++ )
             {
-                cout << "   \t" << j->first;
-                
-                if ( j == maxMinmer )
-                {
-                     cout << "*";
-                }
-                
-                for ( deque<CandidateLocus>::iterator k = j->second.begin(); k != j->second.end(); k++ )
-                {
-                    cout << '\t' << k->position;
-                    
-                    if ( k->isMinmer )
-                    {
-                        cout << '!';
-                    }
-                }
-                
-                cout << endl;
+                reference.hashesSorted.set64(j, hashesReader[j]);
             }
         }
     }
-    
-    // finalize remaining min-hashes from the last window
-    //
-    while ( windowQueue.size() > 0 )
+    else
     {
-        map<Sketch::hash_t, deque<CandidateLocus>>::iterator windowFront = windowQueue.front();
-        windowQueue.pop();
-        
-        if ( windowFront != candidatesByHash.end() )
+        capnp::List<uint32_t>::Reader hashesReader = referenceReader.getHashes32();
+    	
+    	hashCount = hashesReader.size();
+    	
+    	if ( hashCount > parameters.minHashesPerWindow )
+    	{
+    		hashCount = parameters.minHashesPerWindow;
+    	}
+    	
+        reference.hashesSorted.resize(hashCount);
+    
+        for ( uint64_t j = 0; j < hashCount; j++ )
         {
-            deque<CandidateLocus> & frontCandidates = windowFront->second;
+            reference.hashesSorted.set32(j, hashesReader[j]);
             
-            if ( frontCandidates.size() > 0 )
+            if ( j > 0 && hashesReader[j] <= hashesReader[j - 1] )
             {
-                if ( frontCandidates.front().isMinmer )
-                {
-                    if ( verbosity > 1 ) cout << "   \t   minmer:" << frontCandidates.front().position << '\t' << windowFront->first << endl;
-                    positionHashes.push_back(Sketch::PositionHash(frontCandidates.front().position, windowFront->first));
-                }
-                
-                frontCandidates.pop_front();
+            	sorted = false;
+            }
+        }
+        
+        if ( ! sorted )
+        {
+        	reference.hashesSorted.resize(hashesReader.size());
+        	
+            for ( uint64_t j = 0; j < hashesReader.size(); j++ )
+            {
+                reference.hashesSorted.set32(j, hashesReader[j]);
             }
         }
     }
     
-    if ( verbosity > 1 )
+    if ( ! sorted )
     {
-        cout << endl << "Minmers:" << endl;
-    
-        for ( int i = 0; i < positionHashes.size(); i++ )
-        {
-            cout << "   " << positionHashes.at(i).position << '\t' << positionHashes.at(i).hash << endl;
-        }
-        
-        cout << endl;
+    	// Fingerprint sketches used to be written with every hash in file
+    	// order; make them bottom-k sets like any other sketch.
+    	
+    	reference.hashesSorted.sort();
+    	reference.hashesSorted.unique();
+    	
+    	hashCount = reference.hashesSorted.size();
+    	
+    	if ( hashCount > parameters.minHashesPerWindow )
+    	{
+    		hashCount = parameters.minHashesPerWindow;
+    	}
+    	
+    	reference.hashesSorted.resize(hashCount);
     }
     
-    if ( verbosity > 0 ) cout << "   " << positionHashes.size() << " minmers across " << length - windowSize - kmerSize + 2 << " windows (" << unique << " windows with distinct minmer sets)." << endl << endl;
-}
-
-bool hasSuffix(string const & whole, string const & suffix)
-{
-    if (whole.length() >= suffix.length())
+    if ( referenceReader.hasCounts32() && sorted )
     {
-        return 0 == whole.compare(whole.length() - suffix.length(), suffix.length(), suffix);
+		capnp::List<uint32_t>::Reader countsReader = referenceReader.getCounts32();
+	
+		reference.counts.resize(hashCount);
+	
+		for ( uint64_t j = 0; j < hashCount; j++ )
+		{
+			reference.counts[j] = countsReader[j];
+		}
+    }
+    else
+    {
+        reference.counts.clear();
     }
     
-    return false;
+    reference.countsSorted = referenceReader.getCounts32Sorted();
 }
 
 Sketch::SketchOutput * loadCapnp(Sketch::SketchInput * input)
@@ -1089,87 +1762,53 @@ Sketch::SketchOutput * loadCapnp(Sketch::SketchInput * input)
     
     for ( uint64_t i = 0; i < referencesReader.size(); i++ )
     {
-        capnp::MinHash::ReferenceList::Reference::Reader referenceReader = referencesReader[i];
+        loadReferenceFromCapnp(referencesReader[i], input->parameters, file, references[i]);
+    }
+    
+    // The mapping stays while a locus index uses it in place.
+    //
+    uint64_t mappingSize = fileInfo.st_size;
+    shared_ptr<const void> mapping(data, [mappingSize](const void * address) {munmap((void *)address, mappingSize);});
+    
+    bool indexed = false;
+    
+    if ( reader.hasLocusIndex() && reader.getLocusIndex().getHashes().size() != 0 )
+    {
+        // flat index; use the arrays rather than parsing the locus list,
+        // unless they're inconsistent
         
-        Sketch::Reference & reference = references[i];
+        capnp::MinHash::LocusIndex::Reader locusIndexReader = reader.getLocusIndex();
+        capnp::Data::Reader hashesReader = locusIndexReader.getHashes();
+        capnp::Data::Reader offsetsReader = locusIndexReader.getOffsets();
+        capnp::Data::Reader lociReader = locusIndexReader.getLoci();
         
-        reference.name = referenceReader.getName();
-        reference.comment = referenceReader.getComment();
+        indexed = output->locusIndex.setMapped(mapping, hashesReader.begin(), hashesReader.size(), offsetsReader.begin(), offsetsReader.size(), lociReader.begin(), lociReader.size(), references.size());
         
-        if ( referenceReader.getLength64() )
+        if ( ! indexed )
         {
-        	reference.length = referenceReader.getLength64();
+            cerr << "WARNING: The locus index of " << file << " is invalid; reading its locus list instead." << endl;
         }
-        else
-        {
-	        reference.length = referenceReader.getLength();
-	    }
-        
-        reference.hashesSorted.setUse64(input->parameters.use64);
-        uint64_t hashCount;
-        
-        if ( input->parameters.use64 )
-        {
-            capnp::List<uint64_t>::Reader hashesReader = referenceReader.getHashes64();
+    }
+    
+    if ( ! indexed )
+    {
+        capnp::MinHash::LocusList::Reader locusListReader = reader.getLocusList();
+        capnp::List<capnp::MinHash::LocusList::Locus>::Reader lociReader = locusListReader.getLoci();
         
-        	hashCount = hashesReader.size();
-        	
-        	if ( hashCount > input->parameters.minHashesPerWindow )
-        	{
-        		hashCount = input->parameters.minHashesPerWindow;
-        	}
-        	
-            reference.hashesSorted.resize(hashCount);
+        output->positionHashesByReference.resize(references.size());
         
-            for ( uint64_t j = 0; j < hashCount; j++ )
-            {
-                reference.hashesSorted.set64(j, hashesReader[j]);
-            }
-        }
-        else
+        for ( uint64_t i = 0; i < lociReader.size(); i++ )
         {
-            capnp::List<uint32_t>::Reader hashesReader = referenceReader.getHashes32();
-        	
-        	hashCount = hashesReader.size();
-        	
-        	if ( hashCount > input->parameters.minHashesPerWindow )
-        	{
-        		hashCount = input->parameters.minHashesPerWindow;
-        	}
-        	
-            reference.hashesSorted.resize(hashCount);
-        
-            for ( uint64_t j = 0; j < hashCount; j++ )
+            capnp::MinHash::LocusList::Locus::Reader locusReader = lociReader[i];
+            //cout << locusReader.getHash64() << '\t' << locusReader.getSequence() << '\t' << locusReader.getPosition() << endl;
+            
+            if ( locusReader.getSequence() >= references.size() )
             {
-                reference.hashesSorted.set32(j, hashesReader[j]);
+                continue;
             }
+            
+            output->positionHashesByReference[locusReader.getSequence()].push_back(Sketch::PositionHash(locusReader.getPosition(), locusReader.getHash64()));
         }
-        
-        if ( referenceReader.hasCounts32() )
-        {
-			capnp::List<uint32_t>::Reader countsReader = referenceReader.getCounts32();
-		
-			reference.counts.resize(hashCount);
-		
-			for ( uint64_t j = 0; j < hashCount; j++ )
-			{
-				reference.counts[j] = countsReader[j];
-			}
-        }
-        
-        reference.countsSorted = referenceReader.getCounts32Sorted();
-    }
-    
-    capnp::MinHash::LocusList::Reader locusListReader = reader.getLocusList();
-    capnp::List<capnp::MinHash::LocusList::Locus>::Reader lociReader = locusListReader.getLoci();
-    
-    output->positionHashesByReference.resize(references.size());
-    
-    for ( uint64_t i = 0; i < lociReader.size(); i++ )
-    {
-        capnp::MinHash::LocusList::Locus::Reader locusReader = lociReader[i];
-        //cout << locusReader.getHash64() << '\t' << locusReader.getSequence() << '\t' << locusReader.getPosition() << endl;
-        output->positionHashesByReference[locusReader.getSequence()].push_back(Sketch::PositionHash(locusReader.getPosition(), locusReader.getHash64()));
     }
     
     /*
@@ -1211,7 +1850,9 @@ Sketch::SketchOutput * loadCapnp(Sketch::SketchInput * input)
     cout << endl;
     */
     
-    munmap(data, fileInfo.st_size);
+    Stats::add(Stats::BytesRead, fileInfo.st_size);
+    Stats::add(Stats::RecordsRead, references.size());
+    
     close(fd);
     delete message;
     
@@ -1219,6 +1860,420 @@ Sketch::SketchOutput * loadCapnp(Sketch::SketchInput * input)
 }
 
 
+void copyReferenceReduced(capnp::MinHash::ReferenceList::Reference::Reader referenceReader, capnp::MinHash::ReferenceList::Reference::Builder referenceBuilder, const Sketch & sketch, bool packed)
+{
+	// Field by field, for references whose hashes must be cut to the sketch
+	// size or packed (see loadCapnp()).
+	
+	bool use64 = sketch.getUse64();
+	HashList hashes(use64);
+	uint64_t hashCount;
+	bool sorted = true;
+	
+	if ( referenceReader.hasHashesPacked() )
+	{
+		capnp::Data::Reader packedReader = referenceReader.getHashesPacked();
+		PackedHashReader hashesReader(packedReader.begin(), packedReader.size());
+		uint64_t hash;
+		
+		while ( hashesReader.next(hash) )
+		{
+			if ( use64 )
+			{
+				hashes.push_back64(hash);
+			}
+			else
+			{
+				hashes.push_back32(hash);
+			}
+		}
+	}
+	else if ( use64 )
+	{
+		capnp::List<uint64_t>::Reader hashesReader = referenceReader.getHashes64();
+		
+		for ( uint64_t i = 0; i < hashesReader.size(); i++ )
+		{
+			hashes.push_back64(hashesReader[i]);
+			sorted = sorted && (i == 0 || hashesReader[i] > hashesReader[i - 1]);
+		}
+	}
+	else
+	{
+		capnp::List<uint32_t>::Reader hashesReader = referenceReader.getHashes32();
+		
+		for ( uint64_t i = 0; i < hashesReader.size(); i++ )
+		{
+			hashes.push_back32(hashesReader[i]);
+			sorted = sorted && (i == 0 || hashesReader[i] > hashesReader[i - 1]);
+		}
+	}
+	
+	if ( ! sorted )
+	{
+		hashes.sort();
+		hashes.unique();
+	}
+	
+	hashCount = hashes.size();
+	
+	if ( hashCount > sketch.getMinHashesPerWindow() )
+	{
+		hashCount = sketch.getMinHashesPerWindow();
+	}
+	
+	hashes.resize(hashCount);
+	
+	referenceBuilder.setName(referenceReader.getName());
+	referenceBuilder.setComment(referenceReader.getComment());
+	referenceBuilder.setLength64(referenceReader.getLength64() ? referenceReader.getLength64() : referenceReader.getLength());
+	referenceBuilder.setKmersDistinct(referenceReader.getKmersDistinct());
+	referenceBuilder.setKmersTotal(referenceReader.getKmersTotal());
+	
+	vector<uint8_t> hashesPacked;
+	
+	if ( packed && packHashes(hashes, hashesPacked) )
+	{
+		memcpy(referenceBuilder.initHashesPacked(hashesPacked.size()).begin(), hashesPacked.data(), hashesPacked.size());
+	}
+	else if ( use64 )
+	{
+		capnp::List<uint64_t>::Builder hashes64Builder = referenceBuilder.initHashes64(hashCount);
+		
+		for ( uint64_t i = 0; i < hashCount; i++ )
+		{
+			hashes64Builder.set(i, hashes.at(i).hash64);
+		}
+	}
+	else
+	{
+		capnp::List<uint32_t>::Builder hashes32Builder = referenceBuilder.initHashes32(hashCount);
+		
+		for ( uint64_t i = 0; i < hashCount; i++ )
+		{
+			hashes32Builder.set(i, hashes.at(i).hash32);
+		}
+	}
+	
+	if ( referenceReader.hasCounts32() && sorted )
+	{
+		capnp::List<uint32_t>::Reader countsReader = referenceReader.getCounts32();
+		capnp::List<uint32_t>::Builder countsBuilder = referenceBuilder.initCounts32(hashCount);
+		
+		for ( uint64_t i = 0; i < hashCount; i++ )
+		{
+			countsBuilder.set(i, countsReader[i]);
+		}
+		
+		referenceBuilder.setCounts32Sorted(referenceReader.getCounts32Sorted());
+	}
+}
+
+int pasteCapnp(const vector<string> & files, const char * fileOut, bool packed)
+{
+	StatsPhase phase(Stats::Load);
+	
+	if ( files.size() == 0 )
+	{
+		cerr << "ERROR: No sketches to paste." << endl;
+		return 1;
+	}
+	
+	// Headers first: the output takes the parameters of the first file, and
+	// its reference list is sized to the files that match them.
+	
+	Sketch sketch;
+	vector<string> filesGood;
+	vector<uint64_t> sizes;
+	uint64_t referenceCount = 0;
+	uint64_t bytes = 0;
+	
+	for ( int i = 0; i < files.size(); i++ )
+	{
+		Sketch sketchTest;
+		uint64_t count = sketchTest.initParametersFromCapnp(files[i].c_str());
+		
+		if ( i == 0 )
+		{
+			sketch.initParametersFromCapnp(files[i].c_str());
+		}
+		
+		string alphabet;
+		string alphabetTest;
+		
+		sketch.getAlphabetAsString(alphabet);
+		sketchTest.getAlphabetAsString(alphabetTest);
+		
+		if ( alphabet != alphabetTest )
+		{
+			cerr << "\nWARNING: The sketch file " << files[i] << " has different alphabet (" << alphabetTest << ") than the current alphabet (" << alphabet << "). This file will be skipped." << endl << endl;
+			continue;
+		}
+		
+		if ( sketchTest.getHashSeed() != sketch.getHashSeed() || sketchTest.getHashScheme() != sketch.getHashScheme() )
+		{
+			cerr << "\nWARNING: The sketch " << files[i] << " has a seed (" << sketchTest.getHashSeed() << ") or hash scheme that does not match the current one. This file will be skipped." << endl << endl;
+			continue;
+		}
+		
+		if ( sketchTest.getScale() != sketch.getScale() )
+		{
+			cerr << "\nWARNING: The sketch " << files[i] << " has a scale (" << sketchTest.getScale() << ") that does not match the current scale (" << sketch.getScale() << "; 0 is bottom-k). This file will be skipped." << endl << endl;
+			continue;
+		}
+		
+		if ( sketchTest.getKmerSize() != sketch.getKmerSize() )
+		{
+			cerr << "\nWARNING: The sketch " << files[i] << " has a kmer size (" << sketchTest.getKmerSize() << ") that does not match the current kmer size (" << sketch.getKmerSize() << "). This file will be skipped." << endl << endl;
+			continue;
+		}
+		
+		if ( sketchTest.getMinHashesPerWindow() < sketch.getMinHashesPerWindow() )
+		{
+			cerr << "\nWARNING: The sketch file " << files[i] << " has a target sketch size (" << sketchTest.getMinHashesPerWindow() << ") that is smaller than the current sketch size (" << sketch.getMinHashesPerWindow() << "). This file will be skipped." << endl << endl;
+			continue;
+		}
+		
+		if ( sketchTest.getNoncanonical() != sketch.getNoncanonical() )
+		{
+			cerr << "\nWARNING: The sketch file " << files[i] << " is " << (sketchTest.getNoncanonical() ? "noncanonical" : "canonical") << ", which is incompatible with the current setting. This file will be skipped." << endl << endl;
+			continue;
+		}
+		
+		if ( sketchTest.getMinHashesPerWindow() > sketch.getMinHashesPerWindow() )
+		{
+			cerr << "\nWARNING: The sketch file " << files[i] << " has a target sketch size (" << sketchTest.getMinHashesPerWindow() << ") that is larger than the current sketch size (" << sketch.getMinHashesPerWindow() << "). Its sketches will be reduced." << endl << endl;
+		}
+		
+		struct stat fileInfo;
+		stat(files[i].c_str(), &fileInfo);
+		
+		filesGood.push_back(files[i]);
+		sizes.push_back(sketchTest.getMinHashesPerWindow());
+		referenceCount += count;
+		bytes += fileInfo.st_size;
+	}
+	
+	int fd = open(fileOut, O_CREAT | O_WRONLY | O_TRUNC , 0644);
+	
+	if ( fd < 0 )
+	{
+		cerr << "ERROR: could not open " << fileOut << " for writing.\n";
+		return 1;
+	}
+	
+	// The message is built in memory, since Cap'n Proto writes segment sizes
+	// ahead of the data, but as the compact wire format copied straight from
+	// each mapped input; a first segment the size of the inputs avoids
+	// regrowing it.
+	
+	uint64_t words = bytes / sizeof(capnp::word) + 1024;
+	
+	capnp::MallocMessageBuilder message(words < (1 << 28) ? words : (1 << 28));
+	capnp::MinHash::Builder builder = message.initRoot<capnp::MinHash>();
+	
+	capnp::MinHash::ReferenceList::Builder referenceListBuilder = (sketch.getHashSeed() == 42 ? builder.initReferenceListOld() : builder.initReferenceList());
+	capnp::List<capnp::MinHash::ReferenceList::Reference>::Builder referencesBuilder = referenceListBuilder.initReferences(referenceCount);
+	
+	uint64_t index = 0;
+	
+	for ( int i = 0; i < filesGood.size(); i++ )
+	{
+		const char * file = filesGood[i].c_str();
+		int fdIn = open(file, O_RDONLY);
+		struct stat fileInfo;
+		
+		if ( fdIn < 0 || fstat(fdIn, &fileInfo) == -1 )
+		{
+			cerr << "ERROR: could not open \"" << file << "\" for reading." << endl;
+			exit(1);
+		}
+		
+		void * data = mmap(NULL, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fdIn, 0);
+		
+		if ( data == MAP_FAILED )
+		{
+			cerr << "Error: could not memory-map file " << file << " of size " << fileInfo.st_size << endl;
+			exit(1);
+		}
+		
+		capnp::ReaderOptions readerOptions;
+		
+		readerOptions.traversalLimitInWords = 1000000000000;
+		readerOptions.nestingLimit = 1000000;
+		
+		capnp::FlatArrayMessageReader * messageIn = new capnp::FlatArrayMessageReader(kj::ArrayPtr<const capnp::word>(reinterpret_cast<const capnp::word *>(data), fileInfo.st_size / sizeof(capnp::word)), readerOptions);
+		capnp::MinHash::Reader reader = messageIn->getRoot<capnp::MinHash>();
+		
+		capnp::MinHash::ReferenceList::Reader referenceListReader = reader.getReferenceList().getReferences().size() ? reader.getReferenceList() : reader.getReferenceListOld();
+		capnp::List<capnp::MinHash::ReferenceList::Reference>::Reader referencesReader = referenceListReader.getReferences();
+		
+		for ( uint64_t j = 0; j < referencesReader.size() && index < referenceCount; j++, index++ )
+		{
+			capnp::MinHash::ReferenceList::Reference::Reader referenceReader = referencesReader[j];
+			
+			if ( sizes[i] == sketch.getMinHashesPerWindow() && ( ! packed || referenceReader.hasHashesPacked() ) )
+			{
+				referencesBuilder.setWithCaveats(index, referenceReader);
+			}
+			else
+			{
+				copyReferenceReduced(referenceReader, referencesBuilder[index], sketch, packed);
+			}
+		}
+		
+		Stats::add(Stats::BytesRead, fileInfo.st_size);
+		Stats::add(Stats::RecordsRead, referencesReader.size());
+		
+		delete messageIn;
+		munmap(data, fileInfo.st_size);
+		close(fdIn);
+	}
+	
+	builder.setKmerSize(sketch.getKmerSize());
+	builder.setHashSeed(sketch.getHashSeed());
+	builder.setError(sketch.getError());
+	builder.setMinHashesPerWindow(sketch.getMinHashesPerWindow());
+	builder.setWindowSize(sketch.getWindowSize());
+	builder.setConcatenated(sketch.getConcatenated());
+	builder.setNoncanonical(sketch.getNoncanonical());
+	builder.setPreserveCase(sketch.getPreserveCase());
+	builder.setUnicode(sketch.getUnicode());
+	builder.setHashScheme(sketch.getHashScheme());
+	builder.setScale(sketch.getScale());
+	builder.setFingerprintWhole(sketch.getFingerprintWhole());
+	
+	string alphabet;
+	sketch.getAlphabetAsString(alphabet);
+	builder.setAlphabet(alphabet);
+	
+	return writeMessageToFile(message, fd, fileOut);
+}
+
+int loadReferencesFromCapnp(const char * file, const Sketch::Parameters & parameters, const function<void(const Sketch::Reference & reference)> & callback)
+{
+	// One reference at a time, decoded into the same Reference, so memory
+	// doesn't grow with the file.
+	
+	int fd = open(file, O_RDONLY);
+	struct stat fileInfo;
+	
+	if ( fd < 0 || fstat(fd, &fileInfo) == -1 )
+	{
+		cerr << "ERROR: could not open \"" << file << "\" for reading." << endl;
+		return 1;
+	}
+	
+	void * data = mmap(NULL, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	
+	if ( data == MAP_FAILED )
+	{
+		cerr << "Error: could not memory-map file " << file << " of size " << fileInfo.st_size << endl;
+		close(fd);
+		return 1;
+	}
+	
+	capnp::ReaderOptions readerOptions;
+	
+	readerOptions.traversalLimitInWords = 1000000000000;
+	readerOptions.nestingLimit = 1000000;
+	
+	capnp::FlatArrayMessageReader * message = new capnp::FlatArrayMessageReader(kj::ArrayPtr<const capnp::word>(reinterpret_cast<const capnp::word *>(data), fileInfo.st_size / sizeof(capnp::word)), readerOptions);
+	capnp::MinHash::Reader reader = message->getRoot<capnp::MinHash>();
+	
+	capnp::MinHash::ReferenceList::Reader referenceListReader = reader.getReferenceList().getReferences().size() ? reader.getReferenceList() : reader.getReferenceListOld();
+	capnp::List<capnp::MinHash::ReferenceList::Reference>::Reader referencesReader = referenceListReader.getReferences();
+	
+	Sketch::Reference reference;
+	
+	for ( uint64_t i = 0; i < referencesReader.size(); i++ )
+	{
+		loadReferenceFromCapnp(referencesReader[i], parameters, file, reference);
+		callback(reference);
+	}
+	
+	Stats::add(Stats::BytesRead, fileInfo.st_size);
+	Stats::add(Stats::RecordsRead, referencesReader.size());
+	
+	delete message;
+	munmap(data, fileInfo.st_size);
+	close(fd);
+	
+	return 0;
+}
+
+int readReferenceInfoFromCapnp(const char * file, uint64_t sketchSize, const function<void(const char * name, const char * comment, uint64_t length, uint64_t hashCount)> & callback)
+{
+	// Only the pointers of the hash lists are read, so the pages holding the
+	// hashes are never touched.
+	
+	int fd = open(file, O_RDONLY);
+	struct stat fileInfo;
+	
+	if ( fd < 0 || fstat(fd, &fileInfo) == -1 )
+	{
+		cerr << "ERROR: could not open \"" << file << "\" for reading." << endl;
+		return 1;
+	}
+	
+	void * data = mmap(NULL, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	
+	if ( data == MAP_FAILED )
+	{
+		cerr << "Error: could not memory-map file " << file << " of size " << fileInfo.st_size << endl;
+		close(fd);
+		return 1;
+	}
+	
+	capnp::ReaderOptions readerOptions;
+	
+	readerOptions.traversalLimitInWords = 1000000000000;
+	readerOptions.nestingLimit = 1000000;
+	
+	capnp::FlatArrayMessageReader * message = new capnp::FlatArrayMessageReader(kj::ArrayPtr<const capnp::word>(reinterpret_cast<const capnp::word *>(data), fileInfo.st_size / sizeof(capnp::word)), readerOptions);
+	capnp::MinHash::Reader reader = message->getRoot<capnp::MinHash>();
+	
+	capnp::MinHash::ReferenceList::Reader referenceListReader = reader.getReferenceList().getReferences().size() ? reader.getReferenceList() : reader.getReferenceListOld();
+	capnp::List<capnp::MinHash::ReferenceList::Reference>::Reader referencesReader = referenceListReader.getReferences();
+	
+	for ( uint64_t i = 0; i < referencesReader.size(); i++ )
+	{
+		capnp::MinHash::ReferenceList::Reference::Reader referenceReader = referencesReader[i];
+		uint64_t hashCount;
+		
+		if ( referenceReader.hasHashesPacked() )
+		{
+			capnp::Data::Reader packedReader = referenceReader.getHashesPacked();
+			hashCount = PackedHashReader(packedReader.begin(), packedReader.size()).size();
+		}
+		else
+		{
+			hashCount = referenceReader.hasHashes64() ? referenceReader.getHashes64().size() : referenceReader.getHashes32().size();
+		}
+		
+		if ( hashCount > sketchSize )
+		{
+			hashCount = sketchSize;
+		}
+		
+		callback
+		(
+			referenceReader.getName().cStr(),
+			referenceReader.getComment().cStr(),
+			referenceReader.getLength64() ? referenceReader.getLength64() : referenceReader.getLength(),
+			hashCount
+		);
+	}
+	
+	Stats::add(Stats::RecordsRead, referencesReader.size());
+	
+	delete message;
+	munmap(data, fileInfo.st_size);
+	close(fd);
+	
+	return 0;
+}
+
 /* Array from 0..25 of DNA complement of A..Z */
 const char complement[] = {
   'T', // 'A' = A
@@ -1259,6 +2314,7 @@ void reverseComplement(const char * src, char * dest, int length)
 
 void setAlphabetFromString(Sketch::Parameters & parameters, const char * characters)
 {
+    parameters.unicode = false;
     parameters.alphabetSize = 0;
     memset(parameters.alphabet, 0, 256);
     
@@ -1288,6 +2344,20 @@ void setAlphabetFromString(Sketch::Parameters & parameters, const char * charact
     parameters.use64 = pow(parameters.alphabetSize, parameters.kmerSize) > pow(2, 32);
 }
 
+void setAlphabetUnicode(Sketch::Parameters & parameters)
+{
+	// Any code point but controls and spaces is allowed. The symbols actually
+	// used aren't known up front, so the size (for random match chances and
+	// the hash width) is nominal.
+	
+	parameters.unicode = true;
+	parameters.noncanonical = true;
+	parameters.alphabetSize = 256;
+	memset(parameters.alphabet, 0, 256);
+	
+	parameters.use64 = pow(parameters.alphabetSize, parameters.kmerSize) > pow(2, 32);
+}
+
 void setMinHashesForReference(Sketch::Reference & reference, const MinHashHeap & hashes)
 {
     HashList & hashList = reference.hashesSorted;
@@ -1305,13 +2375,26 @@ Sketch::SketchOutput * sketchFile(Sketch::SketchInput * input)
 	output->references.resize(1);
 	Sketch::Reference & reference = output->references[0];
 	
-    MinHashHeap minHashHeap(parameters.use64, parameters.minHashesPerWindow, parameters.reads ? parameters.minCov : 1, parameters.memoryBound);
+    MinHashHeap minHashHeap(parameters.use64, parameters.minHashesPerWindow, parameters.reads ? parameters.minCov : 1, parameters.reads && parameters.minCov > 1 ? getCountMinBytes(parameters) : parameters.memoryBound, getHashMaximum(parameters));
 
 	reference.length = 0;
 	reference.hashesSorted.setUse64(parameters.use64);
 	
+	// For reads, all k-mers are also counted (in a few KB), giving distinct
+	// k-mers and coverage from the same pass. Without a noise filter, this
+	// coverage is what the min-hashes' multiplicity estimates, but from every
+	// k-mer, so target coverage (-c) is judged with less noise.
+	
+	bool coverageAll = parameters.reads && parameters.minCov == 1 && parameters.memoryBound == 0;
+	
+	if ( parameters.reads )
+	{
+		minHashHeap.countDistinct();
+	}
+	
     int l;
     int count = 0;
+    uint64_t bases = 0;
 	bool skipped = false;
 	
 	int fileCount = input->fileNames.size();
@@ -1393,6 +2476,7 @@ Sketch::SketchOutput * sketchFile(Sketch::SketchInput * input)
 		}
 		
 		count++;
+		bases += l;
 		
 		
 		//if ( verbosity > 0 && parameters.windowed ) cout << '>' << seq->name.s << " (" << l << "nt)" << endl << endl;
@@ -1407,7 +2491,7 @@ Sketch::SketchOutput * sketchFile(Sketch::SketchInput * input)
 		
 		addMinHashes(minHashHeap, (*it)->seq.s, l, parameters);
 		
-		if ( parameters.reads && parameters.targetCov > 0 && minHashHeap.estimateMultiplicity() >= parameters.targetCov )
+		if ( parameters.reads && parameters.targetCov > 0 && (coverageAll ? minHashHeap.estimateCoverage() : minHashHeap.estimateMultiplicity()) >= parameters.targetCov )
 		{
 			l = -1; // success code
 			break;
@@ -1431,8 +2515,14 @@ Sketch::SketchOutput * sketchFile(Sketch::SketchInput * input)
 		{
 			reference.length = minHashHeap.estimateSetSize();
 		}
+		
+		reference.kmersDistinct = minHashHeap.estimateDistinct();
+		reference.kmersTotal = minHashHeap.getHashesTried();
 	}
 	
+	Stats::add(Stats::BytesRead, bases);
+	Stats::add(Stats::RecordsRead, count);
+	
 	if ( count > 1 )
 	{
 		reference.comment.insert(0, " seqs] ");
@@ -1472,6 +2562,7 @@ Sketch::SketchOutput * sketchFile(Sketch::SketchInput * input)
     {
        	cerr << "Estimated genome size: " << minHashHeap.estimateSetSize() << endl;
     	cerr << "Estimated coverage:    " << minHashHeap.estimateMultiplicity() << endl;
+    	cerr << "Distinct k-mers:       " << reference.kmersDistinct << " (before filtering; coverage " << minHashHeap.estimateCoverage() << ")" << endl;
     	
     	if ( parameters.targetCov > 0 )
     	{
@@ -1496,6 +2587,9 @@ Sketch::SketchOutput * sketchSequence(Sketch::SketchInput * input)
 	output->references.resize(1);
 	Sketch::Reference & reference = output->references[0];
 	
+	Stats::add(Stats::BytesRead, input->length);
+	Stats::add(Stats::RecordsRead, 1);
+	
 	reference.length = input->length;
 	reference.name = input->name;
 	reference.comment = input->comment;
@@ -1508,7 +2602,7 @@ Sketch::SketchOutput * sketchSequence(Sketch::SketchInput * input)
 	}
 	else
 	{
-	    MinHashHeap minHashHeap(parameters.use64, parameters.minHashesPerWindow, parameters.reads ? parameters.minCov : 1);
+	    MinHashHeap minHashHeap(parameters.use64, parameters.minHashesPerWindow, parameters.reads ? parameters.minCov : 1, parameters.reads && parameters.minCov > 1 ? getCountMinBytes(parameters, input->length) : 0, getHashMaximum(parameters));
         addMinHashes(minHashHeap, input->seq, input->length, parameters);
 		setMinHashesForReference(reference, minHashHeap);
 	}
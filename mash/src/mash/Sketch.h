@@ -9,7 +9,9 @@
 
 #include "mash/capnp/MinHash.capnp.h"
 #include "robin_hood.h"
+#include <functional>
 #include <map>
+#include <memory>
 #include <vector>
 #include <string>
 #include <string.h>
@@ -24,6 +26,18 @@ static const char * suffixSketchWindowed = ".msw";
 
 static const char * alphabetNucleotide = "ACGT";
 static const char * alphabetProtein = "ACDEFGHIKLMNPQRSTVWY";
+static const char * alphabetUnicode = "UTF-8"; // (as shown and stored; see setAlphabetUnicode())
+
+// How k-mers are hashed (stored in sketch headers; see hash.h)
+//
+static const uint32_t hashSchemeMurmur = 0;
+static const uint32_t hashSchemePackedKeys = 1; // k-fingers only
+
+// Nominal sketch size of scaled sketches (see Parameters::scale), which keep
+// every hash under the threshold; stored as such so older readers see a
+// bottom-k sketch that is never truncated.
+//
+static const uint64_t minHashesPerWindowScaled = 1ull << 31;
 
 // FingerPrint section 
 static const char * suffixFingerprint = ".txt";
@@ -59,7 +73,13 @@ public:
             minCov(1),
             targetCov(0),
             genomeSize(0),
-            counts(false)
+            counts(false),
+            fingerprint(false),
+            fingerprintAcross(false),
+            fingerprintWhole(false),
+            unicode(false),
+            hashScheme(hashSchemeMurmur),
+            scale(0)
         {
         	memset(alphabet, 0, 256);
         }
@@ -84,7 +104,13 @@ public:
             minCov(other.minCov),
             targetCov(other.targetCov),
             genomeSize(other.genomeSize),
-            counts(other.counts)
+            counts(other.counts),
+            fingerprint(other.fingerprint),
+            fingerprintAcross(other.fingerprintAcross),
+            fingerprintWhole(other.fingerprintWhole),
+            unicode(other.unicode),
+            hashScheme(other.hashScheme),
+            scale(other.scale)
 		{
 			memcpy(alphabet, other.alphabet, 256);
 		}
@@ -109,7 +135,12 @@ public:
         double targetCov;
         uint64_t genomeSize;
         bool counts;
-        bool fingerprint = false; // Nuovo parametro
+        bool fingerprint; // Nuovo parametro
+        bool fingerprintAcross; // k-finger che attraversano i segmenti ('|')
+        bool fingerprintWhole; // ogni riga è un k-finger (senza -k; kmerSize è allora 1)
+        bool unicode; // k-mers of UTF-8 code points rather than bytes
+        uint32_t hashScheme;
+        uint64_t scale; // keep hashes below max/scale rather than bottom-k (0 = bottom-k; see getHashMaximum())
     };
     
     struct PositionHash
@@ -135,6 +166,41 @@ public:
         uint32_t position;
     };
     
+    // Loci of windowed sketches grouped by hash (CSR): sorted distinct hashes,
+    // the offset of each hash's loci (plus an end offset) and the loci. The
+    // arrays are either built (see createIndex()) or used in place in the
+    // mapped sketch file they were read from (see loadCapnp()).
+    //
+    class LocusIndex
+    {
+    public:
+        
+        LocusIndex() : hashesMapped(0), offsetsMapped(0), lociMapped(0), hashCount(0), lociCount(0) {}
+        
+        void clear();
+        uint64_t getHashCount() const {return hashCount;}
+        const hash_t * getHashes() const {return mapping ? hashesMapped : hashesBuilt.data();}
+        const Locus * getLoci() const {return mapping ? lociMapped : lociBuilt.data();}
+        uint64_t getLociCount() const {return lociCount;}
+        const uint64_t * getOffsets() const {return mapping ? offsetsMapped : offsetsBuilt.data();} // (getHashCount() + 1)
+        void setBuilt(std::vector<hash_t> & hashes, std::vector<uint64_t> & offsets, std::vector<Locus> & loci); // (takes the contents)
+        bool setMapped(const std::shared_ptr<const void> & mappingNew, const void * hashes, uint64_t hashesBytes, const void * offsets, uint64_t offsetsBytes, const void * loci, uint64_t lociBytes, uint64_t sequenceCount); // (false, and left as is, if the arrays aren't a valid index)
+        
+    private:
+        
+        std::vector<hash_t> hashesBuilt;
+        std::vector<uint64_t> offsetsBuilt;
+        std::vector<Locus> lociBuilt;
+        
+        std::shared_ptr<const void> mapping; // (keeps the file mapped)
+        const hash_t * hashesMapped;
+        const uint64_t * offsetsMapped;
+        const Locus * lociMapped;
+        
+        uint64_t hashCount;
+        uint64_t lociCount;
+    };
+    
 
 
     /**
@@ -183,6 +249,8 @@ public:
         HashList hashesSorted;
         std::vector<uint32_t> counts;
         bool countsSorted;
+        uint64_t kmersDistinct = 0; // (reads only; see MinHashHeap::countDistinct())
+        uint64_t kmersTotal = 0;
     };
     
     struct SketchInput
@@ -221,16 +289,22 @@ public:
     {
     	std::vector<Reference> references;
 	    std::vector<std::vector<PositionHash>> positionHashesByReference;
+	    
+	    // locus index read from a windowed sketch file, if it had one
+	    //
+	    LocusIndex locusIndex;
     };
     
     void initFromFingerprints(const std::vector<std::string> & files, const Parameters & parametersNew);
+    static void initFromFingerprints(const std::vector<Sketch *> & sketches, const std::vector<std::string> & files, const Parameters & parametersNew, const std::vector<int> & kmerSizes); // (a sketch for each k-finger size, in one pass)
     void getAlphabetAsString(std::string & alphabet) const;
     uint32_t getAlphabetSize() const {return parameters.alphabetSize;}
     bool getConcatenated() const {return parameters.concatenated;}
     float getError() const {return parameters.error;}
-    int getHashCount() const {return lociByHash.size();}
+    bool getFingerprintWhole() const {return parameters.fingerprintWhole;}
+    int getHashCount() const {return locusIndex.getHashCount();}
     uint32_t getHashSeed() const {return parameters.seed;}
-    const std::vector<Locus> & getLociByHash(hash_t hash) const;
+    uint64_t getLociByHash(hash_t hash, const Locus * & lociToSet) const;
     float getMinHashesPerWindow() const {return parameters.minHashesPerWindow;}
 	int getMinKmerSize(uint64_t reference) const;
 	bool getPreserveCase() const {return parameters.preserveCase;}
@@ -246,12 +320,16 @@ public:
     int getKmerSize() const {return parameters.kmerSize;}
     double getKmerSpace() const {return kmerSpace;}
     bool getUse64() const {return parameters.use64;}
+    bool getUnicode() const {return parameters.unicode;}
+    uint32_t getHashScheme() const {return parameters.hashScheme;}
+    uint64_t getScale() const {return parameters.scale;}
     uint64_t getWindowSize() const {return parameters.windowSize;}
     bool getNoncanonical() const {return parameters.noncanonical;}
+    const Parameters & getParameters() const {return parameters;}
     bool hasHashCounts() const {return references.size() > 0 && references.at(0).counts.size() > 0;}
-    bool hasLociByHash(hash_t hash) const {return lociByHash.count(hash);}
     int initFromFiles(const std::vector<std::string> & files, const Parameters & parametersNew, int verbosity = 0, bool enforceParameters = false, bool contain = false);
     void initFromReads(const std::vector<std::string> & files, const Parameters & parametersNew);
+    void initFromReferences(std::vector<Reference> & referencesNew, const Parameters & parametersNew); // (takes the references)
     uint64_t initParametersFromCapnp(const char * file);
     void setReferenceName(int i, const std::string name) {references[i].name = name;}
     void setReferenceComment(int i, const std::string comment) {references[i].comment = comment;}
@@ -259,7 +337,7 @@ public:
 	void useThreadOutput(SketchOutput * output);
     void warnKmerSize(uint64_t lengthMax, const std::string & lengthMaxName, double randomChance, int kMin, int warningCount) const;
     bool writeToFile() const;
-    int writeToCapnp(const char * file) const;
+    int writeToCapnp(const char * file, bool packed = false) const; // (packed: delta + bit-packed hashes; nonzero if the file could not be written)
     
 private:
     
@@ -270,7 +348,8 @@ private:
 
     robin_hood::unordered_map<std::string, int> referenceIndecesById;
     std::vector<std::vector<PositionHash>> positionHashesByReference;
-    robin_hood::unordered_map<hash_t, std::vector<Locus>> lociByHash;
+    
+    LocusIndex locusIndex; // (loci of windowed sketches)
     
     Parameters parameters;
     double kmerSpace;
@@ -278,11 +357,19 @@ private:
 };
 
 void addMinHashes(MinHashHeap & minHashHeap, char * seq, uint64_t length, const Sketch::Parameters & parameters);
+uint64_t getCountMinBytes(const Sketch::Parameters & parameters, uint64_t kmersMaximum = 0); // (for reads with -m)
+uint64_t getHashMaximum(const Sketch::Parameters & parameters); // (scaled sketches only; 0 otherwise)
 void getMinHashPositions(std::vector<Sketch::PositionHash> & loci, char * seq, uint32_t length, const Sketch::Parameters & parameters, int verbosity = 0);
+void getPositionHashesFromIndex(std::vector<std::vector<Sketch::PositionHash>> & positionHashesByReference, const Sketch::LocusIndex & locusIndex);
 bool hasSuffix(std::string const & whole, std::string const & suffix);
 Sketch::SketchOutput * loadCapnp(Sketch::SketchInput * input);
+void loadReferenceFromCapnp(capnp::MinHash::ReferenceList::Reference::Reader referenceReader, const Sketch::Parameters & parameters, const char * file, Sketch::Reference & reference);
+int loadReferencesFromCapnp(const char * file, const Sketch::Parameters & parameters, const std::function<void(const Sketch::Reference & reference)> & callback); // (one at a time, in order)
+int pasteCapnp(const std::vector<std::string> & files, const char * file, bool packed = false); // (copies references without loading them)
+int readReferenceInfoFromCapnp(const char * file, uint64_t sketchSize, const std::function<void(const char * name, const char * comment, uint64_t length, uint64_t hashCount)> & callback); // (in order, without reading hashes)
 void reverseComplement(const char * src, char * dest, int length);
 void setAlphabetFromString(Sketch::Parameters & parameters, const char * characters);
+void setAlphabetUnicode(Sketch::Parameters & parameters);
 void setMinHashesForReference(Sketch::Reference & reference, const MinHashHeap & hashes);
 Sketch::SketchOutput * sketchFile(Sketch::SketchInput * input);
 Sketch::SketchOutput * sketchSequence(Sketch::SketchInput * input);
@@ -0,0 +1,413 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#include "SketchDatabase.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+#include <sys/file.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace::std;
+
+string getDatabaseDirectory(const string & file)
+{
+	size_t slash = file.rfind('/');
+
+	return slash == string::npos ? "" : file.substr(0, slash + 1);
+}
+
+int lockSketchDatabase(const string & file)
+{
+	// The manifest itself is replaced by rename, so writers lock a separate
+	// file that stays put.
+
+	string fileLock = file + ".lock";
+	int fd = open(fileLock.c_str(), O_RDWR | O_CREAT, 0644);
+
+	if ( fd < 0 )
+	{
+		cerr << "ERROR: could not open \"" << fileLock << "\" for writing." << endl;
+		exit(1);
+	}
+
+	while ( flock(fd, LOCK_EX) != 0 && errno == EINTR );
+
+	return fd;
+}
+
+void unlockSketchDatabase(int fd)
+{
+	flock(fd, LOCK_UN);
+	close(fd);
+}
+
+bool readManifest(const string & file, vector<string> & namesToSet)
+{
+	ifstream in(file.c_str());
+
+	if ( ! in )
+	{
+		cerr << "ERROR: could not open \"" << file << "\" for reading." << endl;
+		return false;
+	}
+
+	string line;
+
+	if ( ! getline(in, line) || line != sketchDatabaseHeader )
+	{
+		cerr << "ERROR: The file \"" << file << "\" does not look like a sketch database." << endl;
+		return false;
+	}
+
+	namesToSet.clear();
+
+	while ( getline(in, line) )
+	{
+		if ( line.length() )
+		{
+			namesToSet.push_back(line);
+		}
+	}
+
+	return true;
+}
+
+bool readRetired(const string & file, vector<string> & namesToSet)
+{
+	// Segments a compaction swapped out, kept for readers that listed them
+	// before the swap; none if there is no list.
+
+	string fileRetired = file + ".retired";
+	ifstream in(fileRetired.c_str());
+
+	namesToSet.clear();
+
+	if ( ! in )
+	{
+		return true;
+	}
+
+	string line;
+
+	if ( ! getline(in, line) || line != sketchDatabaseRetiredHeader )
+	{
+		cerr << "ERROR: The file \"" << fileRetired << "\" does not look like a list of retired segments." << endl;
+		return false;
+	}
+
+	while ( getline(in, line) )
+	{
+		if ( line.length() )
+		{
+			namesToSet.push_back(line);
+		}
+	}
+
+	return true;
+}
+
+bool writeNames(const string & file, const char * header, const vector<string> & names)
+{
+	string fileTemp = file + ".tmp";
+	FILE * out = fopen(fileTemp.c_str(), "w");
+
+	if ( out == NULL )
+	{
+		cerr << "ERROR: could not open \"" << fileTemp << "\" for writing." << endl;
+		return false;
+	}
+
+	fprintf(out, "%s\n", header);
+
+	for ( int i = 0; i < names.size(); i++ )
+	{
+		fprintf(out, "%s\n", names[i].c_str());
+	}
+
+	bool success = fflush(out) == 0 && fsync(fileno(out)) == 0;
+
+	success = fclose(out) == 0 && success;
+
+	if ( ! success || rename(fileTemp.c_str(), file.c_str()) != 0 )
+	{
+		cerr << "ERROR: could not write \"" << file << "\"." << endl;
+		unlink(fileTemp.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool writeManifest(const string & file, const vector<string> & names)
+{
+	return writeNames(file, sketchDatabaseHeader, names);
+}
+
+string createSegmentName(const string & file)
+{
+	string directory = getDatabaseDirectory(file);
+	string base = file.substr(directory.length(), file.length() - directory.length() - strlen(suffixSketchDatabase));
+
+	struct timespec time;
+	clock_gettime(CLOCK_REALTIME, &time);
+
+	char buffer[64];
+
+	for ( int i = 0; ; i++ )
+	{
+		snprintf(buffer, sizeof(buffer), ".%llx-%x-%x", (unsigned long long)time.tv_sec * 1000000000ull + time.tv_nsec, (unsigned int)getpid(), i);
+
+		string name = base + buffer + suffixSketch;
+
+		if ( access((directory + name).c_str(), F_OK) != 0 )
+		{
+			return name;
+		}
+	}
+}
+
+bool isSketchDatabase(const string & file)
+{
+	return hasSuffix(file, suffixSketchDatabase);
+}
+
+bool isSketchFile(const string & file)
+{
+	return hasSuffix(file, suffixSketch) || isSketchDatabase(file);
+}
+
+bool readSketchDatabase(const string & file, vector<string> & segmentsToSet)
+{
+	vector<string> names;
+
+	if ( ! readManifest(file, names) )
+	{
+		return false;
+	}
+
+	string directory = getDatabaseDirectory(file);
+
+	segmentsToSet.clear();
+
+	for ( int i = 0; i < names.size(); i++ )
+	{
+		segmentsToSet.push_back(directory + names[i]);
+	}
+
+	return true;
+}
+
+void expandSketchDatabases(const vector<string> & files, vector<string> & filesToSet)
+{
+	for ( int i = 0; i < files.size(); i++ )
+	{
+		if ( ! isSketchDatabase(files[i]) )
+		{
+			filesToSet.push_back(files[i]);
+			continue;
+		}
+
+		vector<string> segments;
+
+		if ( ! readSketchDatabase(files[i], segments) )
+		{
+			exit(1);
+		}
+
+		if ( segments.size() == 0 )
+		{
+			cerr << "\nWARNING: The sketch database " << files[i] << " is empty." << endl << endl;
+		}
+
+		filesToSet.insert(filesToSet.end(), segments.begin(), segments.end());
+	}
+}
+
+int appendSegment(const string & file, const Sketch & sketch, const function<int(const char *)> & writeSegment)
+{
+	string directory = getDatabaseDirectory(file);
+	vector<string> names;
+
+	int lock = lockSketchDatabase(file);
+
+	if ( access(file.c_str(), F_OK) == 0 && ! readManifest(file, names) )
+	{
+		unlockSketchDatabase(lock);
+		return 1;
+	}
+
+	if ( names.size() )
+	{
+		// segments are loaded as one sketch, so they must agree
+
+		Sketch sketchTest;
+		sketchTest.initParametersFromCapnp((directory + names[0]).c_str());
+
+		string alphabet;
+		string alphabetTest;
+
+		sketch.getAlphabetAsString(alphabet);
+		sketchTest.getAlphabetAsString(alphabetTest);
+
+		if
+		(
+			sketchTest.getKmerSize() != sketch.getKmerSize() ||
+			sketchTest.getHashSeed() != sketch.getHashSeed() ||
+			sketchTest.getHashScheme() != sketch.getHashScheme() ||
+			sketchTest.getScale() != sketch.getScale() ||
+			sketchTest.getMinHashesPerWindow() != sketch.getMinHashesPerWindow() ||
+			sketchTest.getNoncanonical() != sketch.getNoncanonical() ||
+			alphabetTest != alphabet
+		)
+		{
+			cerr << "ERROR: The sketch parameters (k-mer size, seed, hash scheme, sketch size or scale, alphabet and canonicality) must match the sketch database " << file << "." << endl;
+			unlockSketchDatabase(lock);
+			return 1;
+		}
+	}
+
+	string name = createSegmentName(file);
+
+	if ( writeSegment((directory + name).c_str()) != 0 )
+	{
+		unlink((directory + name).c_str());
+		unlockSketchDatabase(lock);
+		return 1;
+	}
+
+	names.push_back(name);
+
+	if ( ! writeManifest(file, names) )
+	{
+		unlink((directory + name).c_str());
+		unlockSketchDatabase(lock);
+		return 1;
+	}
+
+	unlockSketchDatabase(lock);
+
+	return 0;
+}
+
+int appendToSketchDatabase(const string & file, const Sketch & sketch, bool packed)
+{
+	return appendSegment(file, sketch, [&](const char * fileSegment) {return sketch.writeToCapnp(fileSegment, packed);});
+}
+
+int appendToSketchDatabase(const string & file, const vector<string> & sketchFiles, bool packed)
+{
+	if ( sketchFiles.size() == 0 )
+	{
+		cerr << "ERROR: No sketches to add to " << file << "." << endl;
+		return 1;
+	}
+
+	// the segment will have the parameters of the first file
+
+	Sketch sketch;
+	sketch.initParametersFromCapnp(sketchFiles[0].c_str());
+
+	return appendSegment(file, sketch, [&](const char * fileSegment) {return pasteCapnp(sketchFiles, fileSegment, packed);});
+}
+
+int compactSketchDatabase(const string & file, bool packed)
+{
+	string directory = getDatabaseDirectory(file);
+	vector<string> names;
+
+	int lock = lockSketchDatabase(file);
+	bool success = readManifest(file, names);
+	unlockSketchDatabase(lock);
+
+	if ( ! success )
+	{
+		return 1;
+	}
+
+	if ( names.size() < 2 )
+	{
+		cerr << file << " has " << names.size() << " segment" << (names.size() == 1 ? "" : "s") << "; nothing to compact." << endl;
+		return 0;
+	}
+
+	// Merge without the lock, so appends can go on meanwhile. The segments
+	// share parameters, so this is a straight copy of their references.
+
+	vector<string> segments;
+
+	for ( int i = 0; i < names.size(); i++ )
+	{
+		segments.push_back(directory + names[i]);
+	}
+
+	cerr << "Merging " << names.size() << " segments of " << file << "..." << endl;
+
+	string name = createSegmentName(file);
+
+	if ( pasteCapnp(segments, (directory + name).c_str(), packed) != 0 )
+	{
+		unlink((directory + name).c_str());
+		return 1;
+	}
+
+	// Swap in the merged segment for the ones it was made from, which must
+	// still lead the list (appends only add to the end).
+
+	vector<string> namesNow;
+
+	lock = lockSketchDatabase(file);
+
+	if
+	(
+		! readManifest(file, namesNow) ||
+		namesNow.size() < names.size() ||
+		! equal(names.begin(), names.end(), namesNow.begin())
+	)
+	{
+		cerr << "ERROR: The sketch database " << file << " was changed by another compaction; leaving it as is." << endl;
+		unlockSketchDatabase(lock);
+		unlink((directory + name).c_str());
+		return 1;
+	}
+
+	vector<string> namesNew(1, name);
+	namesNew.insert(namesNew.end(), namesNow.begin() + names.size(), namesNow.end());
+
+	if ( ! writeManifest(file, namesNew) )
+	{
+		unlockSketchDatabase(lock);
+		unlink((directory + name).c_str());
+		return 1;
+	}
+
+	// Readers that read the old manifest may still be loading its segments,
+	// so they are only retired now; those retired by the last compaction are
+	// removed instead.
+
+	vector<string> namesRetired;
+
+	if ( ! readRetired(file, namesRetired) || ! writeNames(file + ".retired", sketchDatabaseRetiredHeader, names) )
+	{
+		cerr << "WARNING: The old segments of " << file << " could not be recorded for removal and will be left in place." << endl;
+		namesRetired.clear();
+	}
+
+	unlockSketchDatabase(lock);
+
+	for ( int i = 0; i < namesRetired.size(); i++ )
+	{
+		unlink((directory + namesRetired[i]).c_str());
+	}
+
+	cerr << "Compacted " << names.size() << " segments into " << directory + name << "." << endl;
+
+	return 0;
+}
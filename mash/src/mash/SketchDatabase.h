@@ -0,0 +1,59 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#ifndef SketchDatabase_h
+#define SketchDatabase_h
+
+#include "Sketch.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+// A sketch database (.msd) is a manifest listing sketch (.msh) segments, one
+// per line after a header line, relative to the manifest's directory. Readers
+// (Sketch::initFromFiles()) load the segments in order as one logical sketch.
+// Sketches are added as new segments, so appending costs only the new data,
+// and compaction merges segments into one. The manifest is only ever replaced
+// by renaming a complete new one over it, under a lock held by writers, so
+// readers never see a partial list and appends made while a compaction runs
+// are kept. Segments a compaction replaces are listed in <database>.retired
+// and only removed by the next compaction, so a reader that listed them just
+// before the swap can still load them.
+//
+static const char * suffixSketchDatabase = ".msd";
+static const char * sketchDatabaseHeader = "#mash-database 1";
+static const char * sketchDatabaseRetiredHeader = "#mash-database-retired 1";
+
+bool isSketchDatabase(const std::string & file);
+bool isSketchFile(const std::string & file); // sketch or database
+
+// Gives the paths of the segments of a database. Returns false (with a
+// message) if the manifest can't be read.
+//
+bool readSketchDatabase(const std::string & file, std::vector<std::string> & segmentsToSet);
+
+// Copies 'files', replacing each database with its segments. Exits if a
+// manifest can't be read, as loading does for a missing sketch.
+//
+void expandSketchDatabases(const std::vector<std::string> & files, std::vector<std::string> & filesToSet);
+
+// Writes the sketch as a new segment and adds it to the database, which is
+// created if it doesn't exist. The sketch must match the parameters of the
+// existing segments. Returns an exit code. (For packed, see writeToCapnp().)
+//
+int appendToSketchDatabase(const std::string & file, const Sketch & sketch, bool packed = false);
+
+// Same, pasting sketch files into the segment (see pasteCapnp()).
+//
+int appendToSketchDatabase(const std::string & file, const std::vector<std::string> & sketchFiles, bool packed = false);
+
+// Merges the current segments into one and swaps it in, keeping any segments
+// appended meanwhile. The old segments are retired, and those retired by the
+// previous compaction are removed. Returns an exit code.
+//
+int compactSketchDatabase(const std::string & file, bool packed = false);
+
+#endif
@@ -0,0 +1,192 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#include "Stats.h"
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+
+using namespace::std;
+
+static const char * phaseNames[] = {"other", "load", "sketch", "compare", "output"};
+
+static const char * counterNames[] =
+{
+	"bytesRead",
+	"recordsRead",
+	"kmersHashed",
+	"heapInserts",
+	"heapRejections",
+	"pairsCompared",
+	"pValuesLibrary",
+	"waitWorkers",
+	"waitMain"
+};
+
+static const char * counterDescriptions[] =
+{
+	"Bytes read",
+	"Records read",
+	"K-mers hashed",
+	"Heap inserts",
+	"Heap rejections",
+	"Pairs compared",
+	"P-values (library)",
+	"Worker wait (s)",
+	"Main wait (s)"
+};
+
+bool Stats::enabled = false;
+atomic<uint64_t> Stats::counters[Stats::CounterCount];
+
+Stats::Phase Stats::phaseCurrent = Stats::Other;
+uint64_t Stats::phaseStartWall = 0;
+uint64_t Stats::phaseStartCpu = 0;
+uint64_t Stats::phaseWall[Stats::PhaseCount] = {};
+uint64_t Stats::phaseCpu[Stats::PhaseCount] = {};
+
+uint64_t getCpuTime()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+	return time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+uint64_t getPeakMemory()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss; // (bytes)
+#else
+	return usage.ru_maxrss * 1024ull; // (kilobytes)
+#endif
+}
+
+void Stats::enable()
+{
+	enabled = true;
+	phaseStartWall = getTime();
+	phaseStartCpu = getCpuTime();
+}
+
+uint64_t Stats::getTime()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+Stats::Phase Stats::setPhase(Phase phase)
+{
+	Phase previous = phaseCurrent;
+
+	if ( ! enabled || phase == previous )
+	{
+		return previous;
+	}
+
+	uint64_t wall = getTime();
+	uint64_t cpu = getCpuTime();
+
+	phaseWall[previous] += wall - phaseStartWall;
+	phaseCpu[previous] += cpu - phaseStartCpu;
+
+	phaseCurrent = phase;
+	phaseStartWall = wall;
+	phaseStartCpu = cpu;
+
+	return previous;
+}
+
+void Stats::write(ostream & out, bool json)
+{
+	// charge the current phase up to now
+
+	Phase phase = phaseCurrent;
+	setPhase(phase == Other ? Output : Other);
+	setPhase(phase);
+
+	uint64_t wallTotal = 0;
+	uint64_t cpuTotal = 0;
+
+	for ( int i = 0; i < PhaseCount; i++ )
+	{
+		wallTotal += phaseWall[i];
+		cpuTotal += phaseCpu[i];
+	}
+
+	uint64_t memory = getPeakMemory();
+	char buffer[256];
+
+	if ( json )
+	{
+		out << "{\"phases\":{";
+
+		for ( int i = 0; i < PhaseCount; i++ )
+		{
+			snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"wall\":%.6f,\"cpu\":%.6f}", i ? "," : "", phaseNames[i], phaseWall[i] / 1e9, phaseCpu[i] / 1e9);
+			out << buffer;
+		}
+
+		snprintf(buffer, sizeof(buffer), "},\"wall\":%.6f,\"cpu\":%.6f,\"peakMemory\":%llu,\"counters\":{", wallTotal / 1e9, cpuTotal / 1e9, (unsigned long long)memory);
+		out << buffer;
+
+		for ( int i = 0; i < CounterCount; i++ )
+		{
+			out << (i ? "," : "") << '"' << counterNames[i] << "\":";
+
+			if ( i == WaitWorkers || i == WaitMain )
+			{
+				snprintf(buffer, sizeof(buffer), "%.6f", counters[i] / 1e9);
+				out << buffer;
+			}
+			else
+			{
+				out << counters[i].load();
+			}
+		}
+
+		out << "}}" << endl;
+	}
+	else
+	{
+		out << endl;
+		snprintf(buffer, sizeof(buffer), "%-20s %12s %12s\n", "Phase", "Wall (s)", "CPU (s)");
+		out << buffer;
+
+		for ( int i = 0; i < PhaseCount; i++ )
+		{
+			if ( phaseWall[i] == 0 )
+			{
+				continue;
+			}
+
+			snprintf(buffer, sizeof(buffer), "%-20s %12.3f %12.3f\n", phaseNames[i], phaseWall[i] / 1e9, phaseCpu[i] / 1e9);
+			out << buffer;
+		}
+
+		snprintf(buffer, sizeof(buffer), "%-20s %12.3f %12.3f\n\n", "total", wallTotal / 1e9, cpuTotal / 1e9);
+		out << buffer;
+
+		snprintf(buffer, sizeof(buffer), "%-20s %12.1f\n", "Peak memory (MB)", memory / 1048576.);
+		out << buffer;
+
+		for ( int i = 0; i < CounterCount; i++ )
+		{
+			if ( i == WaitWorkers || i == WaitMain )
+			{
+				snprintf(buffer, sizeof(buffer), "%-20s %12.3f\n", counterDescriptions[i], counters[i] / 1e9);
+			}
+			else
+			{
+				snprintf(buffer, sizeof(buffer), "%-20s %12llu\n", counterDescriptions[i], (unsigned long long)counters[i]);
+			}
+
+			out << buffer;
+		}
+	}
+}
@@ -0,0 +1,93 @@
+// Copyright © 2015, Battelle National Biodefense Institute (BNBI);
+// all rights reserved. Authored by: Brian Ondov, Todd Treangen,
+// Sergey Koren, and Adam Phillippy
+//
+// See the LICENSE.txt file included with this software for license information.
+
+#ifndef Stats_h
+#define Stats_h
+
+#include <atomic>
+#include <inttypes.h>
+#include <ostream>
+
+// Run statistics for --stats (see Command::run).
+//
+// Counters are process-wide and are added to in bulk (per sequence, sketch,
+// heap or comparison job, never per k-mer), so they cost one branch when
+// statistics are off. Phases are switched only by the main thread, and time
+// is charged to one phase at a time: entering a phase within another (with
+// StatsPhase) pauses the outer one, so the phases add up to the run. CPU time
+// is for the whole process, so a phase whose CPU time is well below its wall
+// time times the thread count was waiting on I/O (or on the main thread).
+//
+class Stats
+{
+public:
+
+	enum Counter
+	{
+		BytesRead, // sketch file sizes, sequence letters and fingerprint lines
+		RecordsRead, // sequences, fingerprint lines and sketches loaded
+		KmersHashed,
+		HeapInserts,
+		HeapRejections, // hashes not below the largest kept in a full heap
+		PairsCompared,
+		PValuesLibrary, // p-values that fell back to the library CDF
+		WaitWorkers, // (ns) thread pool workers waiting for input
+		WaitMain, // (ns) main thread waiting for a free worker or an output
+		CounterCount
+	};
+
+	enum Phase
+	{
+		Other,
+		Load,
+		Sketch,
+		Compare,
+		Output,
+		PhaseCount
+	};
+
+	static void add(Counter counter, uint64_t value);
+	static void enable();
+	static bool isEnabled() {return enabled;}
+	static uint64_t getTime(); // monotonic, ns
+	static Phase setPhase(Phase phase); // returns the previous phase
+	static void write(std::ostream & out, bool json);
+
+private:
+
+	static bool enabled;
+	static std::atomic<uint64_t> counters[CounterCount];
+
+	static Phase phaseCurrent;
+	static uint64_t phaseStartWall;
+	static uint64_t phaseStartCpu;
+	static uint64_t phaseWall[PhaseCount];
+	static uint64_t phaseCpu[PhaseCount];
+};
+
+// Enters a phase for the life of the object.
+//
+class StatsPhase
+{
+public:
+
+	StatsPhase(Stats::Phase phase) {previous = Stats::setPhase(phase);}
+	~StatsPhase() {Stats::setPhase(previous);}
+
+private:
+
+	Stats::Phase previous;
+};
+
+inline void Stats::add(Counter counter, uint64_t value)
+{
+	if ( enabled )
+	{
+		counters[counter].fetch_add(value, std::memory_order_relaxed);
+	}
+}
+
+#endif
@@ -5,6 +5,7 @@
 // See the LICENSE.txt file included with this software for license information.
 
 #include "ThreadPool.h"
+#include "Stats.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <iostream>
@@ -96,9 +97,19 @@ TypeOutput * ThreadPool<TypeInput, TypeOutput>::popOutputWhenAvailable()
         return 0;
     }
     
-    while ( ! outputQueueHead->ready )
+    if ( ! outputQueueHead->ready )
     {
-        pthread_cond_wait(condOutput, mutexOutput);
+        uint64_t start = Stats::isEnabled() ? Stats::getTime() : 0;
+        
+        while ( ! outputQueueHead->ready )
+        {
+            pthread_cond_wait(condOutput, mutexOutput);
+        }
+        
+        if ( Stats::isEnabled() )
+        {
+            Stats::add(Stats::WaitMain, Stats::getTime() - start);
+        }
     }
     
     TypeOutput * output = outputQueueHead->output;
@@ -128,9 +139,19 @@ void ThreadPool<TypeInput, TypeOutput>::runWhenThreadAvailable(TypeInput * input
 {
     pthread_mutex_lock(mutexInput);
     
-    while ( inputCurrent != 0 )
+    if ( inputCurrent != 0 )
     {
-        pthread_cond_wait(condInput, mutexInput);
+        uint64_t start = Stats::isEnabled() ? Stats::getTime() : 0;
+        
+        while ( inputCurrent != 0 )
+        {
+            pthread_cond_wait(condInput, mutexInput);
+        }
+        
+        if ( Stats::isEnabled() )
+        {
+            Stats::add(Stats::WaitMain, Stats::getTime() - start);
+        }
     }
     
     inputCurrent = input;
@@ -191,10 +212,17 @@ void * ThreadPool<TypeInput, TypeOutput>::thread(void * arg)
         //
         pthread_mutex_lock(threadPool->mutexInput);
         //
+        uint64_t start = Stats::isEnabled() ? Stats::getTime() : 0;
+        //
         while ( ! threadPool->finished && threadPool->inputCurrent == 0 )
         {
             pthread_cond_wait(threadPool->condInput, threadPool->mutexInput);
         }
+        //
+        if ( Stats::isEnabled() )
+        {
+            Stats::add(Stats::WaitWorkers, Stats::getTime() - start);
+        }
         
         if ( threadPool->finished )
         {
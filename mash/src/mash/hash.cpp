@@ -44,34 +44,94 @@ hash_u getHash(const char * seq, int length, uint32_t seed, bool use64)
 /** getHashFingerPrint  */
 hash_u getHashFingerPrint(const std::vector<uint64_t>& seq, int length, uint32_t seed, bool use64)
 {
-    //for ( int i = 0; i < length; i++ ) { cout << *(seq + i); } cout << endl;
+    return getHashFingerPrint(seq.data(), length, seed, use64);
+}
+
+hash_u getHashFingerPrint(const uint64_t * seq, int length, uint32_t seed, bool use64)
+{
+    // (the numbers are hashed as raw bytes, like the letters of a k-mer)
     
-#ifdef ARCH_32
-    int data[use64 ? 8 : 4];
-    MurmurHash3_x86_32(seq, length > 16 ? 16 : length, seed, data);
-    if ( use64 )
+    return getHash((const char *)seq, length, seed, use64);
+}
+
+
+bool packFingerprintKey(const uint64_t * seq, int count, uint64_t & keyLowToSet, uint64_t & keyHighToSet)
+{
+    uint64_t key[2] = {0, 0};
+    int bit = 0;
+    
+    for ( int i = 0; i < count; i++ )
     {
-        MurmurHash3_x86_32(seq + 16, length - 16, seed, data + 4);
+        uint64_t value = seq[i];
+        
+        do
+        {
+            if ( bit == 128 )
+            {
+                return false;
+            }
+            
+            uint64_t byte = (value & 0x7f) | (value >= 0x80 ? 0x80 : 0);
+            
+            key[bit / 64] |= byte << bit % 64;
+            bit += 8;
+            value >>= 7;
+        }
+        while ( value != 0 );
     }
-#else
-    int data[16];
-    MurmurHash3_x64_128(seq.data(), length, seed, data);
-#endif
     
+    keyLowToSet = key[0];
+    keyHighToSet = key[1];
+    
+    return true;
+}
+
+inline uint64_t mixBits(uint64_t x)
+{
+    // MurmurHash3 fmix64
+    
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    
+    return x;
+}
+
+hash_u getHashFingerPrintKey(uint64_t keyLow, uint64_t keyHigh, int count, uint32_t seed, bool use64)
+{
+    // (the seed is offset so no key mixes to zero; the count keeps windows
+    // that differ only by trailing zeros apart)
+    
+    uint64_t salt = mixBits((uint64_t)count + (seed + 1ull) * 0x9e3779b97f4a7c15ull);
+    uint64_t mixed = mixBits(keyLow ^ mixBits(keyHigh ^ salt));
     hash_u hash;
     
     if ( use64 )
     {
-        hash.hash64 = *((hash64_t *)data);
+        hash.hash64 = mixed;
     }
     else
     {
-        hash.hash32 = *((hash32_t *)data);
+        hash.hash32 = mixed;
     }
     
     return hash;
 }
 
+hash_u getHashFingerPrintPacked(const uint64_t * seq, int count, uint32_t seed, bool use64)
+{
+    uint64_t keyLow;
+    uint64_t keyHigh;
+    
+    if ( packFingerprintKey(seq, count, keyLow, keyHigh) )
+    {
+        return getHashFingerPrintKey(keyLow, keyHigh, count, seed, use64);
+    }
+    
+    return getHashFingerPrint(seq, count * sizeof(uint64_t), seed, use64);
+}
 
 bool hashLessThan(hash_u hash1, hash_u hash2, bool use64)
 {
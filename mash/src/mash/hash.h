@@ -23,6 +23,20 @@ union hash_u
 hash_u getHash(const char * seq, int length, uint32_t seed, bool use64);
 
 hash_u getHashFingerPrint(const std::vector<uint64_t>& seq, int length, uint32_t seed, bool use64);
+hash_u getHashFingerPrint(const uint64_t * seq, int length, uint32_t seed, bool use64); // (length in bytes)
+
+// K-finger windows of small numbers (such as factor lengths) can instead be
+// packed into a 128-bit key, each number as a varint (7 bits per byte, least
+// significant first, the high bit marking more), zero-padded. For a given
+// window length the packing is exact, but zero padding hides trailing zeros
+// ([5] and [5, 0] pack alike), so the count is mixed in with the key; whole
+// lines, whose windows vary in length, then still hash apart. Keys are hashed
+// with rounds of MurmurHash3's 64-bit finalizer; windows too large to pack are
+// hashed as getHashFingerPrint() would.
+//
+bool packFingerprintKey(const uint64_t * seq, int count, uint64_t & keyLowToSet, uint64_t & keyHighToSet);
+hash_u getHashFingerPrintKey(uint64_t keyLow, uint64_t keyHigh, int count, uint32_t seed, bool use64);
+hash_u getHashFingerPrintPacked(const uint64_t * seq, int count, uint32_t seed, bool use64);
 
 bool hashLessThan(hash_u hash1, hash_u hash2, bool use64);
 
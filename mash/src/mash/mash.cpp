@@ -12,9 +12,12 @@
 #include "CommandScreen.h"
 #include "CommandTaxScreen.h"
 #include "CommandTriangle.h"
+#include "CommandCompact.h"
 #include "CommandContain.h"
 #include "CommandInfo.h"
+#include "CommandMatrix.h"
 #include "CommandPaste.h"
+#include "CommandServe.h"
 
 int main(int argc, const char ** argv)
 {
@@ -33,8 +36,11 @@ int main(int argc, const char ** argv)
 	commandList.addCommand(new mash::CommandFind());
 //#endif
     commandList.addCommand(new mash::CommandInfo());
+    commandList.addCommand(new mash::CommandMatrix());
     commandList.addCommand(new mash::CommandPaste());
+    commandList.addCommand(new mash::CommandCompact());
     commandList.addCommand(new mash::CommandBounds());
+    commandList.addCommand(new mash::CommandServe());
     
     return commandList.run(argc, argv);
 }
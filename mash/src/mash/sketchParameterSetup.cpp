@@ -34,12 +34,6 @@ int sketchParameterSetup(Sketch::Parameters & parameters, const Command & comman
     {
         parameters.reads = true;
         parameters.memoryBound = command.getOption("memory").getArgumentAsNumber();
-        
-        if (command.getOption("minCov").active)
-        {
-            cerr << "ERROR: The option " << command.getOption("minCov").identifier << " cannot be used with " << command.getOption("memory").identifier << "." << endl;
-            return 1;
-        }
     }
     
     if (command.getOption("minCov").active || command.getOption("targetCov").active)
@@ -75,13 +69,61 @@ int sketchParameterSetup(Sketch::Parameters & parameters, const Command & comman
         return 1;
     }
     
+    if (command.hasOption("scaled") && command.getOption("scaled").active)
+    {
+        if (command.getOption("sketchSize").active || parameters.windowed)
+        {
+            cerr << "ERROR: The option " << command.getOption("scaled").identifier << " cannot be used with " << command.getOption("sketchSize").identifier << " or windowed sketches." << endl;
+            return 1;
+        }
+        
+        // Tutti gli hash sotto la soglia: la dimensione è solo nominale
+        parameters.scale = command.getOption("scaled").getArgumentAsNumber();
+        parameters.minHashesPerWindow = minHashesPerWindowScaled;
+    }
+    
+    if (command.hasOption("utf8") && command.getOption("utf8").active)
+    {
+        // Le finestre (-W, find) hashano byte grezzi e i fingerprint hanno un
+        // alfabeto proprio: nessuno dei due decodifica UTF-8
+        if (parameters.fingerprint || parameters.windowed || command.name == "find")
+        {
+            cerr << "ERROR: The option " << command.getOption("utf8").identifier << " cannot be used with fingerprints or windowed sketches." << endl;
+            return 1;
+        }
+    }
+    
     if (parameters.fingerprint)
     {
-        parameters.kmerSize = 1; // Se non applicabile a fingerprint
+        // Con -k le righe sono fingerprint interi (divisi in segmenti da '|'),
+        // tagliati in k-finger di questa lunghezza; altrimenti ogni riga è un
+        // k-finger
+        if (!command.getOption("kmer").active)
+        {
+            parameters.kmerSize = 1;
+            parameters.fingerprintWhole = true; // (-k 1 esplicito taglia invece k-finger di un numero)
+        }
+        
+        parameters.fingerprintAcross = command.hasOption("fingerprintAcross") && command.getOption("fingerprintAcross").active;
+        
+        if (command.hasOption("fingerprintPacked") && command.getOption("fingerprintPacked").active)
+        {
+            parameters.hashScheme = hashSchemePackedKeys;
+        }
         parameters.noncanonical = true; // Se fingerprint non richiede considerazioni canoniche
         // Imposta l'alfabeto per i numeri 0-9
         setAlphabetFromString(parameters, "0123456789");
     }
+    else if (command.hasOption("utf8") && command.getOption("utf8").active)
+    {
+        if (command.getOption("protein").active || command.getOption("alphabet").active || command.getOption("case").active)
+        {
+            cerr << "ERROR: The option " << command.getOption("utf8").identifier << " cannot be used with an alphabet (" << command.getOption("protein").identifier << ", " << command.getOption("alphabet").identifier << ") or " << command.getOption("case").identifier << "." << endl;
+            return 1;
+        }
+        
+        setAlphabetUnicode(parameters);
+    }
     else if (command.getOption("protein").active)
     {
         parameters.noncanonical = true;